@@ -1,48 +1,282 @@
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "poly.h"
 #include "calc_poly.h"
+#include "poly_builder.h"
+#include "poly_extmul.h"
+#include "poly_io.h"
+#include "poly_sink.h"
+#include "poly_trace.h"
+#include "spsc_queue.h"
 #include "utils.h"
 
 #define MONOS_ARR_INIT_SIZE 10
 #define MAX_COMM_LEN 10
 #define POLY_COEFF_MAX LONG_MAX
 #define POLY_COEFF_MIN LONG_MIN
-#define MAX_STACK_SIZE 100000
+#define STACK_INIT_SIZE 16
+#define INPUT_BLOCK_SIZE (1 << 20)
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+#define MAX_NUMBER_LEN 24
+#define MAX_FILE_NAME_LEN 4096
+#define PIPELINE_QUEUE_SIZE 1024
+#define PROGRAM_MAGIC "POLYPROG"
+#define PROGRAM_MAGIC_LEN 8
+#define PROGRAM_VERSION 8
+#define RECORD_MAGIC "POLYRECD"
+#define REPLAY_THRESHOLD 50
+#define REPLAY_MIN_DIFF_NS 1000
+#define BATCH_OUT_SUFFIX ".out"
+#define BATCH_ERR_SUFFIX ".err"
+#define SERVER_READ_SIZE (1 << 16)
+#define SERVER_MAX_PENDING (1 << 24)
+#define SERVER_MAX_EVENTS 64
+#define SERVER_MAX_CONNS 1024
+#define STATS_SUB_BUCKETS 4
+#define STATS_BUCKETS (64 * STATS_SUB_BUCKETS)
+#define TRACE_ARGS_LEN 64
+#define SPILL_KEEP 4
+#define SPILL_PREFETCH 2
+
+PolyRef *PolyRefNew(Poly p) {
+    PolyRef *r = malloc(sizeof(PolyRef));
+    assert(r != NULL);
+    r->p = p;
+    atomic_init(&r->refs, 1);
+    r->spillPos = -1;
+    r->compact = false;
+    return r;
+}
+
+PolyRef *PolyRefRetain(PolyRef *r) {
+    atomic_fetch_add_explicit(&r->refs, 1, memory_order_relaxed);
+    return r;
+}
+
+void PolyRefRelease(PolyRef *r) {
+    if (atomic_fetch_sub_explicit(&r->refs, 1, memory_order_acq_rel) == 1) {
+        if (r->compact)
+            PolyCompactFree(&r->p);
+        else
+            PolyDestroy(&r->p);
+        free(r);
+    }
+}
 
 PolyStack *Init() {
     PolyStack *new = malloc(sizeof(PolyStack));
     assert(new != NULL);
-    new->first = NULL;
+    new->size = 0;
+    new->spill = NULL;
+    new->spillLimit = 0;
+    new->spilled = 0;
+    new->spillEnd = 0;
+    new->truncDeg = -1;
+    new->autoOrder = false;
+    new->compactDepth = -1;
+    new->compacted = 0;
+    new->capacity = STACK_INIT_SIZE;
+    new->data = malloc(new->capacity * sizeof(PolyRef *));
+    assert(new->data != NULL);
     return new;
 }
 
+bool SetSpill(PolyStack *s, size_t limit) {
+    if (s->spill == NULL)
+        s->spill = tmpfile();
+    s->spillLimit = limit;
+    return s->spill != NULL;
+}
+
+/**
+ * Podpowiada jądru, żeby w tle wczytało z pliku wymiany
+ * SPILL_PREFETCH elementów, które zostaną wczytane jako następne.
+ * @param[in] s : stos
+ */
+static void SpillPrefetch(PolyStack *s) {
+    long from = s->spillEnd;
+    for (size_t i = s->spilled; i > 0 && i + SPILL_PREFETCH > s->spilled; i--)
+        if (s->data[i - 1]->spillPos >= 0)
+            from = s->data[i - 1]->spillPos;
+    if (from < s->spillEnd)
+        posix_fadvise(fileno(s->spill), from, s->spillEnd - from,
+                      POSIX_FADV_WILLNEED);
+}
+
+/**
+ * Wczytuje z pliku wymiany elementy stosu od szczytu prefiksu wymiany
+ * aż do elementu @p i włącznie. Plik jest obsługiwany jak stos,
+ * więc miejsce po wczytanym elemencie jest używane ponownie.
+ * @param[in] s : stos
+ * @param[in] i : indeks elementu liczony od dna stosu
+ */
+static void SpillLoad(PolyStack *s, size_t i) {
+    while (s->spilled > i) {
+        PolyRef *r = s->data[--s->spilled];
+        if (r->spillPos < 0)
+            continue;
+        if (fseek(s->spill, r->spillPos, SEEK_SET) != 0
+            || !PolyRead(s->spill, &r->p)) {
+            fprintf(stderr, "cannot read spill file\n");
+            exit(1);
+        }
+        s->spillEnd = r->spillPos;
+        r->spillPos = -1;
+    }
+    if (s->compacted > i)
+        s->compacted = i;
+    if (s->spilled > 0)
+        SpillPrefetch(s);
+}
+
+/**
+ * Przenosi najgłębsze elementy stosu do pliku wymiany, dopóki pamięć
+ * jednomianów przekracza limit. SPILL_KEEP górnych elementów zostaje
+ * w pamięci, a współdzielone uchwyty nie są wymieniane.
+ * @param[in] s : stos
+ */
+static void Spill(PolyStack *s) {
+    PolyMemStats stats;
+    PolyMemGetStats(&stats);
+    size_t live = stats.liveBytes;
+    bool wrote = false;
+    while (live > s->spillLimit && s->spilled + SPILL_KEEP < s->size) {
+        PolyRef *r = s->data[s->spilled++];
+        if (atomic_load_explicit(&r->refs, memory_order_acquire) != 1
+            || PolyIsCoeff(&r->p))
+            continue;
+        if (fseek(s->spill, s->spillEnd, SEEK_SET) != 0)
+            break;
+        PolyWrite(&r->p, s->spill);
+        if (ferror(s->spill)) {
+            clearerr(s->spill);
+            s->spillLimit = SIZE_MAX;
+            break;
+        }
+        size_t size = PolyMemSize(&r->p);
+        live = live > size ? live - size : 0;
+        if (r->compact)
+            PolyCompactFree(&r->p);
+        else
+            PolyDestroy(&r->p);
+        r->p = PolyZero();
+        r->compact = false;
+        r->spillPos = s->spillEnd;
+        s->spillEnd = ftell(s->spill);
+        wrote = true;
+    }
+    if (wrote)
+        fflush(s->spill);
+}
+
+/**
+ * Zastępuje zwartymi kopiami (PolyCompact) elementy stosu odległe od
+ * szczytu o co najmniej compactDepth, czyli przykryte już tyloma nowszymi
+ * wynikami. Każdy element jest rozpatrywany raz; współdzielone uchwyty
+ * i elementy w pliku wymiany są pomijane.
+ * @param[in] s : stos
+ */
+static void CompactStack(PolyStack *s) {
+    if (s->compactDepth < 0 || s->size <= (size_t) s->compactDepth)
+        return ;
+    size_t end = s->size - (size_t) s->compactDepth;
+    if (s->compacted < s->spilled)
+        s->compacted = s->spilled;
+    for (; s->compacted < end; s->compacted++) {
+        PolyRef *r = s->data[s->compacted];
+        if (r->compact || PolyIsCoeff(&r->p)
+            || atomic_load_explicit(&r->refs, memory_order_acquire) != 1)
+            continue;
+        Poly p = PolyCompact(&r->p);
+        if (PolyMemFailed()) {
+            PolyCompactFree(&p);
+            PolyMemClearError();
+            break;
+        }
+        PolyDestroy(&r->p);
+        r->p = p;
+        r->compact = true;
+    }
+}
+
+/**
+ * Zwraca uchwyt elementu stosu, wczytując go z pliku wymiany.
+ * @param[in] s : stos
+ * @param[in] depth : odległość od szczytu stosu (0 - szczyt)
+ * @return uchwyt
+ */
+static PolyRef *PeekRef(PolyStack *s, size_t depth) {
+    assert(depth < s->size);
+    size_t i = s->size - 1 - depth;
+    if (i < s->spilled)
+        SpillLoad(s, i);
+    return s->data[i];
+}
+
 bool IsEmpty(PolyStack *s) {
-    return s->first == NULL;
+    return s->size == 0;
 }
 
-Poly Pop(PolyStack *s) {
+PolyRef *PopRef(PolyStack *s) {
     assert(!IsEmpty(s));
-    PolyStackEl *tmp = s->first;
-    s->first = tmp->next;
-    Poly p = tmp->p;
-    free(tmp);
+    PeekRef(s, 0);
+    if (s->compacted == s->size)
+        s->compacted--;
+    return s->data[--s->size];
+}
+
+void PushRef(PolyRef *r, PolyStack *s) {
+    if (s->size == s->capacity) {
+        s->capacity *= 2;
+        s->data = realloc(s->data, s->capacity * sizeof(PolyRef *));
+        assert(s->data != NULL);
+    }
+    s->data[s->size++] = r;
+}
+
+PolyRef *TopRef(PolyStack *s) {
+    assert(!IsEmpty(s));
+    return PeekRef(s, 0);
+}
+
+Poly Pop(PolyStack *s) {
+    PolyRef *r = PopRef(s);
+    Poly p;
+    if (atomic_load_explicit(&r->refs, memory_order_acquire) == 1
+        && !r->compact) {
+        p = r->p;
+        free(r);
+    }
+    else {
+        p = PolyClone(&r->p);
+        PolyRefRelease(r);
+    }
     return p;
 }
 
 void Push(Poly p, PolyStack *s) {
-    PolyStackEl *new = malloc(sizeof(PolyStackEl));
-    assert(new != NULL);
-    new->p = p;
-    new->next = s->first;
-    s->first = new;
+    PushRef(PolyRefNew(p), s);
 }
 
 Poly Top(PolyStack *s) {
-    assert(!IsEmpty(s));
-    return s->first->p;
+    return TopRef(s)->p;
 }
 
 static inline bool ProperLetter(char c) {
@@ -53,426 +287,481 @@ static inline bool ProperDigit(char c) {
     return c >= '0' && c <= '9';
 }
 
-static int DigitNumber(long long int n) {
-    int count = 1;
-    while (n / 10) {
-        n = n / 10;
-        count++;
+/**
+ * Sesja kalkulatora: strumienie, z których czyta i do których pisze,
+ * wraz z ich buforami. Funkcje parsujące i wypisujące korzystają
+ * wyłącznie ze stanu sesji, więc niezależne sesje mogą działać
+ * równolegle w różnych wątkach.
+ */
+typedef struct Session {
+    FILE *inFile; ///< wejście
+    FILE *outFile; ///< wyjście
+    FILE *errFile; ///< wyjście błędów
+    /**
+     * Stan bufora wejścia. Jeśli wejście jest zwykłym plikiem,
+     * to jest ono w całości mapowane do pamięci, w przeciwnym wypadku
+     * wczytywane blokami po INPUT_BLOCK_SIZE bajtów.
+     */
+    struct {
+        char *data; ///< początek bufora (lub zmapowanego pliku)
+        char *pos; ///< następny nieprzeczytany znak
+        char *end; ///< koniec poprawnych danych w buforze
+        size_t mapLen; ///< długość zmapowanego pliku (0 jeśli nie mapujemy)
+        bool eof; ///< czy wejście zostało wyczerpane
+    } in;
+    /**
+     * Bufor wyjścia. Wszystko, co kalkulator wypisuje na wyjście,
+     * trafia najpierw tutaj i jest wypisywane dużymi blokami.
+     */
+    struct {
+        char data[OUTPUT_BUFFER_SIZE]; ///< bufor
+        size_t len; ///< liczba zajętych bajtów bufora
+        bool isTty; ///< czy opróżniać bufor po każdym wierszu wejścia
+    } out;
+    /**
+     * Stos jednomianów używany przez PolyPrint, współdzielony
+     * między wywołaniami.
+     */
+    struct {
+        const Mono **data; ///< jednomiany na kolejnych poziomach zagnieżdżenia
+        size_t size; ///< rozmiar zaalokowanej tablicy
+    } printStack;
+} Session;
+
+/**
+ * Przygotowuje bufor wejścia sesji.
+ */
+static void InputOpen(Session *ses) {
+    struct stat st;
+    ses->in.mapLen = 0;
+    ses->in.eof = false;
+    if (fstat(fileno(ses->inFile), &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0 && ftell(ses->inFile) == 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                         fileno(ses->inFile), 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            ses->in.data = ses->in.pos = map;
+            ses->in.end = ses->in.data + st.st_size;
+            ses->in.mapLen = st.st_size;
+            ses->in.eof = true;
+            return ;
+        }
     }
-    return count;
+    ses->in.data = malloc(INPUT_BLOCK_SIZE);
+    assert(ses->in.data != NULL);
+    ses->in.pos = ses->in.end = ses->in.data;
 }
 
 /**
- * Zwraca informację, czy dany znak 'c' dodany do 'testedNumber'
- * nie sprawi, że utworzona w ten sposób liczba wyjdzie poza zadany zakres.
+ * Zwalnia zasoby bufora wejścia.
  */
-static bool WillBeProper(long long int lowerBound, long long int upperBound,
-                         long long int testedNumber, char c_digitToAdd, int sign) {
-    assert(ProperDigit(c_digitToAdd));
-    int digitToAdd = c_digitToAdd - '0';
-    int digs = DigitNumber(testedNumber);
-    if (digs > 1)
-        if (digs == DigitNumber(lowerBound) || digs == DigitNumber(upperBound))
-            return false;
-    if (testedNumber >= LLONG_MAX/10)
-        return sign * digitToAdd <= LLONG_MAX % 10;
-    if (testedNumber <= LLONG_MIN/10)
-        return sign * digitToAdd >= LLONG_MIN % 10;
-    long long int res = testedNumber * 10 + (sign * digitToAdd);
-    return res <= upperBound && res >= lowerBound;
+static void InputClose(Session *ses) {
+    if (ses->in.mapLen > 0)
+        munmap(ses->in.data, ses->in.mapLen);
+    else
+        free(ses->in.data);
+    ses->in.data = ses->in.pos = ses->in.end = NULL;
 }
 
 /**
- * Czyta liczbę aż do momentu wczytania niepoprawnego znaku
- * (przekraczający zakres bądź niebędący cyfrą).
+ * Wczytuje kolejny blok wejścia, jeśli bieżący został już przeczytany.
+ * @return czy w buforze są jeszcze jakieś znaki
+ */
+static bool InputRefill(Session *ses) {
+    if (ses->in.pos < ses->in.end)
+        return true;
+    if (ses->in.eof)
+        return false;
+    size_t len = fread(ses->in.data, 1, INPUT_BLOCK_SIZE, ses->inFile);
+    if (len < INPUT_BLOCK_SIZE)
+        ses->in.eof = true;
+    ses->in.pos = ses->in.data;
+    ses->in.end = ses->in.data + len;
+    return len > 0;
+}
+
+/**
+ * Zwraca kolejny znak wejścia nie zdejmując go z wejścia.
+ * @return znak lub EOF
+ */
+static inline int InputPeek(Session *ses) {
+    if (ses->in.pos == ses->in.end && !InputRefill(ses))
+        return EOF;
+    return (unsigned char) *ses->in.pos;
+}
+
+/**
+ * Zdejmuje z wejścia kolejny znak.
+ * @return znak lub EOF
+ */
+static inline int InputGet(Session *ses) {
+    int c = InputPeek(ses);
+    if (c != EOF)
+        ses->in.pos++;
+    return c;
+}
+
+/**
+ * Czyta liczbę aż do momentu napotkania niepoprawnego znaku
+ * (przekraczającego zakres bądź niebędącego cyfrą), który
+ * pozostaje na wejściu.
  * errOccured jeśli poza zadanym zakresem.
  * Docelowo zwraca wynik w postaci poly_coeff_t.
  */
-static poly_coeff_t ReadNumber(long long int lowerBound, long long int upperBound,
+static poly_coeff_t ReadNumber(Session *ses, long long int lowerBound, long long int upperBound,
                        int *col, bool *errOccured) {
-    poly_coeff_t res = 0;
+    unsigned long long int res = 0, limit = upperBound;
     bool readAnything = false;
     int sign = 1;
-    char c = getchar();
-    ++*col;
+    int c = InputPeek(ses);
     if (c == '-') {
+        InputGet(ses);
+        ++*col;
         sign = -1;
         if (lowerBound >= 0) {
             *errOccured = true;
             return -1;
         }
-        c = getchar();
-        ++*col;
+        limit = -(unsigned long long int) lowerBound;
+        c = InputPeek(ses);
     }
-    while (ProperDigit(c) && !*errOccured) {
-        if (WillBeProper(lowerBound, upperBound, res, c, sign)) {
-            readAnything = true;
-            res = res * 10 + sign * (c - '0');
-            c = getchar();
-            ++*col;
-        }
-        else {
+    while (ProperDigit(c)) {
+        unsigned digit = c - '0';
+        if (digit > limit || res > (limit - digit) / 10) {
             *errOccured = true;
+            break;
         }
+        res = res * 10 + digit;
+        readAnything = true;
+        InputGet(ses);
+        ++*col;
+        c = InputPeek(ses);
     }
-    ungetc(c, stdin);
-    --*col;
     if (!readAnything)
         *errOccured = true;
-    return res;
+    if (sign > 0 || res == 0)
+        return (poly_coeff_t) res;
+    return -(poly_coeff_t) (res - 1) - 1;
 }
 
-static void PolyPrint(const Poly *p);
-
-static void MonoPrint(const Mono *m) {
-    printf("(");
-    PolyPrint(&m->p);
-    printf(",%d)", m->exp);
+/**
+ * Wypisuje zawartość bufora wyjścia.
+ */
+static void OutputFlush(Session *ses) {
+    if (ses->out.len > 0)
+        fwrite(ses->out.data, 1, ses->out.len, ses->outFile);
+    ses->out.len = 0;
 }
 
-static void PolyPrint(const Poly *p) {
-    Mono *tmp = p->first;
-    if (PolyIsCoeff(p))
-        printf("%ld", p->coeff);
-    else
-        while (tmp != NULL) {
-            MonoPrint(tmp);
-            if (tmp->next != NULL)
-                putchar('+');
-            tmp = tmp->next;
-        }
+/**
+ * Zapewnia, że w buforze wyjścia jest miejsce na @p len bajtów.
+ * @param[in] len : liczba bajtów
+ */
+static inline void OutputReserve(Session *ses, size_t len) {
+    if (ses->out.len + len > OUTPUT_BUFFER_SIZE)
+        OutputFlush(ses);
 }
 
-static void ReadTillNewLine() {
-    char c = getchar();
-    while (c != '\n')
-        c = getchar();
+/**
+ * Dopisuje znak do bufora wyjścia.
+ * @param[in] c : znak
+ */
+static inline void OutputChar(Session *ses, char c) {
+    OutputReserve(ses, 1);
+    ses->out.data[ses->out.len++] = c;
 }
 
-static void InterpreteCommand(PolyStack *s, int r, char *command) {
-    Poly p1, p2;
-    char c;
-    bool errOccured = false;
-    int mockCol = 0;
-
-    if (strcmp(command, "ZERO") == 0) {
-        Push(PolyZero(), s);
-    }
-    else if (strcmp(command, "IS_COEFF") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Top(s);
-            printf("%d\n", PolyIsCoeff(&p1));
-        }
-    }
-    else if (strcmp(command, "IS_ZERO") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Top(s);
-            printf("%d\n", PolyIsZero(&p1));
-        }
-    }
-    else if (strcmp(command, "CLONE") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            Poly p = Top(s);
-            Push(PolyClone(&p), s);
-        }
-    }
-    else if (strcmp(command, "ADD") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Pop(s);
-            if (IsEmpty(s)) {
-                Push(p1, s);
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-            }
-            else {
-                p2 = Pop(s);
-                Push(PolyAdd(&p1, &p2), s);
-                PolyDestroy(&p1);
-                PolyDestroy(&p2);
-            }
-        }
-    }
-    else if (strcmp(command, "MUL") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Pop(s);
-            if (IsEmpty(s)) {
-                Push(p1, s);
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-            }
-            else {
-                p2 = Pop(s);
-                Push(PolyMul(&p1, &p2), s);
-                PolyDestroy(&p1);
-                PolyDestroy(&p2);
-            }
-        }
-    }
-    else if (strcmp(command, "NEG") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Pop(s);
-            Push(PolyNeg(&p1), s);
-            PolyDestroy(&p1);
-        }
-    }
-    else if (strcmp(command, "SUB") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Pop(s);
-            if (IsEmpty(s)) {
-                Push(p1, s);
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-            }
-            else {
-                p2 = Pop(s);
-                Push(PolySub(&p1, &p2), s);
-                PolyDestroy(&p1);
-                PolyDestroy(&p2);
-            }
-        }
+/**
+ * Dopisuje liczbę w zapisie dziesiętnym do bufora wyjścia.
+ * @param[in] n : liczba
+ */
+static void OutputNumber(Session *ses, long n) {
+    char digits[MAX_NUMBER_LEN];
+    int it = MAX_NUMBER_LEN;
+    unsigned long u = n < 0 ? -(unsigned long) n : (unsigned long) n;
+    do {
+        digits[--it] = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    if (n < 0)
+        digits[--it] = '-';
+    OutputReserve(ses, MAX_NUMBER_LEN - it);
+    memcpy(ses->out.data + ses->out.len, digits + it, MAX_NUMBER_LEN - it);
+    ses->out.len += MAX_NUMBER_LEN - it;
+}
 
+/**
+ * Wypisuje wielomian w formacie wejściowym kalkulatora.
+ * Przechodzi drzewo iteracyjnie, więc głębokość zagnieżdżenia
+ * nie jest ograniczona rozmiarem stosu wywołań.
+ * @param[in] p : wielomian
+ */
+static void PolyPrint(Session *ses, const Poly *p) {
+    size_t depth = 0;
+    if (PolyIsCoeff(p)) {
+        OutputNumber(ses, p->coeff);
+        return ;
     }
-    else if (strcmp(command, "IS_EQ") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Pop(s);
-            if (IsEmpty(s)) {
-                Push(p1, s);
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-            }
-            else {
-                p2 = Top(s);
-                printf("%d\n", PolyIsEq(&p1, &p2));
-                Push(p1, s);
-            }
-        }
-    }
-    else if (strcmp(command, "DEG") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Top(s);
-            printf("%d\n", PolyDeg(&p1));
-        }
-    }
-    else if (strcmp(command, "DEG_BY") == 0) {
-        poly_coeff_t cf = ReadNumber(0, UINT_MAX, &mockCol, &errOccured);
-        c = getchar();
-        if (errOccured || c != '\n') {
-            fprintf(stderr, "ERROR %d WRONG VARIABLE\n", r);
-            if (c != '\n')
-                ReadTillNewLine();
-        }
-        else {
-            if (IsEmpty(s)) {
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-            }
-            else {
-                p1 = Top(s);
-                printf("%d\n", PolyDegBy(&p1, (poly_exp_t) cf));
-            }
-        }
-    }
-    else if (strcmp(command, "AT") == 0) {
-        poly_coeff_t cf = ReadNumber(POLY_COEFF_MIN, POLY_COEFF_MAX,
-            &mockCol, &errOccured);
-        c = getchar();
-        if (errOccured || c != '\n') {
-            fprintf(stderr, "ERROR %d WRONG VALUE\n", r);
-            if (c != '\n')
-                ReadTillNewLine();
-        }
-        else {
-            if (IsEmpty(s)) {
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-            }
-            else {
-                p1 = Pop(s);
-                p2 = PolyAt(&p1, cf);
-                Push(p2, s);
-                PolyDestroy(&p1);
-            }
-        }
-    }
-    else if (strcmp(command, "PRINT") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Top(s);
-            PolyPrint(&p1);
-            printf("\n");
-        }
-    }
-    else if (strcmp(command, "POP") == 0) {
-        if (IsEmpty(s)) {
-            fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-        }
-        else {
-            p1 = Pop(s);
-            PolyDestroy(&p1);
+    const Mono *m = p->first;
+    while (true) {
+        if (depth == ses->printStack.size) {
+            ses->printStack.size = ses->printStack.size == 0 ? MONOS_ARR_INIT_SIZE
+                                                   : 2 * ses->printStack.size;
+            ses->printStack.data = realloc(ses->printStack.data,
+                                      ses->printStack.size * sizeof(Mono *));
+            assert(ses->printStack.data != NULL);
         }
-    }
-    else if (strcmp(command, "COMPOSE") == 0) {
-        unsigned count = ReadNumber(0, UINT_MAX, &mockCol, &errOccured);
-        Poly res;
-        c = getchar();
-        if (errOccured || c != '\n') {
-            fprintf(stderr, "ERROR %d WRONG COUNT\n", r);
-            if (c != '\n')
-                ReadTillNewLine();
+        ses->printStack.data[depth++] = m;
+        OutputChar(ses, '(');
+        if (!PolyIsCoeff(&m->p)) {
+            m = m->p.first;
+            continue;
         }
-        else {
-            if (count > MAX_STACK_SIZE) {
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-                return ;
-            }
-            Poly arr[count];
-            if (!IsEmpty(s)) {
-                p1 = Pop(s);
+        OutputNumber(ses, m->p.coeff);
+        while (true) {
+            m = ses->printStack.data[--depth];
+            OutputChar(ses, ',');
+            OutputNumber(ses, m->exp);
+            OutputChar(ses, ')');
+            if (m->next != NULL) {
+                OutputChar(ses, '+');
+                m = m->next;
+                break;
             }
-            else {
-                fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
+            if (depth == 0)
                 return ;
-            }
-            for (unsigned i = 0; i < count; i++) {
-                if (!IsEmpty(s)) {
-                    arr[i] = Pop(s);
-                }
-                else {
-                    fprintf(stderr, "ERROR %d STACK UNDERFLOW\n", r);
-                    for (long j = i - 1; j >= 0; j--)
-                        Push(arr[j], s);
-                    Push(p1, s);
-                    free(arr);
-                    return ;
-                }
-            }
-            res = PolyCompose(&p1, count, arr);
-            for(unsigned j = 0; j < count; j++)
-                PolyDestroy(&arr[j]);
-            free(arr);
-            PolyDestroy(&p1);
-            Push(res, s);
         }
-    } /* COMPOSE */
-    else {
-        fprintf(stderr, "ERROR %d WRONG COMMAND\n", r);
     }
 }
 
-static void ReadCommand(PolyStack *s, int r) {
-    char c, command[MAX_COMM_LEN];
-    bool err;
-    int it = 0;
-    do {
-        c = getchar();
-        if (ProperLetter(c) || c == '_')
-            command[it++] = c;
-    } while (it < MAX_COMM_LEN - 1 && (ProperLetter(c) || c == '_'));
-    command[it] = '\0';
-    bool cmdWithArg = strcmp(command, "AT") == 0
-                    || strcmp(command, "DEG_BY") == 0
-                    || strcmp(command, "COMPOSE") == 0;
-    err = cmdWithArg ? c != ' ' : c != '\n';
-    if (err) {
-        if (c != '\n')
-            ReadTillNewLine();
-        fprintf(stderr, cmdWithArg ? "ERROR %d WRONG COUNT\n"
-                    : "ERROR %d WRONG COMMAND\n", r);
-        return ;
-    }
-    InterpreteCommand(s, r, command);
+static void ReadTillNewLine(Session *ses) {
+    int c = InputGet(ses);
+    while (c != '\n' && c != EOF)
+        c = InputGet(ses);
 }
 
-static inline bool MonoIsZero(Mono m) {
-    return PolyIsZero(&(m.p));
+/**
+ * Czyta nazwę pliku aż do końca wiersza (włącznie ze znakiem nowej linii).
+ * @param[out] fileName : bufor o rozmiarze MAX_FILE_NAME_LEN
+ * @return czy wczytano niepustą nazwę mieszczącą się w buforze
+ */
+static bool ReadFileName(Session *ses, char *fileName) {
+    int len = 0;
+    int c = InputGet(ses);
+    while (c != '\n' && c != EOF) {
+        if (len < MAX_FILE_NAME_LEN - 1)
+            fileName[len] = c;
+        len++;
+        c = InputGet(ses);
+    }
+    if (len == 0 || len >= MAX_FILE_NAME_LEN)
+        return false;
+    fileName[len] = '\0';
+    return c == '\n';
 }
 
-static Poly ReadPoly(int r, int *col, bool *errOccured);
+/**
+ * Rodzaje błędów zgłaszanych przez kalkulator.
+ */
+typedef enum ErrorType {
+    ERR_COLUMN, ///< błąd parsowania wielomianu w zadanej kolumnie
+    ERR_STACK_UNDERFLOW, ///< za mało wielomianów na stosie
+    ERR_WRONG_COMMAND, ///< nieznane polecenie
+    ERR_WRONG_COUNT, ///< niepoprawny parametr COMPOSE
+    ERR_WRONG_VALUE, ///< niepoprawny parametr AT, SHIFT, POW, TRUNC, REORDER
+    ERR_WRONG_VARIABLE, ///< niepoprawny parametr DEG_BY
+    ERR_WRONG_FILE, ///< niepoprawny plik SAVE lub LOAD
+    ERR_OUT_OF_MEMORY, ///< przekroczony limit pamięci
+    ERR_TIMEOUT, ///< przekroczony limit czasu wiersza
+    ERR_INTERRUPTED, ///< wiersz przerwany przez SIGINT
+    ERR_LINE_TOO_LONG ///< wiersz serwera dłuższy niż SERVER_MAX_PENDING
+} ErrorType;
+
+/**
+ * Rodzaje wierszy wejścia.
+ */
+typedef enum CommandType {
+    CMD_POLY, ///< wielomian do wrzucenia na stos
+    CMD_ZERO, ///< ZERO
+    CMD_IS_COEFF, ///< IS_COEFF
+    CMD_IS_ZERO, ///< IS_ZERO
+    CMD_CLONE, ///< CLONE
+    CMD_ADD, ///< ADD
+    CMD_MUL, ///< MUL
+    CMD_NEG, ///< NEG
+    CMD_SUB, ///< SUB
+    CMD_IS_EQ, ///< IS_EQ
+    CMD_DEG, ///< DEG
+    CMD_DEG_BY, ///< DEG_BY
+    CMD_AT, ///< AT
+    CMD_SHIFT, ///< SHIFT
+    CMD_PRINT, ///< PRINT
+    CMD_POP, ///< POP
+    CMD_COMPOSE, ///< COMPOSE
+    CMD_SAVE, ///< SAVE
+    CMD_LOAD, ///< LOAD
+    CMD_STATS, ///< STATS
+    CMD_POW, ///< POW
+    CMD_TRUNC, ///< TRUNC
+    CMD_REORDER, ///< REORDER
+    CMD_MUL_TO, ///< MUL_TO
+    CMD_DOT, ///< DOT
+    CMD_FMA, ///< FMA
+    CMD_COMPACT, ///< COMPACT
+    CMD_SUBST, ///< SUBST
+    CMD_ERROR, ///< wiersz niepoprawny
+    CMD_END ///< koniec wejścia
+} CommandType;
+
+/**
+ * Rodzaje parametrów poleceń.
+ */
+typedef enum ArgType {
+    ARG_NONE, ///< brak parametru
+    ARG_NUMBER, ///< liczba z zadanego zakresu
+    ARG_FILE ///< nazwa pliku
+} ArgType;
+
+/**
+ * Opis polecenia kalkulatora.
+ */
+typedef struct CommandDesc {
+    const char *name; ///< nazwa polecenia
+    CommandType type; ///< rodzaj polecenia
+    ArgType arg; ///< rodzaj parametru
+    long long int lowerBound; ///< najmniejsza poprawna wartość parametru
+    long long int upperBound; ///< największa poprawna wartość parametru
+    ErrorType argErr; ///< błąd zgłaszany przy niepoprawnym parametrze
+} CommandDesc;
+
+/** Polecenia kalkulatora */
+static const CommandDesc commands[] = {
+    {"ZERO", CMD_ZERO, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"IS_COEFF", CMD_IS_COEFF, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"IS_ZERO", CMD_IS_ZERO, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"CLONE", CMD_CLONE, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"ADD", CMD_ADD, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"MUL", CMD_MUL, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"NEG", CMD_NEG, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"SUB", CMD_SUB, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"IS_EQ", CMD_IS_EQ, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"DEG", CMD_DEG, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"DEG_BY", CMD_DEG_BY, ARG_NUMBER, 0, UINT_MAX, ERR_WRONG_VARIABLE},
+    {"AT", CMD_AT, ARG_NUMBER, POLY_COEFF_MIN, POLY_COEFF_MAX, ERR_WRONG_VALUE},
+    {"SHIFT", CMD_SHIFT, ARG_NUMBER, POLY_COEFF_MIN, POLY_COEFF_MAX,
+     ERR_WRONG_VALUE},
+    {"PRINT", CMD_PRINT, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"POP", CMD_POP, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"COMPOSE", CMD_COMPOSE, ARG_NUMBER, 0, UINT_MAX, ERR_WRONG_COUNT},
+    {"SAVE", CMD_SAVE, ARG_FILE, 0, 0, ERR_WRONG_FILE},
+    {"LOAD", CMD_LOAD, ARG_FILE, 0, 0, ERR_WRONG_FILE},
+    {"STATS", CMD_STATS, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"POW", CMD_POW, ARG_NUMBER, 0, INT_MAX, ERR_WRONG_VALUE},
+    {"TRUNC", CMD_TRUNC, ARG_NUMBER, -1, INT_MAX, ERR_WRONG_VALUE},
+    {"REORDER", CMD_REORDER, ARG_NUMBER, 0, 1, ERR_WRONG_VALUE},
+    {"MUL_TO", CMD_MUL_TO, ARG_FILE, 0, 0, ERR_WRONG_FILE},
+    {"DOT", CMD_DOT, ARG_NUMBER, 0, UINT_MAX, ERR_WRONG_COUNT},
+    {"FMA", CMD_FMA, ARG_NONE, 0, 0, ERR_WRONG_COMMAND},
+    {"COMPACT", CMD_COMPACT, ARG_NUMBER, -1, UINT_MAX, ERR_WRONG_VALUE},
+    {"SUBST", CMD_SUBST, ARG_NUMBER, 0, UINT_MAX, ERR_WRONG_VARIABLE},
+};
+
+/**
+ * Sparsowany wiersz wejścia.
+ */
+typedef struct Command {
+    CommandType type; ///< rodzaj wiersza
+    int line; ///< numer wiersza
+    poly_coeff_t arg; ///< parametr liczbowy
+    Poly p; ///< wielomian dla CMD_POLY
+    char *fileName; ///< nazwa pliku dla CMD_SAVE, CMD_LOAD i CMD_MUL_TO
+    ErrorType err; ///< rodzaj błędu dla CMD_ERROR
+    int col; ///< kolumna błędu dla ERR_COLUMN
+} Command;
+
+/**
+ * Rodzaje wyników wykonania wiersza.
+ */
+typedef enum ResultType {
+    RES_NONE, ///< brak wyjścia
+    RES_NUMBER, ///< liczba na standardowe wyjście
+    RES_POLY, ///< wielomian na standardowe wyjście
+    RES_ERROR, ///< błąd na standardowe wyjście błędów
+    RES_TEXT, ///< tekst na standardowe wyjście
+    RES_END ///< koniec wyników
+} ResultType;
+
+/**
+ * Wynik wykonania wiersza, czyli to, co należy wypisać.
+ */
+typedef struct Result {
+    ResultType type; ///< rodzaj wyniku
+    int line; ///< numer wiersza
+    long number; ///< liczba dla RES_NUMBER
+    PolyRef *ref; ///< wielomian dla RES_POLY (wynik jest jednym z właścicieli)
+    ErrorType err; ///< rodzaj błędu dla RES_ERROR
+    int col; ///< kolumna błędu dla ERR_COLUMN
+    char *text; ///< tekst dla RES_TEXT (wynik jest właścicielem)
+} Result;
+
+static Poly ReadPoly(Session *ses, int *col, bool *errOccured, int *errCol);
 
-static Mono ReadMono(int r, int *col, bool *errOccured) {
+static Mono ReadMono(Session *ses, int *col, bool *errOccured, int *errCol) {
     Mono m = (Mono) {.p = PolyZero(), .exp = -1};
-    char c = getchar();
-    ++*col;
-    if (c != '(') {
+    if (InputPeek(ses) != '(') {
         if (!*errOccured)
-            fprintf(stderr, "ERROR %d %d\n", r, *col);
-        ungetc(c, stdin);
-        --*col;
+            *errCol = *col + 1;
         *errOccured = true;
         return m;
     }
-    m.p = ReadPoly(r, col, errOccured);
+    InputGet(ses);
+    ++*col;
+    m.p = ReadPoly(ses, col, errOccured, errCol);
     if (*errOccured)
         return m;
-    c = getchar();
-    ++*col;
-    if (c != ',') {
+    if (InputPeek(ses) != ',') {
         if (!*errOccured)
-            fprintf(stderr, "ERROR %d %d\n", r, *col);
-        ungetc(c, stdin);
-        --*col;
+            *errCol = *col + 1;
         *errOccured = true;
         return m;
     }
-    m.exp = (poly_exp_t) ReadNumber(0, INT_MAX, col, errOccured);
+    InputGet(ses);
+    ++*col;
+    m.exp = (poly_exp_t) ReadNumber(ses, 0, INT_MAX, col, errOccured);
     if (*errOccured) {
-        fprintf(stderr, "ERROR %d %d\n", r, *col + 1);
+        *errCol = *col + 1;
         return m;
     }
-    c = getchar();
-    ++*col;
-    if (c != ')') {
+    if (InputPeek(ses) != ')') {
         if (!*errOccured)
-            fprintf(stderr, "ERROR %d %d\n", r, *col);
-        ungetc(c, stdin);
-        --*col;
+            *errCol = *col + 1;
         *errOccured = true;
+        return m;
     }
+    InputGet(ses);
+    ++*col;
     return m;
 }
 
-static Poly ReadPoly(int r, int *col, bool *errOccured) {
+static Poly ReadPoly(Session *ses, int *col, bool *errOccured, int *errCol) {
     Poly p;
     Mono mTmp;
     unsigned size = MONOS_ARR_INIT_SIZE, count = 0;
     Mono *monos = malloc(size * sizeof(Mono));
     assert(monos != NULL);
-    char c = getchar();
-    ungetc(c, stdin);
+    int c = InputPeek(ses);
     if (ProperDigit(c) || c == '-') {
-        poly_coeff_t cf = ReadNumber(POLY_COEFF_MIN, POLY_COEFF_MAX,
+        poly_coeff_t cf = ReadNumber(ses, POLY_COEFF_MIN, POLY_COEFF_MAX,
                                      col, errOccured);
         if (*errOccured) //poza zakresem
-            fprintf(stderr, "ERROR %d %d\n", r, *col + 1);
+            *errCol = *col + 1;
         p = PolyFromCoeff(cf);
         free(monos);
         return p;
     }
     else {
-        mTmp = ReadMono(r, col, errOccured);
+        mTmp = ReadMono(ses, col, errOccured, errCol);
         if (*errOccured) {
             free(monos);
             PolyDestroy(&mTmp.p);
@@ -480,11 +769,11 @@ static Poly ReadPoly(int r, int *col, bool *errOccured) {
         }
         monos[count++] = mTmp;
         while (!*errOccured) {
-            c = getchar();
-            ++*col;
-            if (c != '+')
+            if (InputPeek(ses) != '+')
                 break;
-            monos[count++] = ReadMono(r, col, errOccured);
+            InputGet(ses);
+            ++*col;
+            monos[count++] = ReadMono(ses, col, errOccured, errCol);
             if (*errOccured) {
                 for(unsigned i = 0; i < count; i++)
                     PolyDestroy(&monos[i].p);
@@ -497,75 +786,1870 @@ static Poly ReadPoly(int r, int *col, bool *errOccured) {
                 assert(monos != NULL);
             }
         } /* while */
-        if (!*errOccured) {
-            assert(c != '+');
-            ungetc(c, stdin);
-            --*col;
-        }
-    }
-    monos = realloc(monos, count * sizeof(Mono));
-    if (count == 0) {
-        assert(monos == NULL);
-        return PolyZero();
     }
     p = PolyAddMonos(count, monos);
     free(monos);
     return p;
 }
 
-static void ReadPolyLine(PolyStack *s, int r) {
-    Poly p;
-    bool errOccured = false;
-    int col = 0;
-    char c;
-    p = ReadPoly(r, &col, &errOccured);
-    if (errOccured) {
-        PolyDestroy(&p);
-        ReadTillNewLine();
-        return ;
-    }
-    else {
-        c = getchar();
-        col++;
-        if (c == '\n') {
-            Push(p, s);
-        }
-        else {
-            PolyDestroy(&p);
-            fprintf(stderr, "ERROR %d %d\n", r, col);
-            ReadTillNewLine();
-        }
+/**
+ * Ustawia wiersz jako niepoprawny.
+ * @param[out] cmd : wiersz
+ * @param[in] err : rodzaj błędu
+ */
+static inline void CommandSetError(Command *cmd, ErrorType err) {
+    cmd->type = CMD_ERROR;
+    cmd->err = err;
+}
+
+/**
+ * Zamienia wiersz z wielomianem na błąd, jeśli budowanie wielomianu
+ * przekroczyło limit pamięci.
+ * @param[in,out] cmd : wiersz
+ */
+static void CommandCheckMemory(Command *cmd) {
+    if (cmd->type == CMD_POLY && PolyMemFailed()) {
+        PolyDestroy(&cmd->p);
+        cmd->p = PolyZero();
+        CommandSetError(cmd, ERR_OUT_OF_MEMORY);
     }
 }
 
-void Read(PolyStack *s) {
-    char c;
-    int r = 1;
-    while (1) {
-        c = getchar();
-        if (c == EOF)
-            return ;
-        ungetc(c, stdin);
-        if (ProperLetter(c))
-            ReadCommand(s, r);
-        else
-            ReadPolyLine(s, r);
-        r++;
+/**
+ * Parsuje wiersz z poleceniem wraz z jego parametrem.
+ * @param[out] cmd : sparsowany wiersz
+ */
+static void ParseCommand(Session *ses, Command *cmd) {
+    char command[MAX_COMM_LEN];
+    const CommandDesc *desc = NULL;
+    int c;
+    bool err;
+    int it = 0;
+    do {
+        c = InputGet(ses);
+        if (ProperLetter(c) || c == '_')
+            command[it++] = c;
+    } while (it < MAX_COMM_LEN - 1 && (ProperLetter(c) || c == '_'));
+    command[it] = '\0';
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        if (strcmp(command, commands[i].name) == 0)
+            desc = &commands[i];
+    ArgType arg = desc == NULL ? ARG_NONE : desc->arg;
+    err = arg != ARG_NONE ? c != ' ' : c != '\n';
+    if (err) {
+        if (c != '\n')
+            ReadTillNewLine(ses);
+        CommandSetError(cmd, arg == ARG_FILE ? ERR_WRONG_FILE
+                           : arg == ARG_NUMBER ? ERR_WRONG_COUNT
+                           : ERR_WRONG_COMMAND);
+        return ;
+    }
+    if (desc == NULL) {
+        CommandSetError(cmd, ERR_WRONG_COMMAND);
+        return ;
+    }
+    cmd->type = desc->type;
+    if (arg == ARG_NUMBER) {
+        bool errOccured = false;
+        int mockCol = 0;
+        cmd->arg = ReadNumber(ses, desc->lowerBound, desc->upperBound,
+                              &mockCol, &errOccured);
+        c = InputGet(ses);
+        if (errOccured || c != '\n') {
+            CommandSetError(cmd, desc->argErr);
+            if (c != '\n')
+                ReadTillNewLine(ses);
+        }
+    }
+    else if (arg == ARG_FILE) {
+        cmd->fileName = malloc(MAX_FILE_NAME_LEN);
+        assert(cmd->fileName != NULL);
+        if (!ReadFileName(ses, cmd->fileName)) {
+            free(cmd->fileName);
+            cmd->fileName = NULL;
+            CommandSetError(cmd, desc->argErr);
+        }
     }
 }
 
-void CleanStack(PolyStack *s) {
+/**
+ * Parsuje wiersz z wielomianem.
+ * @param[out] cmd : sparsowany wiersz
+ */
+static void ParsePolyLine(Session *ses, Command *cmd) {
     Poly p;
-    while (!IsEmpty(s)) {
-        p = Pop(s);
+    bool errOccured = false;
+    int col = 0, errCol = 0;
+    int c;
+    p = ReadPoly(ses, &col, &errOccured, &errCol);
+    if (errOccured) {
         PolyDestroy(&p);
+        ReadTillNewLine(ses);
+        CommandSetError(cmd, ERR_COLUMN);
+        cmd->col = errCol;
+    }
+    else {
+        c = InputGet(ses);
+        col++;
+        if (c == '\n') {
+            cmd->type = CMD_POLY;
+            cmd->p = p;
+        }
+        else {
+            PolyDestroy(&p);
+            CommandSetError(cmd, ERR_COLUMN);
+            cmd->col = col;
+            ReadTillNewLine(ses);
+        }
+    }
+}
+
+/**
+ * Parsuje kolejny wiersz wejścia.
+ * @param[out] cmd : sparsowany wiersz (CMD_END na końcu wejścia)
+ * @param[in] r : numer wiersza
+ */
+static void ParseLine(Session *ses, Command *cmd, int r) {
+    int c = InputPeek(ses);
+    *cmd = (Command) {.type = CMD_END, .line = r, .p = PolyZero()};
+    if (c == EOF)
+        return ;
+    PolyMemClearError();
+    if (ProperLetter(c))
+        ParseCommand(ses, cmd);
+    else
+        ParsePolyLine(ses, cmd);
+    CommandCheckMemory(cmd);
+}
+
+/**
+ * Ustawia wynik jako błąd.
+ * @param[out] res : wynik
+ * @param[in] err : rodzaj błędu
+ */
+static inline void ResultSetError(Result *res, ErrorType err) {
+    res->type = RES_ERROR;
+    res->err = err;
+}
+
+/**
+ * Ustawia wynik jako liczbę do wypisania.
+ * @param[out] res : wynik
+ * @param[in] n : liczba
+ */
+static inline void ResultSetNumber(Result *res, long n) {
+    res->type = RES_NUMBER;
+    res->number = n;
+}
+
+/**
+ * Statystyki wykonań jednego rodzaju wiersza.
+ */
+typedef struct CommandStats {
+    atomic_ulong count; ///< liczba wykonań
+    atomic_ulong maxNs; ///< najdłuższe wykonanie w nanosekundach
+    atomic_ulong termsIn; ///< łączna liczba składników argumentów
+    atomic_ulong termsOut; ///< łączna liczba składników wyników
+    atomic_ulong allocs; ///< łączna liczba przydzielonych jednomianów
+    atomic_ulong buckets[STATS_BUCKETS]; ///< histogram czasów wykonania
+} CommandStats;
+
+/** Czy zbierać statystyki wykonania wierszy (ustawiane przed startem) */
+static bool statsOn = false;
+
+/** Statystyki kolejnych rodzajów wierszy */
+static CommandStats stats[CMD_END];
+
+/**
+ * Zwraca nazwę rodzaju wiersza.
+ * @param[in] type : rodzaj wiersza
+ * @return nazwa
+ */
+static const char *CommandName(CommandType type) {
+    if (type == CMD_POLY)
+        return "POLY";
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        if (commands[i].type == type)
+            return commands[i].name;
+    return "ERROR";
+}
+
+/**
+ * Zwraca przedział histogramu dla czasu wykonania. Każda potęga dwójki
+ * dzieli się na STATS_SUB_BUCKETS przedziałów, więc błąd odczytanego
+ * kwantyla nie przekracza 25%.
+ * @param[in] ns : czas w nanosekundach
+ * @return numer przedziału
+ */
+static unsigned StatsBucket(unsigned long ns) {
+    if (ns < STATS_SUB_BUCKETS)
+        return ns;
+    unsigned e = 63 - __builtin_clzl(ns);
+    return (e - 1) * STATS_SUB_BUCKETS + ((ns >> (e - 2)) & 3);
+}
+
+/**
+ * Zwraca największy czas należący do przedziału histogramu.
+ * @param[in] bucket : numer przedziału
+ * @return czas w nanosekundach
+ */
+static unsigned long StatsBucketMax(unsigned bucket) {
+    if (bucket < STATS_SUB_BUCKETS)
+        return bucket;
+    unsigned e = bucket / STATS_SUB_BUCKETS + 1;
+    unsigned long sub = bucket % STATS_SUB_BUCKETS;
+    return ((STATS_SUB_BUCKETS + sub + 1) << (e - 2)) - 1;
+}
+
+/**
+ * Odczytuje kwantyl czasu wykonania z histogramu.
+ * @param[in] st : statystyki
+ * @param[in] count : liczba wykonań
+ * @param[in] q : rząd kwantyla w procentach
+ * @return czas w nanosekundach
+ */
+static unsigned long StatsQuantile(CommandStats *st, unsigned long count,
+                                   unsigned q) {
+    unsigned long target = (count * q + 99) / 100, seen = 0;
+    unsigned long max = atomic_load_explicit(&st->maxNs, memory_order_relaxed);
+    for (unsigned i = 0; i < STATS_BUCKETS; i++) {
+        seen += atomic_load_explicit(&st->buckets[i], memory_order_relaxed);
+        if (seen >= target)
+            return StatsBucketMax(i) < max ? StatsBucketMax(i) : max;
+    }
+    return max;
+}
+
+/**
+ * Dodaje wykonanie wiersza do statystyk.
+ * @param[in] type : rodzaj wiersza
+ * @param[in] ns : czas wykonania w nanosekundach
+ * @param[in] termsIn : liczba składników argumentów
+ * @param[in] termsOut : liczba składników wyniku
+ * @param[in] allocs : liczba przydzielonych jednomianów
+ */
+static void StatsRecord(CommandType type, unsigned long ns,
+                        unsigned long termsIn, unsigned long termsOut,
+                        unsigned long allocs) {
+    CommandStats *st = &stats[type];
+    unsigned long max = atomic_load_explicit(&st->maxNs, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak(&st->maxNs, &max, ns))
+        ;
+    atomic_fetch_add_explicit(&st->buckets[StatsBucket(ns)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->termsIn, termsIn, memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->termsOut, termsOut, memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->allocs, allocs, memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->count, 1, memory_order_relaxed);
+}
+
+/**
+ * Wypisuje tabelę statystyk rodzajów wierszy, które zostały wykonane.
+ * @param[in] f : plik
+ */
+static void StatsPrint(FILE *f) {
+    fprintf(f, "COMMAND COUNT P50_NS P99_NS MAX_NS TERMS_IN TERMS_OUT "
+            "ALLOCS\n");
+    for (int type = 0; type < CMD_END; type++) {
+        CommandStats *st = &stats[type];
+        unsigned long count = atomic_load(&st->count);
+        if (count == 0)
+            continue;
+        fprintf(f, "%s %lu %lu %lu %lu %lu %lu %lu\n", CommandName(type),
+                count, StatsQuantile(st, count, 50),
+                StatsQuantile(st, count, 99), atomic_load(&st->maxNs),
+                atomic_load(&st->termsIn), atomic_load(&st->termsOut),
+                atomic_load(&st->allocs));
+    }
+}
+
+/**
+ * Wypisuje statystyki na standardowe wyjście błędów i kończy zapis
+ * śladu; wywoływane przy wyjściu z programu.
+ */
+static void StatsAtExit() {
+    if (statsOn)
+        StatsPrint(stderr);
+    PolyTraceClose();
+}
+
+/**
+ * Zwraca błąd odpowiadający powodowi przerwania operacji.
+ * @return rodzaj błędu
+ */
+static ErrorType StopError() {
+    switch (PolyStopReason()) {
+        case POLY_STOP_DEADLINE:
+            return ERR_TIMEOUT;
+        case POLY_STOP_INTERRUPT:
+            return ERR_INTERRUPTED;
+        default:
+            return ERR_OUT_OF_MEMORY;
+    }
+}
+
+/**
+ * Zastępuje @p count górnych wielomianów stosu wynikiem operacji.
+ * Jeśli operacja została przerwana, stos pozostaje bez zmian,
+ * a wynikiem wiersza jest błąd.
+ * @param[in] s : stos
+ * @param[in] count : liczba zastępowanych wielomianów
+ * @param[in] p : wynik operacji
+ * @param[out] res : wynik wiersza
+ */
+static void Replace(PolyStack *s, unsigned count, Poly p, Result *res) {
+    if (PolyMemFailed()) {
+        PolyDestroy(&p);
+        ResultSetError(res, StopError());
+        return ;
+    }
+    for (unsigned i = 0; i < count; i++)
+        PolyRefRelease(PopRef(s));
+    Push(p, s);
+}
+
+/**
+ * Wykonuje polecenie COMPOSE.
+ * @param[in] s : stos
+ * @param[in] count : parametr polecenia
+ * @param[out] res : wynik
+ */
+static void ExecuteCompose(PolyStack *s, unsigned count, Result *res) {
+    if (count >= s->size) {
+        ResultSetError(res, ERR_STACK_UNDERFLOW);
+        return ;
+    }
+    Poly p = TopRef(s)->p;
+    unsigned n = 0, *perm = NULL;
+    if (s->autoOrder)
+        perm = PolyChooseVarOrder(1, &p, &n);
+    unsigned len = perm != NULL && n > count ? n : count;
+    Poly *arr = malloc((len > 0 ? len : 1) * sizeof(Poly));
+    assert(arr != NULL);
+    for (unsigned i = 0; i < len; i++)
+        arr[i] = PolyZero();
+    for (unsigned i = 0; i < len; i++)
+        if (i < count)
+            arr[perm != NULL && i < n ? perm[i] : i] = PeekRef(s, i + 1)->p;
+    if (perm != NULL)
+        p = PolyPermuteVars(&p, n, perm);
+    PolyDegCap cap = {.total = s->truncDeg};
+    Poly composed = s->truncDeg >= 0 ? PolyComposeTrunc(&p, len, arr, &cap)
+                                     : PolyCompose(&p, len, arr);
+    if (perm != NULL)
+        PolyDestroy(&p);
+    free(arr);
+    free(perm);
+    Replace(s, count + 1, composed, res);
+}
+
+/**
+ * Mnoży wielomiany, obcinając iloczyn do ustawienia TRUNC. Przy
+ * włączonym REORDER czynniki są mnożone w kolejności zmiennych
+ * wybranej przez PolyChooseVarOrder, a iloczyn wraca do kolejności
+ * pierwotnej.
+ * @param[in] s : stos
+ * @param[in] p : czynnik
+ * @param[in] q : czynnik
+ * @return `p * q`
+ */
+static Poly ExecuteMul(PolyStack *s, const Poly *p, const Poly *q) {
+    PolyDegCap cap = {.total = s->truncDeg};
+    Poly ops[2] = {*p, *q};
+    unsigned n, *perm = s->autoOrder ? PolyChooseVarOrder(2, ops, &n) : NULL;
+    if (perm != NULL) {
+        ops[0] = PolyPermuteVars(p, n, perm);
+        ops[1] = PolyPermuteVars(q, n, perm);
+        p = &ops[0];
+        q = &ops[1];
     }
+    Poly res = s->truncDeg >= 0 ? PolyMulTrunc(p, q, &cap) : PolyMul(p, q);
+    if (perm != NULL) {
+        unsigned *inv = malloc(n * sizeof(unsigned));
+        assert(inv != NULL);
+        for (unsigned i = 0; i < n; i++)
+            inv[perm[i]] = i;
+        Poly tmp = PolyPermuteVars(&res, n, inv);
+        PolyDestroy(&res);
+        PolyDestroy(&ops[0]);
+        PolyDestroy(&ops[1]);
+        free(inv);
+        free(perm);
+        res = tmp;
+    }
+    return res;
+}
+
+/**
+ * Wykonuje polecenie MUL_TO: zapisuje iloczyn dwóch wielomianów ze szczytu
+ * stosu do pliku w formacie SAVE, nie tworząc go w pamięci. Stos nie
+ * zmienia się; ustawienia TRUNC i REORDER nie są stosowane.
+ * @param[in] s : stos
+ * @param[in] fileName : nazwa pliku
+ * @param[out] res : wynik
+ */
+static void ExecuteMulTo(PolyStack *s, const char *fileName, Result *res) {
+    if (s->size < 2) {
+        ResultSetError(res, ERR_STACK_UNDERFLOW);
+        return ;
+    }
+    FILE *f = fopen(fileName, "wb");
+    PolyTermWriter *w = PolyTermWriterNew();
+    bool ok = f != NULL && PolyMulSink(&PeekRef(s, 0)->p, &PeekRef(s, 1)->p,
+                                       PolyTermWriterAdd, w);
+    ok = PolyTermWriterFinish(w, ok ? f : NULL) && ok;
+    if (f != NULL && fclose(f) != 0)
+        ok = false;
+    if (PolyMemFailed())
+        ResultSetError(res, StopError());
+    else if (!ok)
+        ResultSetError(res, ERR_WRONG_FILE);
+}
+
+/**
+ * Obcina wielomian do ustawienia TRUNC.
+ * @param[in] s : stos
+ * @param[in] p : wielomian, przejmowany na własność
+ * @return obcięty wielomian
+ */
+static Poly ApplyTrunc(PolyStack *s, Poly p) {
+    if (s->truncDeg < 0)
+        return p;
+    PolyDegCap cap = {.total = s->truncDeg};
+    Poly res = PolyTrunc(&p, &cap);
+    PolyDestroy(&p);
+    return res;
+}
+
+/**
+ * Wykonuje polecenie DOT: zastępuje @p count par wielomianów ze szczytu
+ * stosu sumą ich iloczynów, wyliczoną przez PolyDot.
+ * @param[in] s : stos
+ * @param[in] count : parametr polecenia
+ * @param[out] res : wynik
+ */
+static void ExecuteDot(PolyStack *s, unsigned count, Result *res) {
+    if (2 * (unsigned long) count > s->size) {
+        ResultSetError(res, ERR_STACK_UNDERFLOW);
+        return ;
+    }
+    Poly *a = malloc((count > 0 ? count : 1) * sizeof(Poly));
+    Poly *b = malloc((count > 0 ? count : 1) * sizeof(Poly));
+    assert(a != NULL && b != NULL);
+    for (unsigned i = 0; i < count; i++) {
+        a[i] = PeekRef(s, 2 * i)->p;
+        b[i] = PeekRef(s, 2 * i + 1)->p;
+    }
+    Poly p = PolyDot(count, a, b);
+    free(a);
+    free(b);
+    Replace(s, 2 * count, ApplyTrunc(s, p), res);
+}
+
+/**
+ * Wykonuje polecenie FMA: zastępuje trzy wielomiany ze szczytu stosu
+ * trzecim z nich powiększonym o iloczyn dwóch górnych. Akumulator,
+ * którego uchwyt nie jest współdzielony ani zwarty, jest przekazywany
+ * do PolyFma bez kopiowania; przy ustawieniu TRUNC jest kopiowany, żeby
+ * przerwane obcinanie nie zmieniło stosu.
+ * @param[in] s : stos
+ * @param[out] res : wynik
+ */
+static void ExecuteFma(PolyStack *s, Result *res) {
+    if (s->size < 3) {
+        ResultSetError(res, ERR_STACK_UNDERFLOW);
+        return ;
+    }
+    PolyRef *acc = PeekRef(s, 2);
+    bool own = atomic_load_explicit(&acc->refs, memory_order_acquire) == 1
+               && !acc->compact && s->truncDeg < 0;
+    Poly p = own ? acc->p : PolyClone(&acc->p);
+    PolyFma(&p, &PeekRef(s, 0)->p, &PeekRef(s, 1)->p);
+    if (own) {
+        if (PolyMemFailed()) {
+            ResultSetError(res, StopError());
+            return ;
+        }
+        acc->p = PolyZero();
+    }
+    Replace(s, 3, ApplyTrunc(s, p), res);
+}
+
+/**
+ * Wykonuje sparsowany wiersz, przejmując na własność jego zawartość.
+ * @param[in] s : stos
+ * @param[in] cmd : wiersz
+ * @param[out] res : wynik
+ */
+static void ExecuteCommand(PolyStack *s, Command *cmd, Result *res) {
+    Poly p1;
+    PolyRef *r1, *r2;
+    PolyDegCap cap = {.total = s->truncDeg};
+    PolyMemClearError();
+    *res = (Result) {.type = RES_NONE, .line = cmd->line, .ref = NULL};
+    if (cmd->type == CMD_ERROR) {
+        ResultSetError(res, cmd->err);
+        res->col = cmd->col;
+        return ;
+    }
+    if (cmd->type == CMD_END) {
+        res->type = RES_END;
+        return ;
+    }
+    if (cmd->type == CMD_POLY) {
+        Push(cmd->p, s);
+        return ;
+    }
+    if (cmd->type == CMD_ZERO) {
+        Push(PolyZero(), s);
+        return ;
+    }
+    if (cmd->type == CMD_TRUNC) {
+        s->truncDeg = (poly_exp_t) cmd->arg;
+        return ;
+    }
+    if (cmd->type == CMD_REORDER) {
+        s->autoOrder = cmd->arg != 0;
+        return ;
+    }
+    if (cmd->type == CMD_COMPACT) {
+        s->compactDepth = (long) cmd->arg;
+        return ;
+    }
+    if (cmd->type == CMD_STATS) {
+        size_t len;
+        FILE *f = open_memstream(&res->text, &len);
+        assert(f != NULL);
+        StatsPrint(f);
+        fclose(f);
+        res->type = RES_TEXT;
+        return ;
+    }
+    if (cmd->type == CMD_LOAD) {
+        FILE *f = fopen(cmd->fileName, "rb");
+        if (f == NULL || !PolyDeserialize(f, &p1))
+            ResultSetError(res, PolyMemFailed() ? StopError()
+                                                : ERR_WRONG_FILE);
+        else
+            Replace(s, 0, p1, res);
+        if (f != NULL)
+            fclose(f);
+        free(cmd->fileName);
+        return ;
+    }
+    if (IsEmpty(s)) {
+        ResultSetError(res, ERR_STACK_UNDERFLOW);
+        free(cmd->fileName);
+        return ;
+    }
+    switch (cmd->type) {
+        case CMD_IS_COEFF:
+            p1 = Top(s);
+            ResultSetNumber(res, PolyIsCoeff(&p1));
+            break;
+        case CMD_IS_ZERO:
+            p1 = Top(s);
+            ResultSetNumber(res, PolyIsZero(&p1));
+            break;
+        case CMD_CLONE:
+            PushRef(PolyRefRetain(TopRef(s)), s);
+            break;
+        case CMD_ADD:
+        case CMD_MUL:
+        case CMD_SUB:
+            if (s->size < 2) {
+                ResultSetError(res, ERR_STACK_UNDERFLOW);
+                break;
+            }
+            r2 = PeekRef(s, 1);
+            r1 = PeekRef(s, 0);
+            if (cmd->type == CMD_ADD)
+                p1 = PolyAdd(&r1->p, &r2->p);
+            else if (cmd->type == CMD_MUL)
+                p1 = ExecuteMul(s, &r1->p, &r2->p);
+            else
+                p1 = PolySub(&r1->p, &r2->p);
+            Replace(s, 2, p1, res);
+            break;
+        case CMD_NEG:
+            Replace(s, 1, PolyNeg(&TopRef(s)->p), res);
+            break;
+        case CMD_POW:
+            p1 = PolyPowTrunc(&TopRef(s)->p, (poly_exp_t) cmd->arg, &cap);
+            Replace(s, 1, p1, res);
+            break;
+        case CMD_IS_EQ:
+            if (s->size < 2) {
+                ResultSetError(res, ERR_STACK_UNDERFLOW);
+                break;
+            }
+            ResultSetNumber(res, PolyIsEq(&PeekRef(s, 1)->p,
+                                          &PeekRef(s, 0)->p));
+            break;
+        case CMD_DEG:
+            p1 = Top(s);
+            ResultSetNumber(res, PolyDeg(&p1));
+            break;
+        case CMD_DEG_BY:
+            p1 = Top(s);
+            ResultSetNumber(res, PolyDegBy(&p1, (unsigned) cmd->arg));
+            break;
+        case CMD_AT:
+        case CMD_SHIFT:
+            r1 = TopRef(s);
+            if (cmd->type == CMD_AT)
+                p1 = PolyAt(&r1->p, cmd->arg);
+            else
+                p1 = PolyShift(&r1->p, cmd->arg);
+            Replace(s, 1, p1, res);
+            break;
+        case CMD_PRINT:
+            res->type = RES_POLY;
+            res->ref = PolyRefRetain(TopRef(s));
+            break;
+        case CMD_POP:
+            PolyRefRelease(PopRef(s));
+            break;
+        case CMD_COMPOSE:
+            ExecuteCompose(s, (unsigned) cmd->arg, res);
+            break;
+        case CMD_SAVE: {
+            FILE *f = fopen(cmd->fileName, "wb");
+            p1 = Top(s);
+            if (f == NULL || !PolySerialize(&p1, f))
+                ResultSetError(res, ERR_WRONG_FILE);
+            if (f != NULL && fclose(f) != 0)
+                ResultSetError(res, ERR_WRONG_FILE);
+            free(cmd->fileName);
+            break;
+        }
+        case CMD_MUL_TO:
+            ExecuteMulTo(s, cmd->fileName, res);
+            free(cmd->fileName);
+            break;
+        case CMD_DOT:
+            ExecuteDot(s, (unsigned) cmd->arg, res);
+            break;
+        case CMD_FMA:
+            ExecuteFma(s, res);
+            break;
+        case CMD_SUBST:
+            if (s->size < 2) {
+                ResultSetError(res, ERR_STACK_UNDERFLOW);
+                break;
+            }
+            p1 = PolySubst(&PeekRef(s, 0)->p, (unsigned) cmd->arg,
+                           &PeekRef(s, 1)->p);
+            Replace(s, 2, ApplyTrunc(s, p1), res);
+            break;
+        default:
+            assert(false);
+    }
+}
+
+/**
+ * Zwraca liczbę wielomianów ze szczytu stosu, które czyta wiersz.
+ * @param[in] cmd : wiersz
+ * @return liczba argumentów
+ */
+static unsigned long CommandInputs(const Command *cmd) {
+    switch (cmd->type) {
+        case CMD_POLY: case CMD_ZERO: case CMD_LOAD: case CMD_STATS:
+        case CMD_TRUNC: case CMD_REORDER: case CMD_COMPACT: case CMD_ERROR:
+        case CMD_END:
+            return 0;
+        case CMD_ADD: case CMD_MUL: case CMD_SUB: case CMD_IS_EQ:
+        case CMD_MUL_TO: case CMD_SUBST:
+            return 2;
+        case CMD_COMPOSE:
+            return (unsigned long) cmd->arg + 1;
+        case CMD_DOT:
+            return 2 * (unsigned long) cmd->arg;
+        case CMD_FMA:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * Sprawdza, czy wiersz wykonany bez błędu kładzie wynik na stos.
+ * @param[in] type : rodzaj wiersza
+ * @return czy szczyt stosu jest wynikiem
+ */
+static bool CommandPushes(CommandType type) {
+    switch (type) {
+        case CMD_POLY: case CMD_ZERO: case CMD_LOAD: case CMD_CLONE:
+        case CMD_ADD: case CMD_MUL: case CMD_SUB: case CMD_NEG:
+        case CMD_AT: case CMD_SHIFT: case CMD_COMPOSE: case CMD_POW:
+        case CMD_DOT: case CMD_FMA: case CMD_SUBST:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Zlicza składniki górnych wielomianów stosu.
+ * @param[in] s : stos
+ * @param[in] count : liczba wielomianów
+ * @return liczba składników
+ */
+static unsigned long StackTerms(PolyStack *s, unsigned long count) {
+    unsigned long terms = 0;
+    for (unsigned long i = 0; i < count && i < s->size; i++)
+        terms += PolyTermCount(&PeekRef(s, i)->p);
+    return terms;
+}
+
+/**
+ * Wykonuje sparsowany wiersz jak ExecuteCommand, mierząc czas wykonania
+ * i zliczając składniki argumentów, wyniku oraz przydziały pamięci.
+ * @param[in] s : stos
+ * @param[in] cmd : wiersz
+ * @param[out] res : wynik
+ */
+static void ExecuteMeasured(PolyStack *s, Command *cmd, Result *res) {
+    char args[TRACE_ARGS_LEN];
+    CommandType type = cmd->type;
+    unsigned long termsIn = StackTerms(s, CommandInputs(cmd)), termsOut = 0;
+    if (polyTraceOn) {
+        snprintf(args, sizeof(args), "{\"in\":%lu}", termsIn);
+        PolyTraceEvent(CommandName(type), 'B', args);
+    }
+    unsigned long allocs = PolyMemAllocCount();
+    long start = PolyTraceNow();
+    ExecuteCommand(s, cmd, res);
+    long ns = PolyTraceNow() - start;
+    allocs = PolyMemAllocCount() - allocs;
+    if (polyTraceOn) {
+        snprintf(args, sizeof(args), "{\"allocs\":%lu}", allocs);
+        PolyTraceEvent(CommandName(type), 'E', args);
+    }
+    if (!statsOn)
+        return ;
+    if (res->type == RES_POLY)
+        termsOut = PolyTermCount(&res->ref->p);
+    else if (res->type != RES_ERROR && CommandPushes(type))
+        termsOut = StackTerms(s, 1);
+    StatsRecord(type, ns, termsIn, termsOut, allocs);
+}
+
+/** Limit czasu wykonania wiersza w nanosekundach (0 - brak limitu) */
+static long commandLimitNs = 0;
+
+/** Liczba wierszy wykonywanych w tej chwili */
+static atomic_int executing;
+
+/** Ustawiane przez SIGINT w trakcie wykonywania wiersza */
+static atomic_bool interrupted;
+
+/**
+ * Obsługa SIGINT: w trakcie wykonywania wiersza przerywa tylko jego
+ * obliczenia, zachowując stos; poza tym kończy program.
+ * @param[in] sig : numer sygnału
+ */
+static void InterruptSignal(int sig) {
+    if (atomic_load(&executing) > 0) {
+        atomic_store(&interrupted, true);
+        return ;
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/**
+ * Wykonuje sparsowany wiersz, przejmując na własność jego zawartość.
+ * Wykonanie jest ograniczone limitem czasu wiersza i można je przerwać
+ * przez SIGINT. Jeśli włączono statystyki lub ślad, wykonanie jest
+ * mierzone; jeśli
+ * włączono wymianę, po wykonaniu zimne elementy stosu trafiają na dysk.
+ * @param[in] s : stos
+ * @param[in] cmd : wiersz
+ * @param[out] res : wynik
+ */
+static void Execute(PolyStack *s, Command *cmd, Result *res) {
+    if (commandLimitNs > 0)
+        PolySetDeadline(PolyTraceNow() + commandLimitNs);
+    PolySetInterrupt(&interrupted);
+    atomic_fetch_add(&executing, 1);
+    if ((!statsOn && !polyTraceOn) || cmd->type == CMD_END)
+        ExecuteCommand(s, cmd, res);
+    else
+        ExecuteMeasured(s, cmd, res);
+    if (atomic_fetch_sub(&executing, 1) == 1)
+        atomic_store(&interrupted, false);
+    PolySetDeadline(0);
+    CompactStack(s);
+    if (s->spill != NULL)
+        Spill(s);
+}
+
+/** Komunikaty kolejnych rodzajów błędów */
+static const char *errorMessages[] = {
+    [ERR_STACK_UNDERFLOW] = "STACK UNDERFLOW",
+    [ERR_WRONG_COMMAND] = "WRONG COMMAND",
+    [ERR_WRONG_COUNT] = "WRONG COUNT",
+    [ERR_WRONG_VALUE] = "WRONG VALUE",
+    [ERR_WRONG_VARIABLE] = "WRONG VARIABLE",
+    [ERR_WRONG_FILE] = "WRONG FILE",
+    [ERR_OUT_OF_MEMORY] = "OUT OF MEMORY",
+    [ERR_TIMEOUT] = "TIMEOUT",
+    [ERR_INTERRUPTED] = "INTERRUPTED",
+    [ERR_LINE_TOO_LONG] = "LINE TOO LONG",
+};
+
+/**
+ * Wypisuje wynik wykonania wiersza i zwalnia jego zawartość.
+ * @param[in] res : wynik
+ */
+static void Emit(Session *ses, Result *res) {
+    switch (res->type) {
+        case RES_NUMBER:
+            OutputNumber(ses, res->number);
+            OutputChar(ses, '\n');
+            break;
+        case RES_POLY:
+            PolyPrint(ses, &res->ref->p);
+            OutputChar(ses, '\n');
+            PolyRefRelease(res->ref);
+            break;
+        case RES_TEXT:
+            OutputFlush(ses);
+            fputs(res->text, ses->outFile);
+            free(res->text);
+            break;
+        case RES_ERROR:
+            if (ses->errFile == ses->outFile)
+                OutputFlush(ses);
+            if (res->err == ERR_COLUMN)
+                fprintf(ses->errFile, "ERROR %d %d\n", res->line, res->col);
+            else
+                fprintf(ses->errFile, "ERROR %d %s\n", res->line,
+                        errorMessages[res->err]);
+            break;
+        default:
+            break;
+    }
+    if (ses->out.isTty)
+        OutputFlush(ses);
+}
+
+/**
+ * Przygotowuje wyjście kalkulatora.
+ */
+static void OutputOpen(Session *ses) {
+    ses->out.isTty = ses->outFile != NULL && isatty(fileno(ses->outFile));
+}
+
+/**
+ * Opróżnia wyjście i zwalnia jego zasoby.
+ */
+static void OutputClose(Session *ses) {
+    OutputFlush(ses);
+    free(ses->printStack.data);
+    ses->printStack.data = NULL;
+    ses->printStack.size = 0;
+}
+
+/**
+ * Tworzy sesję kalkulatora i przygotowuje jej wejście i wyjście.
+ * @param[in] inFile : wejście (NULL jeśli sesja nie czyta skryptu)
+ * @param[in] outFile : wyjście
+ * @param[in] errFile : wyjście błędów
+ * @return sesja
+ */
+static Session *SessionOpen(FILE *inFile, FILE *outFile, FILE *errFile) {
+    Session *ses = malloc(sizeof(Session));
+    assert(ses != NULL);
+    ses->inFile = inFile;
+    ses->outFile = outFile;
+    ses->errFile = errFile;
+    ses->out.len = 0;
+    ses->printStack.data = NULL;
+    ses->printStack.size = 0;
+    ses->in.data = NULL;
+    ses->in.mapLen = 0;
+    if (inFile != NULL)
+        InputOpen(ses);
+    OutputOpen(ses);
+    return ses;
+}
+
+/**
+ * Opróżnia wyjście sesji, zwalnia jej zasoby i samą sesję.
+ * @param[in] ses : sesja
+ */
+static void SessionClose(Session *ses) {
+    OutputClose(ses);
+    if (ses->inFile != NULL)
+        InputClose(ses);
+    free(ses);
+}
+
+void Read(PolyStack *s, FILE *inFile, FILE *outFile, FILE *errFile) {
+    Command cmd;
+    Result res;
+    int r = 1;
+    Session *ses = SessionOpen(inFile, outFile, errFile);
+    while (ParseLine(ses, &cmd, r++), cmd.type != CMD_END) {
+        Execute(s, &cmd, &res);
+        Emit(ses, &res);
+    }
+    SessionClose(ses);
+}
+
+/**
+ * Kolejki łączące etapy kalkulatora potokowego.
+ */
+typedef struct Pipeline {
+    SpscQueue commands; ///< wiersze od parsera do wykonawcy
+    SpscQueue results; ///< wyniki od wykonawcy do wypisującego
+    PolyStack *s; ///< stos wykonawcy
+    Session *ses; ///< sesja; wejścia używa tylko parser, wyjścia wypisujący
+} Pipeline;
+
+/**
+ * Etap parsowania: czyta wejście i przekazuje sparsowane wiersze.
+ * @param[in] arg : potok
+ * @return NULL
+ */
+static void *ParseStage(void *arg) {
+    Pipeline *pipe = arg;
+    Command cmd;
+    int r = 1;
+    do {
+        ParseLine(pipe->ses, &cmd, r++);
+        SpscPush(&pipe->commands, &cmd);
+    } while (cmd.type != CMD_END);
+    PolyReleaseCache();
+    return NULL;
+}
+
+/**
+ * Etap wykonania: wykonuje wiersze na stosie i przekazuje wyniki.
+ * @param[in] arg : potok
+ * @return NULL
+ */
+static void *ExecuteStage(void *arg) {
+    Pipeline *pipe = arg;
+    Command cmd;
+    Result res;
+    do {
+        SpscPop(&pipe->commands, &cmd);
+        Execute(pipe->s, &cmd, &res);
+        SpscPush(&pipe->results, &res);
+    } while (res.type != RES_END);
+    PolyReleaseCache();
+    return NULL;
+}
+
+void ReadPipelined(PolyStack *s, FILE *inFile, FILE *outFile, FILE *errFile) {
+    Pipeline pipe = {.s = s};
+    pthread_t parser, executor;
+    Result res;
+    SpscInit(&pipe.commands, PIPELINE_QUEUE_SIZE, sizeof(Command));
+    SpscInit(&pipe.results, PIPELINE_QUEUE_SIZE, sizeof(Result));
+    pipe.ses = SessionOpen(inFile, outFile, errFile);
+    if (pthread_create(&parser, NULL, ParseStage, &pipe) != 0
+        || pthread_create(&executor, NULL, ExecuteStage, &pipe) != 0) {
+        fprintf(stderr, "cannot start pipeline threads\n");
+        exit(1);
+    }
+    do {
+        SpscPop(&pipe.results, &res);
+        Emit(pipe.ses, &res);
+    } while (res.type != RES_END);
+    pthread_join(parser, NULL);
+    pthread_join(executor, NULL);
+    SessionClose(pipe.ses);
+    SpscDestroy(&pipe.commands);
+    SpscDestroy(&pipe.results);
+}
+
+/**
+ * Zapisuje sparsowany wiersz do skompilowanego skryptu.
+ * Zapis składa się z kodu operacji (CommandType) i jej operandów.
+ * @param[in] cmd : wiersz
+ * @param[in] f : plik
+ */
+static void WriteCommand(const Command *cmd, FILE *f) {
+    putc_unlocked(cmd->type, f);
+    switch (cmd->type) {
+        case CMD_POLY:
+            PolyWrite(&cmd->p, f);
+            break;
+        case CMD_DEG_BY:
+        case CMD_AT:
+        case CMD_SHIFT:
+        case CMD_COMPOSE:
+        case CMD_POW:
+        case CMD_TRUNC:
+        case CMD_REORDER:
+        case CMD_DOT:
+        case CMD_COMPACT:
+        case CMD_SUBST:
+            WriteCoeff(cmd->arg, f);
+            break;
+        case CMD_SAVE:
+        case CMD_LOAD:
+        case CMD_MUL_TO: {
+            size_t len = strlen(cmd->fileName);
+            WriteVarint(len, f);
+            fwrite(cmd->fileName, 1, len, f);
+            break;
+        }
+        case CMD_ERROR:
+            putc_unlocked(cmd->err, f);
+            WriteVarint(cmd->col, f);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Sprawdza, czy parametr liczbowy polecenia mieści się w granicach podanych
+ * w tablicy commands, tak jak przy parsowaniu wiersza.
+ * @param[in] type : rodzaj polecenia
+ * @param[in] arg : parametr
+ * @return czy parametr jest poprawny
+ */
+static bool ArgInRange(CommandType type, poly_coeff_t arg) {
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        if (commands[i].type == type)
+            return commands[i].arg == ARG_NUMBER
+                   && arg >= commands[i].lowerBound
+                   && arg <= commands[i].upperBound;
+    return false;
+}
+
+/**
+ * Odczytuje wiersz zapisany przez WriteCommand.
+ * @param[in] f : plik
+ * @param[out] cmd : wiersz
+ * @param[in] r : numer wiersza
+ * @return czy odczyt się powiódł
+ */
+static bool ReadCommandRecord(FILE *f, Command *cmd, int r) {
+    unsigned long n;
+    int op = getc_unlocked(f);
+    *cmd = (Command) {.type = op, .line = r, .p = PolyZero()};
+    bool ok;
+    switch (op) {
+        case CMD_POLY:
+            PolyMemClearError();
+            ok = PolyRead(f, &cmd->p);
+            CommandCheckMemory(cmd);
+            return ok;
+        case CMD_ZERO: case CMD_IS_COEFF: case CMD_IS_ZERO: case CMD_CLONE:
+        case CMD_ADD: case CMD_MUL: case CMD_NEG: case CMD_SUB:
+        case CMD_IS_EQ: case CMD_DEG: case CMD_PRINT: case CMD_POP:
+        case CMD_STATS: case CMD_FMA: case CMD_END:
+            return true;
+        case CMD_DEG_BY: case CMD_AT: case CMD_SHIFT: case CMD_COMPOSE:
+        case CMD_POW: case CMD_TRUNC: case CMD_REORDER: case CMD_DOT:
+        case CMD_COMPACT: case CMD_SUBST:
+            return ReadCoeff(f, &cmd->arg) && ArgInRange(op, cmd->arg);
+        case CMD_SAVE:
+        case CMD_LOAD:
+        case CMD_MUL_TO:
+            if (!ReadVarint(f, &n) || n == 0 || n >= MAX_FILE_NAME_LEN)
+                return false;
+            cmd->fileName = malloc(n + 1);
+            assert(cmd->fileName != NULL);
+            cmd->fileName[n] = '\0';
+            if (fread(cmd->fileName, 1, n, f) != n) {
+                free(cmd->fileName);
+                return false;
+            }
+            return true;
+        case CMD_ERROR:
+            cmd->err = getc_unlocked(f);
+            if (cmd->err < ERR_COLUMN || cmd->err > ERR_INTERRUPTED
+                || !ReadVarint(f, &n) || n > INT_MAX)
+                return false;
+            cmd->col = n;
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool CompileScript(FILE *inFile, FILE *f) {
+    Command cmd;
+    int r = 1;
+    Session *ses = SessionOpen(inFile, NULL, stderr);
+    fwrite(PROGRAM_MAGIC, 1, PROGRAM_MAGIC_LEN, f);
+    putc_unlocked(PROGRAM_VERSION, f);
+    do {
+        ParseLine(ses, &cmd, r++);
+        WriteCommand(&cmd, f);
+        PolyDestroy(&cmd.p);
+        free(cmd.fileName);
+    } while (cmd.type != CMD_END);
+    SessionClose(ses);
+    return !ferror(f);
+}
+
+bool RunProgram(PolyStack *s, FILE *f, FILE *outFile, FILE *errFile) {
+    char magic[PROGRAM_MAGIC_LEN];
+    Command cmd;
+    Result res;
+    bool ok = true;
+    int r = 1;
+    if (fread(magic, 1, PROGRAM_MAGIC_LEN, f) != PROGRAM_MAGIC_LEN
+        || memcmp(magic, PROGRAM_MAGIC, PROGRAM_MAGIC_LEN) != 0
+        || getc_unlocked(f) != PROGRAM_VERSION)
+        return false;
+    Session *ses = SessionOpen(NULL, outFile, errFile);
+    while ((ok = ReadCommandRecord(f, &cmd, r++)) && cmd.type != CMD_END) {
+        Execute(s, &cmd, &res);
+        Emit(ses, &res);
+    }
+    SessionClose(ses);
+    return ok;
+}
+
+bool Record(PolyStack *s, FILE *inFile, FILE *outFile, FILE *errFile,
+            FILE *log) {
+    Command cmd;
+    Result res;
+    int r = 1;
+    Session *ses = SessionOpen(inFile, outFile, errFile);
+    fwrite(RECORD_MAGIC, 1, PROGRAM_MAGIC_LEN, log);
+    putc_unlocked(PROGRAM_VERSION, log);
+    long start = PolyTraceNow();
+    while (ParseLine(ses, &cmd, r++), cmd.type != CMD_END) {
+        WriteCommand(&cmd, log);
+        long begin = PolyTraceNow();
+        Execute(s, &cmd, &res);
+        long end = PolyTraceNow();
+        WriteVarint(begin - start, log);
+        WriteVarint(end - begin, log);
+        Emit(ses, &res);
+    }
+    WriteCommand(&cmd, log);
+    SessionClose(ses);
+    return !ferror(log);
+}
+
+/**
+ * Sprawdza, czy czas wykonania wiersza istotnie odbiega od zapisanego.
+ * Różnice poniżej REPLAY_MIN_DIFF_NS są pomijane jako szum pomiaru.
+ * @param[in] recorded : zapisany czas w nanosekundach
+ * @param[in] ns : obecny czas w nanosekundach
+ * @param[in] threshold : dopuszczalna różnica w procentach
+ * @return czy różnica przekracza próg
+ */
+static bool TimingDeviates(unsigned long recorded, unsigned long ns,
+                           unsigned threshold) {
+    unsigned long diff = ns > recorded ? ns - recorded : recorded - ns;
+    return diff >= REPLAY_MIN_DIFF_NS
+           && diff * 100 > recorded * (unsigned long) threshold;
+}
+
+bool Replay(PolyStack *s, FILE *log, FILE *outFile, FILE *errFile,
+            unsigned threshold) {
+    char magic[PROGRAM_MAGIC_LEN];
+    unsigned long offset, recorded;
+    Command cmd;
+    Result res;
+    bool ok = true;
+    int r = 1;
+    if (fread(magic, 1, PROGRAM_MAGIC_LEN, log) != PROGRAM_MAGIC_LEN
+        || memcmp(magic, RECORD_MAGIC, PROGRAM_MAGIC_LEN) != 0
+        || getc_unlocked(log) != PROGRAM_VERSION)
+        return false;
+    Session *ses = SessionOpen(NULL, outFile, errFile);
+    while ((ok = ReadCommandRecord(log, &cmd, r++)) && cmd.type != CMD_END) {
+        if (!ReadVarint(log, &offset) || !ReadVarint(log, &recorded)) {
+            PolyDestroy(&cmd.p);
+            free(cmd.fileName);
+            ok = false;
+            break;
+        }
+        CommandType type = cmd.type;
+        long begin = PolyTraceNow();
+        Execute(s, &cmd, &res);
+        unsigned long ns = PolyTraceNow() - begin;
+        Emit(ses, &res);
+        if (TimingDeviates(recorded, ns, threshold)) {
+            if (ses->errFile == ses->outFile)
+                OutputFlush(ses);
+            fprintf(ses->errFile, "TIMING %d %s %lu %lu\n", cmd.line,
+                    CommandName(type), recorded, ns);
+        }
+    }
+    SessionClose(ses);
+    return ok;
+}
+
+void CleanStack(PolyStack *s) {
+    while (!IsEmpty(s))
+        PolyRefRelease(s->data[--s->size]);
+    if (s->spill != NULL)
+        fclose(s->spill);
+    free(s->data);
     free(s);
 }
 
-int main() {
+/**
+ * Wspólny stan puli wątków wykonujących sesje wsadowe.
+ */
+typedef struct Batch {
+    char **files; ///< pliki wejściowe kolejnych sesji
+    int count; ///< liczba sesji
+    _Atomic int next; ///< indeks pierwszej nierozpoczętej sesji
+    _Atomic bool ok; ///< czy wszystkie pliki udało się otworzyć
+} Batch;
+
+/**
+ * Wykonuje jedną sesję wsadową: wejście @p file, wyjście @p file.out,
+ * błędy @p file.err.
+ * @param[in] file : plik wejściowy
+ * @return czy udało się otworzyć pliki sesji
+ */
+static bool RunBatchSession(const char *file) {
+    FILE *inFile = fopen(file, "r");
+    if (inFile == NULL)
+        return false;
+    char *name = malloc(strlen(file) + sizeof(BATCH_ERR_SUFFIX));
+    assert(name != NULL);
+    sprintf(name, "%s%s", file, BATCH_OUT_SUFFIX);
+    FILE *outFile = fopen(name, "w");
+    sprintf(name, "%s%s", file, BATCH_ERR_SUFFIX);
+    FILE *errFile = fopen(name, "w");
+    free(name);
+    bool ok = outFile != NULL && errFile != NULL;
+    if (ok) {
+        atomic_long monos;
+        atomic_init(&monos, 0);
+        PolySetMemAccount(&monos);
+        PolyStack *s = Init();
+        Read(s, inFile, outFile, errFile);
+        CleanStack(s);
+        PolySetMemAccount(NULL);
+    }
+    fclose(inFile);
+    if (outFile != NULL && fclose(outFile) != 0)
+        ok = false;
+    if (errFile != NULL && fclose(errFile) != 0)
+        ok = false;
+    PolyReleaseCache();
+    return ok;
+}
+
+/**
+ * Wątek puli: pobiera kolejne sesje, dopóki jakieś zostały.
+ * @param[in] arg : stan puli
+ * @return NULL
+ */
+static void *BatchWorker(void *arg) {
+    Batch *batch = arg;
+    int i;
+    while ((i = atomic_fetch_add(&batch->next, 1)) < batch->count) {
+        if (!RunBatchSession(batch->files[i])) {
+            fprintf(stderr, "cannot run session %s\n", batch->files[i]);
+            atomic_store(&batch->ok, false);
+        }
+    }
+    return NULL;
+}
+
+bool RunBatch(unsigned jobs, int count, char *files[]) {
+    Batch batch = {.files = files, .count = count};
+    atomic_init(&batch.next, 0);
+    atomic_init(&batch.ok, true);
+    if (jobs > (unsigned) count)
+        jobs = count;
+    pthread_t *workers = malloc(jobs * sizeof(pthread_t));
+    assert(workers != NULL || jobs == 0);
+    unsigned started = 0;
+    while (started < jobs
+           && pthread_create(&workers[started], NULL, BatchWorker, &batch) == 0)
+        started++;
+    if (started == 0)
+        BatchWorker(&batch);
+    for (unsigned i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    return atomic_load(&batch.ok);
+}
+
+/**
+ * Połączenie z klientem serwera wraz z jego sesją kalkulatora.
+ * Pola @p job i @p jobOut należą do wątku puli, gdy @p busy jest ustawione;
+ * pozostałe pola należą do pętli zdarzeń.
+ */
+typedef struct Connection {
+    int fd; ///< gniazdo klienta
+    PolyStack *s; ///< stos sesji
+    int line; ///< numer kolejnego wiersza sesji
+    struct {
+        char *data; ///< odebrane, jeszcze niewykonane dane
+        size_t len; ///< liczba bajtów w @p data
+        size_t size; ///< rozmiar bufora @p data
+    } in;
+    struct {
+        char *data; ///< dane do wysłania
+        size_t len; ///< liczba bajtów w @p data
+        size_t pos; ///< liczba już wysłanych bajtów
+        size_t size; ///< rozmiar bufora @p data
+    } out;
+    char *job; ///< pełne wiersze przekazane do wykonania
+    size_t jobLen; ///< długość @p job
+    char *jobOut; ///< wyjście wykonanych wierszy
+    size_t jobOutLen; ///< długość @p jobOut
+    atomic_long monos; ///< jednomiany sesji, do których stosuje się limit
+    bool busy; ///< czy wiersze połączenia są właśnie wykonywane
+    bool eof; ///< czy klient zakończył wysyłanie
+    bool broken; ///< czy połączenie zostało zerwane
+    struct Connection *next; ///< następny element kolejki zadań
+    struct Connection *prevConn; ///< poprzednie otwarte połączenie
+    struct Connection *nextConn; ///< następne otwarte połączenie
+} Connection;
+
+/**
+ * Stan serwera: pętla zdarzeń i kolejki zadań puli wątków.
+ */
+typedef struct Server {
+    int epfd; ///< deskryptor epoll
+    int listenFd; ///< gniazdo nasłuchujące
+    int wakeFd; ///< eventfd budzący pętlę po wykonaniu zadania
+    unsigned conns; ///< liczba otwartych połączeń
+    unsigned maxConns; ///< maksymalna liczba otwartych połączeń
+    bool listening; ///< czy przyjmujemy nowe połączenia
+    Connection *all; ///< lista otwartych połączeń
+    pthread_mutex_t lock; ///< chroni @p pending, @p done i @p stop
+    pthread_cond_t cond; ///< sygnalizuje nowe zadania
+    Connection *pending; ///< połączenia czekające na wykonanie
+    Connection **pendingTail; ///< koniec kolejki @p pending
+    Connection *done; ///< połączenia z wykonanymi zadaniami
+    bool stop; ///< czy wątki puli mają się zakończyć
+} Server;
+
+/** Ustawiane przez obsługę SIGINT i SIGTERM */
+static volatile sig_atomic_t serverStop = 0;
+
+/**
+ * Obsługa sygnałów kończących serwer.
+ * @param[in] sig : numer sygnału
+ */
+static void ServerSignal(int sig) {
+    (void) sig;
+    serverStop = 1;
+}
+
+/**
+ * Dopisuje dane na koniec rosnącego bufora.
+ * @param[in,out] data : bufor
+ * @param[in,out] len : liczba zajętych bajtów
+ * @param[in,out] size : rozmiar bufora
+ * @param[in] src : dopisywane dane
+ * @param[in] n : długość dopisywanych danych
+ */
+static void BufferAppend(char **data, size_t *len, size_t *size,
+                         const char *src, size_t n) {
+    if (*len + n > *size) {
+        *size = *size * 2 > *len + n ? *size * 2 : *len + n;
+        *data = realloc(*data, *size);
+        assert(*data != NULL);
+    }
+    memcpy(*data + *len, src, n);
+    *len += n;
+}
+
+/**
+ * Wykonuje przekazane wiersze na stosie połączenia (w wątku puli).
+ * @param[in] conn : połączenie
+ */
+static void ServerExecute(Connection *conn) {
+    Command cmd;
+    Result res;
+    FILE *inFile = fmemopen(conn->job, conn->jobLen, "r");
+    FILE *outFile = open_memstream(&conn->jobOut, &conn->jobOutLen);
+    assert(inFile != NULL && outFile != NULL);
+    Session *ses = SessionOpen(inFile, outFile, outFile);
+    PolySetMemAccount(&conn->monos);
+    while (ParseLine(ses, &cmd, conn->line++), cmd.type != CMD_END) {
+        Execute(conn->s, &cmd, &res);
+        Emit(ses, &res);
+    }
+    PolySetMemAccount(NULL);
+    conn->line--;
+    SessionClose(ses);
+    fclose(inFile);
+    fclose(outFile);
+    free(conn->job);
+    conn->job = NULL;
+}
+
+/**
+ * Wątek puli: wykonuje zadania kolejnych połączeń.
+ * @param[in] arg : serwer
+ * @return NULL
+ */
+static void *ServerWorker(void *arg) {
+    Server *srv = arg;
+    const uint64_t one = 1;
+    pthread_mutex_lock(&srv->lock);
+    while (true) {
+        while (srv->pending == NULL && !srv->stop)
+            pthread_cond_wait(&srv->cond, &srv->lock);
+        Connection *conn = srv->pending;
+        if (conn == NULL)
+            break;
+        srv->pending = conn->next;
+        if (srv->pending == NULL)
+            srv->pendingTail = &srv->pending;
+        pthread_mutex_unlock(&srv->lock);
+        ServerExecute(conn);
+        pthread_mutex_lock(&srv->lock);
+        conn->next = srv->done;
+        srv->done = conn;
+        if (write(srv->wakeFd, &one, sizeof(one)) != sizeof(one))
+            assert(errno == EAGAIN);
+    }
+    pthread_mutex_unlock(&srv->lock);
+    PolyReleaseCache();
+    return NULL;
+}
+
+/**
+ * Odrzuca wiersz, który nie zmieścił się w buforze połączenia: wysyła
+ * klientowi błąd i kończy odbiór, więc połączenie zostanie zamknięte
+ * po wysłaniu wyjścia.
+ * @param[in] conn : połączenie
+ */
+static void ServerReject(Connection *conn) {
+    char msg[64];
+    int n = snprintf(msg, sizeof(msg), "ERROR %d %s\n", conn->line,
+                     errorMessages[ERR_LINE_TOO_LONG]);
+    BufferAppend(&conn->out.data, &conn->out.len, &conn->out.size, msg, n);
+    conn->in.len = 0;
+    conn->eof = true;
+}
+
+/**
+ * Przekazuje puli pełne wiersze odebrane od klienta, o ile połączenie
+ * nie czeka już na wykonanie poprzednich. Wiersz dłuższy niż
+ * SERVER_MAX_PENDING jest odrzucany (ServerReject).
+ * @param[in] srv : serwer
+ * @param[in] conn : połączenie
+ */
+static void ServerSubmit(Server *srv, Connection *conn) {
+    if (conn->busy || conn->broken || conn->in.len == 0)
+        return ;
+    char *nl = memrchr(conn->in.data, '\n', conn->in.len);
+    size_t cut = nl != NULL ? (size_t) (nl - conn->in.data) + 1 : 0;
+    if (cut == 0 && conn->in.len >= SERVER_MAX_PENDING)
+        ServerReject(conn);
+    if (cut == 0 && conn->eof)
+        cut = conn->in.len;
+    if (cut == 0)
+        return ;
+    conn->job = malloc(cut);
+    assert(conn->job != NULL);
+    memcpy(conn->job, conn->in.data, cut);
+    conn->jobLen = cut;
+    conn->in.len -= cut;
+    memmove(conn->in.data, conn->in.data + cut, conn->in.len);
+    conn->busy = true;
+    conn->next = NULL;
+    pthread_mutex_lock(&srv->lock);
+    *srv->pendingTail = conn;
+    srv->pendingTail = &conn->next;
+    pthread_cond_signal(&srv->cond);
+    pthread_mutex_unlock(&srv->lock);
+}
+
+/**
+ * Ustawia zdarzenia, na które czeka połączenie.
+ * @param[in] srv : serwer
+ * @param[in] conn : połączenie
+ */
+static void ServerWatch(Server *srv, Connection *conn) {
+    struct epoll_event ev = {.data.ptr = conn};
+    if (conn->broken) {
+        epoll_ctl(srv->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+        return ;
+    }
+    if (!conn->eof && conn->in.len < SERVER_MAX_PENDING)
+        ev.events |= EPOLLIN;
+    if (conn->out.pos < conn->out.len)
+        ev.events |= EPOLLOUT;
+    epoll_ctl(srv->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+/**
+ * Włącza lub wyłącza przyjmowanie nowych połączeń.
+ * @param[in] srv : serwer
+ * @param[in] on : czy przyjmować połączenia
+ */
+static void ServerListen(Server *srv, bool on) {
+    struct epoll_event ev = {.events = on ? EPOLLIN : 0,
+                             .data.ptr = &srv->listenFd};
+    srv->listening = on;
+    epoll_ctl(srv->epfd, EPOLL_CTL_MOD, srv->listenFd, &ev);
+}
+
+/**
+ * Zamyka połączenie i zwalnia jego sesję.
+ * @param[in] srv : serwer
+ * @param[in] conn : połączenie (nie może czekać na wykonanie)
+ */
+static void ServerClose(Server *srv, Connection *conn) {
+    assert(!conn->busy);
+    epoll_ctl(srv->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->prevConn != NULL)
+        conn->prevConn->nextConn = conn->nextConn;
+    else
+        srv->all = conn->nextConn;
+    if (conn->nextConn != NULL)
+        conn->nextConn->prevConn = conn->prevConn;
+    CleanStack(conn->s);
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+    srv->conns--;
+    if (!srv->listening)
+        ServerListen(srv, true);
+}
+
+/**
+ * Przyjmuje oczekujące połączenia, dopóki nie osiągnięto limitu.
+ * @param[in] srv : serwer
+ */
+static void ServerAccept(Server *srv) {
+    int fd;
+    while (srv->conns < srv->maxConns
+           && (fd = accept4(srv->listenFd, NULL, NULL,
+                            SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        Connection *conn = calloc(1, sizeof(Connection));
+        assert(conn != NULL);
+        conn->fd = fd;
+        atomic_init(&conn->monos, 0);
+        conn->s = Init();
+        conn->line = 1;
+        conn->nextConn = srv->all;
+        if (srv->all != NULL)
+            srv->all->prevConn = conn;
+        srv->all = conn;
+        srv->conns++;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+        epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (srv->conns >= srv->maxConns)
+        ServerListen(srv, false);
+}
+
+/**
+ * Odbiera dostępne dane od klienta.
+ * @param[in] conn : połączenie
+ */
+static void ServerRecv(Connection *conn) {
+    char buf[SERVER_READ_SIZE];
+    ssize_t n;
+    while (!conn->eof && conn->in.len < SERVER_MAX_PENDING) {
+        n = recv(conn->fd, buf, sizeof(buf), 0);
+        if (n > 0)
+            BufferAppend(&conn->in.data, &conn->in.len, &conn->in.size, buf, n);
+        else if (n == 0)
+            conn->eof = true;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+            conn->eof = conn->broken = true;
+    }
+}
+
+/**
+ * Wysyła tyle oczekującego wyjścia, ile przyjmie gniazdo.
+ * @param[in] conn : połączenie
+ */
+static void ServerSend(Connection *conn) {
+    ssize_t n;
+    while (!conn->broken && conn->out.pos < conn->out.len) {
+        n = send(conn->fd, conn->out.data + conn->out.pos,
+                 conn->out.len - conn->out.pos, MSG_NOSIGNAL);
+        if (n >= 0)
+            conn->out.pos += n;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return ;
+        else if (errno != EINTR)
+            conn->eof = conn->broken = true;
+    }
+    conn->out.pos = conn->out.len = 0;
+}
+
+/**
+ * Posuwa obsługę połączenia: wysyła wyjście, zleca wykonanie nowych wierszy
+ * i zamyka połączenie, gdy nie ma już nic do zrobienia.
+ * @param[in] srv : serwer
+ * @param[in] conn : połączenie
+ */
+static void ServerProgress(Server *srv, Connection *conn) {
+    ServerSend(conn);
+    ServerSubmit(srv, conn);
+    if (conn->busy)
+        ServerWatch(srv, conn);
+    else if (conn->broken || (conn->eof && conn->out.pos == conn->out.len))
+        ServerClose(srv, conn);
+    else
+        ServerWatch(srv, conn);
+}
+
+/**
+ * Odbiera od puli wyniki wykonanych zadań.
+ * @param[in] srv : serwer
+ */
+static void ServerCollect(Server *srv) {
+    uint64_t count;
+    if (read(srv->wakeFd, &count, sizeof(count)) < 0)
+        assert(errno == EAGAIN);
+    pthread_mutex_lock(&srv->lock);
+    Connection *conn = srv->done;
+    srv->done = NULL;
+    pthread_mutex_unlock(&srv->lock);
+    while (conn != NULL) {
+        Connection *next = conn->next;
+        conn->busy = false;
+        BufferAppend(&conn->out.data, &conn->out.len, &conn->out.size,
+                     conn->jobOut, conn->jobOutLen);
+        free(conn->jobOut);
+        conn->jobOut = NULL;
+        ServerProgress(srv, conn);
+        conn = next;
+    }
+}
+
+/**
+ * Tworzy gniazdo nasłuchujące pod ścieżką @p path.
+ * @param[in] path : ścieżka gniazda
+ * @return deskryptor gniazda lub -1
+ */
+static int ServerSocket(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool RunServer(const char *path, unsigned jobs, unsigned maxConns) {
+    Server srv = {.maxConns = maxConns > 0 ? maxConns : 1, .listening = true};
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    struct sigaction sa = {.sa_handler = ServerSignal};
+    srv.pendingTail = &srv.pending;
+    srv.listenFd = ServerSocket(path);
+    if (srv.listenFd < 0)
+        return false;
+    srv.epfd = epoll_create1(EPOLL_CLOEXEC);
+    srv.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(srv.epfd >= 0 && srv.wakeFd >= 0);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &srv.listenFd};
+    epoll_ctl(srv.epfd, EPOLL_CTL_ADD, srv.listenFd, &ev);
+    ev.data.ptr = &srv.wakeFd;
+    epoll_ctl(srv.epfd, EPOLL_CTL_ADD, srv.wakeFd, &ev);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_cond_init(&srv.cond, NULL);
+    if (jobs == 0)
+        jobs = 1;
+    pthread_t *workers = malloc(jobs * sizeof(pthread_t));
+    assert(workers != NULL);
+    for (unsigned i = 0; i < jobs; i++) {
+        if (pthread_create(&workers[i], NULL, ServerWorker, &srv) != 0) {
+            fprintf(stderr, "cannot start server threads\n");
+            exit(1);
+        }
+    }
+    while (!serverStop) {
+        int n = epoll_wait(srv.epfd, events, SERVER_MAX_EVENTS, -1);
+        bool woken = false;
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &srv.listenFd) {
+                ServerAccept(&srv);
+            }
+            else if (ptr == &srv.wakeFd) {
+                woken = true;
+            }
+            else {
+                Connection *conn = ptr;
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    conn->eof = conn->broken = true;
+                else if (events[i].events & EPOLLIN)
+                    ServerRecv(conn);
+                ServerProgress(&srv, conn);
+            }
+        }
+        if (woken)
+            ServerCollect(&srv);
+    }
+    pthread_mutex_lock(&srv.lock);
+    srv.stop = true;
+    pthread_cond_broadcast(&srv.cond);
+    pthread_mutex_unlock(&srv.lock);
+    for (unsigned i = 0; i < jobs; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    for (Connection *conn = srv.all; conn != NULL; conn = conn->nextConn)
+        conn->broken = true;
+    ServerCollect(&srv);
+    while (srv.all != NULL)
+        ServerClose(&srv, srv.all);
+    close(srv.wakeFd);
+    close(srv.epfd);
+    close(srv.listenFd);
+    unlink(path);
+    pthread_mutex_destroy(&srv.lock);
+    pthread_cond_destroy(&srv.cond);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    bool pipelined = false, batch = false, ok = true;
+    const char *compileTo = NULL, *runFrom = NULL, *socketPath = NULL;
+    const char *traceTo = NULL, *recordTo = NULL, *replayFrom = NULL;
+    long threshold = REPLAY_THRESHOLD;
+    long long spillLimit = -1;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN), maxConns = SERVER_MAX_CONNS;
+    int opt;
+    while ((opt = getopt(argc, argv, "pc:r:bj:s:m:M:ST:R:X:d:W:t:")) != -1) {
+        switch (opt) {
+            case 'p':
+                pipelined = true;
+                break;
+            case 'b':
+                batch = true;
+                break;
+            case 'j':
+                jobs = strtol(optarg, NULL, 10);
+                break;
+            case 'c':
+                compileTo = optarg;
+                break;
+            case 'r':
+                runFrom = optarg;
+                break;
+            case 's':
+                socketPath = optarg;
+                break;
+            case 'm':
+                maxConns = strtol(optarg, NULL, 10);
+                break;
+            case 'M':
+                PolyMemSetBudget(strtoull(optarg, NULL, 10));
+                break;
+            case 'S':
+                statsOn = true;
+                break;
+            case 'T':
+                traceTo = optarg;
+                break;
+            case 'R':
+                recordTo = optarg;
+                break;
+            case 'X':
+                replayFrom = optarg;
+                break;
+            case 'd':
+                threshold = strtol(optarg, NULL, 10);
+                break;
+            case 'W':
+                spillLimit = strtoll(optarg, NULL, 10);
+                break;
+            case 't':
+                commandLimitNs = strtol(optarg, NULL, 10) * 1000000L;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-M bytes] [-W bytes] [-t ms] [-S] "
+                        "[-T trace] [-p]\n"
+                        "          [-c program | -r program]\n"
+                        "       %s [-W bytes] [-S] [-T trace] -R log | -X log "
+                        "[-d percent]\n"
+                        "       %s -b [-j jobs] [-t ms] file...\n"
+                        "       %s -s socket [-j jobs] [-m connections] "
+                        "[-t ms]\n",
+                        argv[0], argv[0], argv[0], argv[0]);
+                return 1;
+        }
+    }
+    if (traceTo != NULL && !PolyTraceOpen(traceTo)) {
+        fprintf(stderr, "cannot write trace %s\n", traceTo);
+        return 1;
+    }
+    atexit(StatsAtExit);
+    if (socketPath != NULL) {
+        ok = RunServer(socketPath, jobs > 0 ? jobs : 1,
+                       maxConns > 0 ? maxConns : 1);
+        if (!ok)
+            fprintf(stderr, "cannot listen on %s\n", socketPath);
+        return ok ? 0 : 1;
+    }
+    if (batch)
+        return RunBatch(jobs > 0 ? jobs : 1, argc - optind,
+                        argv + optind) ? 0 : 1;
+    if (compileTo != NULL) {
+        FILE *f = fopen(compileTo, "wb");
+        ok = f != NULL && CompileScript(stdin, f);
+        if (f != NULL && fclose(f) != 0)
+            ok = false;
+        if (!ok)
+            fprintf(stderr, "cannot write program %s\n", compileTo);
+        return ok ? 0 : 1;
+    }
+    struct sigaction sa = {.sa_handler = InterruptSignal};
+    sigaction(SIGINT, &sa, NULL);
     PolyStack *s = Init();
-    Read(s);
+    if (spillLimit >= 0 && !SetSpill(s, spillLimit)) {
+        fprintf(stderr, "cannot create spill file\n");
+        CleanStack(s);
+        return 1;
+    }
+    if (runFrom != NULL) {
+        FILE *f = fopen(runFrom, "rb");
+        ok = f != NULL && RunProgram(s, f, stdout, stderr);
+        if (f != NULL)
+            fclose(f);
+        if (!ok)
+            fprintf(stderr, "cannot read program %s\n", runFrom);
+    }
+    else if (replayFrom != NULL) {
+        FILE *f = fopen(replayFrom, "rb");
+        ok = f != NULL && Replay(s, f, stdout, stderr,
+                                 threshold > 0 ? threshold : 0);
+        if (f != NULL)
+            fclose(f);
+        if (!ok)
+            fprintf(stderr, "cannot read log %s\n", replayFrom);
+    }
+    else if (recordTo != NULL) {
+        FILE *f = fopen(recordTo, "wb");
+        ok = f != NULL && Record(s, stdin, stdout, stderr, f);
+        if (f != NULL && fclose(f) != 0)
+            ok = false;
+        if (!ok)
+            fprintf(stderr, "cannot write log %s\n", recordTo);
+    }
+    else if (pipelined) {
+        ReadPipelined(s, stdin, stdout, stderr);
+    }
+    else {
+        Read(s, stdin, stdout, stderr);
+    }
     CleanStack(s);
-    return 0;
+    return ok ? 0 : 1;
 }
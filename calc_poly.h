@@ -6,21 +6,80 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-typedef struct PolyStackEl {
-    Poly p;
-    struct PolyStackEl *next;
-} PolyStackEl;
+#include <stdatomic.h>
 
+/**
+ * Współdzielony, niezmienny wielomian z licznikiem odwołań.
+ * Wielomian w uchwycie nigdy nie jest modyfikowany, dopóki uchwyt
+ * ma więcej niż jednego właściciela.
+ */
+typedef struct PolyRef {
+    Poly p; ///< wielomian
+    atomic_uint refs; ///< liczba właścicieli uchwytu
+    long spillPos; ///< położenie w pliku wymiany (-1 - wielomian w pamięci)
+    bool compact; ///< czy wielomian jest zwarty (PolyCompact)
+} PolyRef;
+
+/**
+ * Stos uchwytów do wielomianów trzymany w ciągłej, rosnącej tablicy.
+ * Po włączeniu wymiany (SetSpill) elementy z dna stosu mogą być
+ * przeniesione do pliku wymiany; tworzą one prefiks tablicy @p data
+ * długości @p spilled, zapisany w pliku w kolejności od dna stosu.
+ */
 typedef struct PolyStack {
-    PolyStackEl *first;
+    PolyRef **data; ///< kolejne elementy, od dna stosu
+    size_t size; ///< liczba elementów
+    size_t capacity; ///< rozmiar tablicy @p data
+    FILE *spill; ///< plik wymiany (NULL - wymiana wyłączona)
+    size_t spillLimit; ///< pamięć jednomianów, powyżej której stos wymienia
+    size_t spilled; ///< liczba elementów z dna stosu w prefiksie wymiany
+    long spillEnd; ///< koniec danych w pliku wymiany
+    poly_exp_t truncDeg; ///< stopień całkowity, do którego MUL, POW i COMPOSE
+                         ///< obcinają wyniki (ujemny - bez obcięcia)
+    bool autoOrder; ///< czy MUL i COMPOSE dobierają kolejność zmiennych
+    long compactDepth; ///< odległość od szczytu, od której elementy są
+                       ///< zwarte przez PolyCompact (ujemna - wyłączone)
+    size_t compacted; ///< liczba elementów z dna stosu rozpatrzonych już
+                      ///< przez zwartą kopię
 } PolyStack;
 
+/**
+* @brief tworzy uchwyt przejmujący na własność wielomian
+* @param[in] p : wielomian
+* @return uchwyt z jednym właścicielem
+*/
+PolyRef *PolyRefNew(Poly p);
+
+/**
+* @brief dodaje właściciela uchwytu
+* @param[in] r : uchwyt
+* @return ten sam uchwyt
+*/
+PolyRef *PolyRefRetain(PolyRef *r);
+
+/**
+* @brief usuwa właściciela uchwytu; ostatni zwalnia wielomian
+* @param[in] r : uchwyt
+*/
+void PolyRefRelease(PolyRef *r);
+
 /**
 * @brief inicjuje stos
 * @return stworzony stos
 */
 PolyStack *Init();
 
+/**
+* @brief włącza wymianę elementów stosu do pliku tymczasowego.
+* Gdy pamięć jednomianów przekracza @p limit, najgłębsze elementy stosu
+* są zapisywane w zwartej postaci binarnej i zwalniane; dostęp do nich
+* przez Top, Pop i pozostałe funkcje stosu wczytuje je z powrotem.
+* @param[in] s stos
+* @param[in] limit limit pamięci w bajtach
+* @return czy udało się utworzyć plik wymiany
+*/
+bool SetSpill(PolyStack *s, size_t limit);
+
 /**
 * @brief sprawdza pustość stosu
 * @param stos
@@ -30,8 +89,9 @@ bool IsEmpty(PolyStack *s);
 
 /**
 * @brief usuwa górny element
+* Jeśli wielomian jest współdzielony, zwracana jest jego kopia.
 * @param stos
-* @return usunięty element
+* @return usunięty element (na własność)
 */
 Poly Pop(PolyStack *s);
 
@@ -43,17 +103,133 @@ Poly Pop(PolyStack *s);
 void Push(Poly p, PolyStack *s);
 
 /**
-* @brief zwraca kopię górnego elementu
+* @brief zwraca górny element bez kopiowania
 * @param[in] s : stos
-* @return kopia
+* @return górny wielomian (tylko do odczytu)
 */
 Poly Top(PolyStack *s);
 
 /**
-* @brief Czyta wiersz i odpowiednio go interpretuje
+* @brief usuwa górny uchwyt, przekazując go wywołującemu
+* @param[in] s : stos
+* @return uchwyt
+*/
+PolyRef *PopRef(PolyStack *s);
+
+/**
+* @brief wrzuca na stos uchwyt, przejmując go na własność
+* @param[in] r : uchwyt
+* @param[in] s : stos
+*/
+void PushRef(PolyRef *r, PolyStack *s);
+
+/**
+* @brief zwraca górny uchwyt bez zmiany liczby właścicieli
+* @param[in] s : stos
+* @return uchwyt
+*/
+PolyRef *TopRef(PolyStack *s);
+
+/**
+* @brief Czyta kolejne wiersze i odpowiednio je interpretuje
+* @param[in] s stos
+* @param[in] inFile wejście
+* @param[in] outFile wyjście
+* @param[in] errFile wyjście błędów
+*/
+void Read(PolyStack *s, FILE *inFile, FILE *outFile, FILE *errFile);
+
+/**
+* @brief Działa jak Read, ale parsowanie, wykonywanie poleceń i wypisywanie
+* wyników odbywa się w osobnych wątkach połączonych kolejkami.
+* Wyjście jest takie samo jak w przypadku Read.
+* @param[in] s stos
+* @param[in] inFile wejście
+* @param[in] outFile wyjście
+* @param[in] errFile wyjście błędów
+*/
+void ReadPipelined(PolyStack *s, FILE *inFile, FILE *outFile, FILE *errFile);
+
+/**
+* @brief Kompiluje skrypt do postaci binarnej:
+* ciągu kodów operacji z już sparsowanymi i znormalizowanymi wielomianami.
+* Niepoprawne wiersze są zapisywane jako błędy, więc wykonanie
+* skompilowanego skryptu daje to samo wyjście co Read.
+* @param[in] inFile skrypt
+* @param[in] f plik otwarty do zapisu
+* @return czy zapis się powiódł
+*/
+bool CompileScript(FILE *inFile, FILE *f);
+
+/**
+* @brief Wykonuje skrypt skompilowany przez CompileScript.
+* @param[in] s stos
+* @param[in] f plik otwarty do odczytu
+* @param[in] outFile wyjście
+* @param[in] errFile wyjście błędów
+* @return czy plik był poprawny
+*/
+bool RunProgram(PolyStack *s, FILE *f, FILE *outFile, FILE *errFile);
+
+/**
+* @brief Działa jak Read i dodatkowo zapisuje dziennik sesji: każdy
+* wczytany wiersz w postaci skompilowanej (jak CompileScript) wraz
+* z chwilą jego wykonania i czasem trwania.
+* @param[in] s stos
+* @param[in] inFile wejście
+* @param[in] outFile wyjście
+* @param[in] errFile wyjście błędów
+* @param[in] log plik dziennika otwarty do zapisu
+* @return czy zapis dziennika się powiódł
+*/
+bool Record(PolyStack *s, FILE *inFile, FILE *outFile, FILE *errFile,
+            FILE *log);
+
+/**
+* @brief Ponownie wykonuje sesję zapisaną przez Record, dając to samo
+* wyjście (o ile pliki czytane przez LOAD się nie zmieniły). Dla każdego
+* wiersza, którego czas wykonania różni się od zapisanego o więcej niż
+* @p threshold procent, wypisuje na wyjście błędów
+* "TIMING wiersz polecenie zapisany_ns obecny_ns".
 * @param[in] s stos
+* @param[in] log plik dziennika otwarty do odczytu
+* @param[in] outFile wyjście
+* @param[in] errFile wyjście błędów
+* @param[in] threshold dopuszczalna różnica czasu w procentach
+* @return czy dziennik był poprawny
+*/
+bool Replay(PolyStack *s, FILE *log, FILE *outFile, FILE *errFile,
+            unsigned threshold);
+
+/**
+* @brief Wykonuje wiele niezależnych sesji kalkulatora na puli wątków.
+* Każdy plik wejściowy jest wykonywany na osobnym stosie; wyjście trafia
+* do pliku z przyrostkiem ".out", a błędy do pliku z przyrostkiem ".err".
+* Wynik każdej sesji jest taki sam jak przy wykonaniu jej osobno, również
+* przy limicie pamięci, który dotyczy każdej sesji z osobna.
+* @param[in] jobs liczba wątków
+* @param[in] count liczba plików
+* @param[in] files pliki wejściowe
+* @return czy udało się wykonać wszystkie sesje
+*/
+bool RunBatch(unsigned jobs, int count, char *files[]);
+
+/**
+* @brief Uruchamia serwer kalkulatora na gnieździe uniksowym @p path.
+* Każde połączenie ma własny stos i numerację wierszy; klient może wysłać
+* wiele wierszy naraz, a wyjście i błędy otrzymuje w tym samym gnieździe
+* w kolejności wierszy. Wiersze są wykonywane na puli wątków, więc
+* kosztowne polecenia nie blokują obsługi pozostałych połączeń.
+* Na wiersz dłuższy niż 16 MiB serwer odpowiada błędem LINE TOO LONG
+* i zamyka połączenie.
+* Limit pamięci dotyczy każdego połączenia z osobna.
+* Serwer działa do otrzymania SIGINT lub SIGTERM.
+* @param[in] path ścieżka gniazda
+* @param[in] jobs liczba wątków wykonujących polecenia
+* @param[in] maxConns maksymalna liczba jednoczesnych połączeń
+* @return czy udało się uruchomić serwer
 */
-void Read(PolyStack *s);
+bool RunServer(const char *path, unsigned jobs, unsigned maxConns);
 
 /**
 * @brief czyści zadany stos
@@ -7,8 +7,11 @@
 */
 
 #include "poly.h"
+#include "poly_trace.h"
 #include <assert.h>
 #include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -16,19 +19,406 @@
 /** Maksymalna wartość wykładnika wielomianu */
 #define POLY_EXP_MAX INT_MAX
 
+/** Maksymalna liczba jednomianów przechowywanych do ponownego użycia */
+#define MONO_CACHE_MAX (1 << 16)
+
+/** Liczba jednomianów odłożonych przez wątek na wypadek braku pamięci */
+#define MONO_RESERVE 1024
+
+/** Co tyle przydzielonych lub zwolnionych jednomianów wątek
+ * aktualizuje wspólne liczniki pamięci */
+#define MEM_FLUSH 256
+
+/** Co tyle kroków pętli operacji sprawdzany jest termin i przerwanie */
+#define STOP_CHECK_PERIOD 1024
+
+/**
+ * Wspólne liczniki pamięci jednomianów.
+ */
+static struct {
+    atomic_long live; ///< liczba używanych jednomianów
+    atomic_long peak; ///< największa wartość live
+    atomic_size_t budget; ///< limit w jednomianach (0 - brak limitu)
+} memStats;
+
+/**
+ * Stan liczników pamięci wątku.
+ */
+static __thread struct {
+    long delta; ///< zmiana liczby jednomianów niedodana do memStats.live
+    unsigned long allocs; ///< liczba jednomianów przydzielonych przez wątek
+    bool failed; ///< czy operacja została przerwana
+    PolyStop stop; ///< powód przerwania
+    long deadline; ///< termin operacji (0 - brak)
+    const atomic_bool *interrupt; ///< flaga przerwania lub NULL
+    PolyProgress progress; ///< funkcja postępu lub NULL
+    void *progressArg; ///< argument funkcji postępu
+    unsigned long steps; ///< liczba wykonanych kroków pętli
+    atomic_long *account; ///< licznik jednomianów sesji lub NULL
+} memLocal;
+
+/**
+ * Zwolnione jednomiany wątku, gotowe do ponownego użycia.
+ * Każdy wątek ma własną listę, więc niezależne sesje kalkulatora
+ * wykonywane w różnych wątkach przydzielają pamięć bez synchronizacji.
+ */
+static __thread struct {
+    Mono *first; ///< pierwszy wolny jednomian
+    unsigned count; ///< liczba wolnych jednomianów
+    Mono *reserve; ///< jednomiany wydawane, gdy malloc zawiedzie
+    unsigned reserveCount; ///< liczba jednomianów w reserve
+} monoCache;
+
+/**
+ * Przerywa bieżącą operację, jeśli nie została już przerwana.
+ * @param[in] why : powód przerwania
+ */
+static void PolyStopNow(PolyStop why){
+    if (!memLocal.failed) {
+        memLocal.failed = true;
+        memLocal.stop = why;
+    }
+}
+
+/**
+ * Sprawdza termin, flagę przerwania i funkcję postępu.
+ */
+static void StopCheck(){
+    if (memLocal.deadline > 0 && PolyTraceNow() >= memLocal.deadline)
+        PolyStopNow(POLY_STOP_DEADLINE);
+    else if (memLocal.interrupt != NULL && atomic_load(memLocal.interrupt))
+        PolyStopNow(POLY_STOP_INTERRUPT);
+    else if (memLocal.progress != NULL
+             && !memLocal.progress(memLocal.progressArg, memLocal.steps))
+        PolyStopNow(POLY_STOP_INTERRUPT);
+}
+
+/**
+ * Liczy krok pętli operacji i co STOP_CHECK_PERIOD kroków sprawdza,
+ * czy operację należy przerwać.
+ * @return czy operacja została przerwana
+ */
+static inline bool Stopped(){
+    if ((++memLocal.steps & (STOP_CHECK_PERIOD - 1)) == 0)
+        StopCheck();
+    return memLocal.failed;
+}
+
+/**
+ * Dodaje zmianę liczby jednomianów wątku do wspólnych liczników,
+ * aktualizuje szczytowe użycie i sprawdza limit: względem licznika sesji,
+ * jeśli go ustawiono, a w przeciwnym razie względem wszystkich jednomianów.
+ */
+static void MemFlush(){
+    long live = atomic_fetch_add_explicit(&memStats.live, memLocal.delta,
+                                          memory_order_relaxed)
+                + memLocal.delta;
+    long peak = atomic_load_explicit(&memStats.peak, memory_order_relaxed);
+    size_t budget = atomic_load_explicit(&memStats.budget,
+                                         memory_order_relaxed);
+    while (live > peak
+           && !atomic_compare_exchange_weak_explicit(&memStats.peak, &peak,
+                                                     live,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed));
+    if (memLocal.account != NULL)
+        live = atomic_fetch_add_explicit(memLocal.account, memLocal.delta,
+                                         memory_order_relaxed)
+               + memLocal.delta;
+    memLocal.delta = 0;
+    if (budget > 0 && live > 0 && (size_t) live > budget)
+        PolyStopNow(POLY_STOP_MEMORY);
+}
+
+/**
+ * Zwraca wynik operacji albo, jeśli w jej trakcie przekroczono limit
+ * pamięci, zwalnia go i zwraca wielomian zerowy.
+ * @param[in] res : wynik operacji
+ * @return wynik lub wielomian zerowy
+ */
+static inline Poly MemCheck(Poly res){
+    if (memLocal.failed) {
+        PolyDestroy(&res);
+        return PolyZero();
+    }
+    return res;
+}
+
 /**
- * Alokuje niepoprawny(!) jednomian i sprawdza poprawnosć alokacji.
- * @return stworzony jednomian
+ * Uzupełnia zapas jednomianów wątku do MONO_RESERVE.
  */
-static Mono* MonoAlloc(){
-    Mono *new = malloc(sizeof(Mono));
-    assert(new != NULL);
+static void MonoReserveFill(){
+    while (monoCache.reserveCount < MONO_RESERVE) {
+        Mono *m = malloc(sizeof(Mono));
+        if (m == NULL)
+            return ;
+        m->next = monoCache.reserve;
+        monoCache.reserve = m;
+        monoCache.reserveCount++;
+    }
+}
+
+/**
+ * Wydaje jednomian z zapasu po nieudanym malloc i przerywa bieżącą
+ * operację. Zapas wystarcza, by operacja dotarła do najbliższego
+ * sprawdzenia przerwania i zwolniła częściowe wyniki.
+ * @return jednomian
+ */
+static Mono *MonoReserveTake(){
+    PolyStopNow(POLY_STOP_MEMORY);
+    Mono *m = monoCache.reserve;
+    if (m == NULL) {
+        fputs("out of memory\n", stderr);
+        abort();
+    }
+    monoCache.reserve = m->next;
+    monoCache.reserveCount--;
+    return m;
+}
+
+/**
+ * Przydziela wyzerowaną tablicę roboczą operacji. Tablica jest wliczana
+ * do statystyk i limitu pamięci jako równoważna liczba jednomianów; jeśli
+ * przekroczyłaby limit lub zabraknie pamięci, operacja jest przerywana.
+ * @param[in] count : liczba elementów
+ * @param[in] size : rozmiar elementu
+ * @return tablica lub NULL, jeśli operacja została przerwana
+ */
+static void *ScratchAlloc(size_t count, size_t size){
+    if (memLocal.failed)
+        return NULL;
+    if (size > 0 && count > LONG_MAX / size) {
+        PolyStopNow(POLY_STOP_MEMORY);
+        return NULL;
+    }
+    long monos = (long) ((count * size + sizeof(Mono) - 1) / sizeof(Mono));
+    memLocal.delta += monos;
+    MemFlush();
+    void *arr = memLocal.failed ? NULL : calloc(count, size);
+    if (arr == NULL) {
+        PolyStopNow(POLY_STOP_MEMORY);
+        memLocal.delta -= monos;
+        MemFlush();
+    }
+    return arr;
+}
+
+/**
+ * Zwalnia tablicę przydzieloną przez ScratchAlloc.
+ * @param[in] arr : tablica
+ * @param[in] count : liczba elementów
+ * @param[in] size : rozmiar elementu
+ */
+static void ScratchFree(void *arr, size_t count, size_t size){
+    free(arr);
+    memLocal.delta -= (long) ((count * size + sizeof(Mono) - 1)
+                              / sizeof(Mono));
+    MemFlush();
+}
+
+Mono* MonoAlloc(){
+    Mono *new = monoCache.first;
+    if (new != NULL) {
+        monoCache.first = new->next;
+        monoCache.count--;
+    }
+    else {
+        MonoReserveFill();
+        new = malloc(sizeof(Mono));
+        if (new == NULL)
+            new = MonoReserveTake();
+    }
     new->p = PolyZero();
     new->next = NULL;
     new->exp = 0;
+    memLocal.allocs++;
+    if (++memLocal.delta >= MEM_FLUSH)
+        MemFlush();
     return new;
 }
 
+/**
+ * Zwalnia jednomian zaalokowany przez MonoAlloc,
+ * zachowując go do ponownego użycia przez bieżący wątek.
+ * @param[in] m : jednomian
+ */
+void MonoFree(Mono *m){
+    if (--memLocal.delta <= -MEM_FLUSH)
+        MemFlush();
+    if (monoCache.count < MONO_CACHE_MAX) {
+        m->next = monoCache.first;
+        monoCache.first = m;
+        monoCache.count++;
+    }
+    else {
+        free(m);
+    }
+}
+
+void PolyReleaseCache(){
+    while (monoCache.first != NULL) {
+        Mono *next = monoCache.first->next;
+        free(monoCache.first);
+        monoCache.first = next;
+    }
+    monoCache.count = 0;
+    while (monoCache.reserve != NULL) {
+        Mono *next = monoCache.reserve->next;
+        free(monoCache.reserve);
+        monoCache.reserve = next;
+    }
+    monoCache.reserveCount = 0;
+    MemFlush();
+}
+
+/**
+ * Blok zwartego wielomianu (PolyCompact).
+ */
+typedef struct CompactBlock {
+    size_t count; ///< liczba jednomianów
+    Mono monos[]; ///< jednomiany w porządku przechodzenia w głąb
+} CompactBlock;
+
+/**
+ * Kopiuje listę jednomianów i ich współczynniki do kolejnych miejsc
+ * bloku, w porządku przechodzenia drzewa w głąb.
+ * @param[in] m : pierwszy jednomian listy
+ * @param[in] slot : następne wolne miejsce bloku
+ * @return pierwszy jednomian kopii
+ */
+static Mono *CompactList(const Mono *m, Mono **slot){
+    Mono *first = NULL, **link = &first;
+    for (; m != NULL; m = m->next) {
+        Mono *new = (*slot)++;
+        *new = (Mono) {.p = m->p, .exp = m->exp, .next = NULL};
+        if (!PolyIsCoeff(&m->p))
+            new->p.first = CompactList(m->p.first, slot);
+        *link = new;
+        link = &new->next;
+    }
+    return first;
+}
+
+Poly PolyCompact(const Poly *p){
+    if (PolyIsCoeff(p))
+        return *p;
+    size_t count = PolyMemSize(p) / sizeof(Mono);
+    memLocal.delta += (long) count;
+    MemFlush();
+    CompactBlock *block = memLocal.failed
+        ? NULL : malloc(sizeof(CompactBlock) + count * sizeof(Mono));
+    if (block == NULL) {
+        PolyStopNow(POLY_STOP_MEMORY);
+        memLocal.delta -= (long) count;
+        MemFlush();
+        return PolyZero();
+    }
+    block->count = count;
+    Mono *slot = block->monos;
+    Poly res = {.coeff = p->coeff, .first = CompactList(p->first, &slot)};
+    assert(res.first == block->monos && slot == block->monos + count);
+    memLocal.allocs++;
+    return res;
+}
+
+void PolyCompactFree(Poly *p){
+    if (PolyIsCoeff(p))
+        return ;
+    CompactBlock *block = (CompactBlock *) ((char *) p->first
+                                            - offsetof(CompactBlock, monos));
+    memLocal.delta -= (long) block->count;
+    MemFlush();
+    free(block);
+}
+
+size_t PolyMemSize(const Poly *p){
+    size_t size = 0;
+    if (PolyIsCoeff(p))
+        return 0;
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next)
+        size += sizeof(Mono) + PolyMemSize(&tmp->p);
+    return size;
+}
+
+size_t PolyTermCount(const Poly *p){
+    size_t count = 0;
+    if (PolyIsCoeff(p))
+        return p->coeff != 0;
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next)
+        count += PolyTermCount(&tmp->p);
+    return count;
+}
+
+unsigned PolyDepth(const Poly *p){
+    unsigned depth = 0;
+    if (PolyIsCoeff(p))
+        return 0;
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next) {
+        unsigned d = PolyDepth(&tmp->p) + 1;
+        if (d > depth)
+            depth = d;
+    }
+    return depth;
+}
+
+unsigned long PolyMemAllocCount(){
+    return memLocal.allocs;
+}
+
+void PolyMemGetStats(PolyMemStats *stats){
+    MemFlush();
+    long live = atomic_load(&memStats.live);
+    stats->liveMonos = live > 0 ? (size_t) live : 0;
+    stats->liveBytes = stats->liveMonos * sizeof(Mono);
+    stats->peakBytes = (size_t) atomic_load(&memStats.peak) * sizeof(Mono);
+    stats->budget = atomic_load(&memStats.budget) * sizeof(Mono);
+}
+
+void PolyMemResetPeak(){
+    MemFlush();
+    atomic_store(&memStats.peak, atomic_load(&memStats.live));
+}
+
+void PolyMemSetBudget(size_t bytes){
+    size_t monos = bytes / sizeof(Mono);
+    atomic_store(&memStats.budget, bytes > 0 && monos == 0 ? 1 : monos);
+}
+
+bool PolyMemFailed(){
+    return memLocal.failed;
+}
+
+void PolyMemClearError(){
+    memLocal.failed = false;
+    memLocal.stop = POLY_STOP_NONE;
+}
+
+PolyStop PolyStopReason(){
+    return memLocal.stop;
+}
+
+void PolySetDeadline(long ns){
+    memLocal.deadline = ns;
+}
+
+void PolySetMemAccount(atomic_long *account){
+    MemFlush();
+    memLocal.account = account;
+}
+
+void PolySetInterrupt(const atomic_bool *flag){
+    memLocal.interrupt = flag;
+}
+
+bool PolyStep(){
+    return Stopped();
+}
+
+void PolySetProgress(PolyProgress fn, void *arg){
+    memLocal.progress = fn;
+    memLocal.progressArg = arg;
+}
+
 /**
  * Zwraca liczbę jednomianów w wielomianie normalnym.
  * O(n), n - liczba jednomianów
@@ -67,7 +457,7 @@ static void MonoListDestroy(Mono *m){
         return ;
     MonoListDestroy(m->next);
     MonoDestroy(m);
-    free(m);
+    MonoFree(m);
 }
 
 void PolyDestroy(Poly *p){
@@ -94,7 +484,7 @@ static Mono* MonoListClone(Mono *m){
 Poly PolyClone(const Poly *p){
     if (PolyIsCoeff(p))
         return *p;
-    return (Poly) {.first = MonoListClone(p->first)};
+    return MemCheck((Poly) {.first = MonoListClone(p->first)});
 }
 
 static Poly PolyAddCoeff(const Poly *p, poly_coeff_t c);
@@ -168,6 +558,24 @@ static inline bool OnlyZeroExpMonoWithConstCoeff(Poly *p) {
            && PolyIsCoeff(&p->first->p);
 }
 
+/**
+ * Tworzy wielomian z posortowanej listy jednomianów o niezerowych
+ * współczynnikach, sprowadzając jednomian stały do współczynnika.
+ * @param[in] first : pierwszy jednomian listy lub NULL
+ * @return wielomian normalny
+ */
+static Poly PolyFromMonoList(Mono *first){
+    if (first == NULL)
+        return PolyZero();
+    Poly res = (Poly) {.first = first};
+    if (OnlyZeroExpMonoWithConstCoeff(&res)) {
+        Poly coeffPoly = first->p;
+        MonoFree(first);
+        return coeffPoly;
+    }
+    return res;
+}
+
 /**
  * Dodaje dwa normalne wielomiany.
  * @param[in] p : wielomian normalny
@@ -220,7 +628,7 @@ static Poly PolyAddPolyPoly(const Poly *p, const Poly *q){
         if (OnlyZeroExpMonoWithConstCoeff(&res)) {
             Poly coeffPoly = res.first->p;
             assert(PolyIsCoeff(&coeffPoly));
-            free(res.first);
+            MonoFree(res.first);
             return coeffPoly;
         }
         return res;
@@ -229,11 +637,11 @@ static Poly PolyAddPolyPoly(const Poly *p, const Poly *q){
 
 Poly PolyAdd(const Poly *p, const Poly *q){
     if (PolyIsCoeff(p))
-        return PolyAddCoeff(q, p->coeff);
+        return MemCheck(PolyAddCoeff(q, p->coeff));
     else if (PolyIsCoeff(q))
-        return PolyAddCoeff(p, q->coeff);
+        return MemCheck(PolyAddCoeff(p, q->coeff));
     else
-        return PolyAddPolyPoly(p, q);
+        return MemCheck(PolyAddPolyPoly(p, q));
 }
 
 static poly_exp_t MonoCmp(const void *a, const void *b){
@@ -249,7 +657,8 @@ static inline bool MonoIsDummy(Mono *m){
 }
 
 /**
- * Usuwa jednomiany z zerowymi współczynnikami.
+ * Usuwa jednomiany z zerowymi współczynnikami i sprowadza pozostały
+ * jednomian stały do współczynnika.
  * @param[in] p : normalizowany wielomian
  * @return 'wynikowy wielomian'
  */
@@ -264,7 +673,7 @@ static Poly PolyFix(Poly *p){
         assert(act->exp > prev->exp);
         if (PolyIsZero(&act->p)) {
             tmp = act->next;
-            free(act);
+            MonoFree(act);
             prev->next = act = tmp;
         }
         else {
@@ -273,8 +682,8 @@ static Poly PolyFix(Poly *p){
         }
     }
     p->first = dummy->next;
-    free(dummy);
-    return p->first == NULL ? PolyZero() : *p;
+    MonoFree(dummy);
+    return PolyFromMonoList(p->first);
 }
 
 /**
@@ -288,13 +697,27 @@ static Poly PolyAddMonosZeroCoeff(unsigned count, const Mono monos[]){
     assert(count > 0);
     Mono *act, *tmp, *dummy, *prev;
     Poly res;
+    Mono *arr = ScratchAlloc(count, sizeof(Mono));
+    if (arr == NULL) {
+        for (unsigned i = 0; i < count; i++) {
+            res = monos[i].p;
+            PolyDestroy(&res);
+        }
+        return PolyZero();
+    }
     prev = act = dummy = MonoAlloc();
     *dummy = MonoDummy();
-    Mono *arr = calloc(count, sizeof(Mono));
-    assert(arr != NULL);
     memcpy(arr, monos, count * sizeof(Mono));
     qsort(arr, count, sizeof(Mono), MonoCmp);
     for (unsigned i = 0; i < count; i++) {
+        if (Stopped()) {
+            for (unsigned j = i; j < count; j++)
+                PolyDestroy(&arr[j].p);
+            res = (Poly) {.first = dummy->next};
+            PolyDestroy(&res);
+            ScratchFree(arr, count, sizeof(Mono)), MonoFree(dummy);
+            return PolyZero();
+        }
         tmp = MonoAlloc();
         if (MonoIsDummy(act)) {
             *tmp = MonoFromPoly(&arr[i].p, arr[i].exp);
@@ -312,7 +735,7 @@ static Poly PolyAddMonosZeroCoeff(unsigned count, const Mono monos[]){
             *tmp = MonoFromPoly(&sum, arr[i].exp);
             PolyDestroy(&arr[i].p);
             PolyDestroy(&act->p);
-            free(act);
+            MonoFree(act);
             prev->next = act = tmp;
         }
     }
@@ -320,20 +743,22 @@ static Poly PolyAddMonosZeroCoeff(unsigned count, const Mono monos[]){
     assert(first != NULL);
     if (first->next == NULL && first->exp == 0 && PolyIsCoeff(&first->p)) {
         res = first->p;
-        free(first);
+        MonoFree(first);
     }
     else {
         res = (Poly) {.first = first};
     }
-    free(arr), free(dummy);
+    ScratchFree(arr, count, sizeof(Mono)), MonoFree(dummy);
     return res;
 }
 
 Poly PolyAddMonos(unsigned count, const Mono monos[]){
     Poly res = PolyAddMonosZeroCoeff(count, monos);
-    return PolyFix(&res);
+    return MemCheck(PolyFix(&res));
 }
 
+static Poly PolyMulRec(const Poly *p, const Poly *q);
+
 /**
  * Mnoży dwa wielomiany normalne.
  * @param[in] p : wielomian normalny
@@ -341,21 +766,31 @@ Poly PolyAddMonos(unsigned count, const Mono monos[]){
  * @return `p * q`
  */
 static Poly PolyMulPolyPoly(const Poly *p, const Poly *q){
-    unsigned count = PolyLen(p) * PolyLen(q);
-    Mono  *arr = calloc(count, sizeof(struct Mono));
+    size_t count = (size_t) PolyLen(p) * PolyLen(q);
+    Mono *arr = count <= UINT_MAX ? ScratchAlloc(count, sizeof(Mono)) : NULL;
     unsigned k = 0;
     Mono *tmpp = p->first, *tmpq = q->first;
+    if (arr == NULL) {
+        PolyStopNow(POLY_STOP_MEMORY);
+        return PolyZero();
+    }
     while (tmpp != NULL) {
         tmpq = q->first;
-        while (tmpq != NULL) {
-            arr[k++] = (Mono) {.p = PolyMul(&tmpp->p, &tmpq->p),
+        while (tmpq != NULL && !Stopped()) {
+            arr[k++] = (Mono) {.p = PolyMulRec(&tmpp->p, &tmpq->p),
                                .exp = tmpp->exp + tmpq->exp};
             tmpq = tmpq->next;
         }
         tmpp = tmpp->next;
+        if (memLocal.failed) {
+            while (k > 0)
+                PolyDestroy(&arr[--k].p);
+            ScratchFree(arr, count, sizeof(Mono));
+            return PolyZero();
+        }
     }
     Poly res = PolyAddMonos(count, arr);
-    free(arr);
+    ScratchFree(arr, count, sizeof(Mono));
     return res;
 }
 
@@ -372,14 +807,16 @@ static Poly PolyMulPolyCoeff(const Poly *p, poly_coeff_t c){
         return PolyZero();
     unsigned len = PolyLen(p), count = 0;
     Mono *tmp = p->first;
-    Mono *arr = calloc(len, sizeof(Mono));
+    Mono *arr = ScratchAlloc(len, sizeof(Mono));
+    if (arr == NULL)
+        return PolyZero();
     while (tmp != NULL) {
         arr[count++] = (Mono) {.p = PolyMulCoeff(&tmp->p, c), .exp = tmp->exp};
         tmp = tmp->next;
     }
     assert(count == len);
     Poly res = PolyAddMonos(len, arr);
-    free(arr);
+    ScratchFree(arr, len, sizeof(Mono));
     return res;
 }
 
@@ -396,7 +833,13 @@ static Poly PolyMulCoeff(const Poly *p, poly_coeff_t c){
         return PolyMulPolyCoeff(p, c);
 }
 
-Poly PolyMul(const Poly *p, const Poly *q){
+/**
+ * Mnoży dwa wielomiany bez zapisu śladu, dla wywołań rekurencyjnych.
+ * @param[in] p : wielomian
+ * @param[in] q : wielomian
+ * @return `p * q`
+ */
+static Poly PolyMulRec(const Poly *p, const Poly *q){
     if (PolyIsCoeff(p))
         return PolyMulCoeff(q, p->coeff);
     else if (PolyIsCoeff(q))
@@ -405,8 +848,17 @@ Poly PolyMul(const Poly *p, const Poly *q){
         return PolyMulPolyPoly(p, q);
 }
 
+Poly PolyMul(const Poly *p, const Poly *q){
+    if (PolyIsCoeff(p) && PolyIsCoeff(q))
+        return PolyFromCoeff(p->coeff * q->coeff);
+    PolyTraceBegin("PolyMul");
+    Poly res = PolyMulRec(p, q);
+    PolyTraceEnd("PolyMul");
+    return MemCheck(res);
+}
+
 Poly PolyNeg(const Poly *p){
-    return PolyMulCoeff(p, -1);
+    return MemCheck(PolyMulCoeff(p, -1));
 }
 
 Poly PolySub(const Poly *p, const Poly *q){
@@ -509,8 +961,10 @@ Poly PolyAt(const Poly *p, poly_coeff_t x){
         PolyDestroy(&mulTmp);
         res = addTmp;
         tmp = tmp->next;
+        if (Stopped())
+            break;
     }
-    return res;
+    return MemCheck(res);
 }
 
 /**
@@ -524,8 +978,8 @@ static Poly PolyPow(const Poly *p, unsigned exp) {
     if (exp == 0)
         return PolyFromCoeff(1);
     Poly tmp, res = PolyClone(p);
-    while (--exp) {
-        tmp = PolyMul(&res, p);
+    while (--exp && !Stopped()) {
+        tmp = PolyMulRec(&res, p);
         PolyDestroy(&res);
         res = tmp;
     }
@@ -548,14 +1002,17 @@ static Poly PolySubstitute(const Mono *m, const Poly *p, unsigned actDeg,
         unsigned count, const Poly x[]){
     Poly q = PolyPow(p, m->exp);
     Poly r = PolyComposeRec(actDeg + 1, &m->p, count, x);
-    Poly res = PolyMul(&q, &r);
+    Poly res = PolyMulRec(&q, &r);
     PolyDestroy(&q);
     PolyDestroy(&r);
     return res;
 }
 
 Poly PolyCompose(const Poly *p, unsigned count, const Poly x[]){
-    return PolyComposeRec(0, p, count, x);
+    PolyTraceBegin("PolyCompose");
+    Poly res = PolyComposeRec(0, p, count, x);
+    PolyTraceEnd("PolyCompose");
+    return MemCheck(res);
 }
 /**
  * Tworzy wielomian poprzez wstawianie wielomianów
@@ -578,6 +1035,437 @@ static Poly PolyComposeRec(unsigned actDeg, const Poly *p,
         PolyDestroy(&tmpPoly);
         PolyDestroy(&substituted);
         tmp = tmp->next;
+        if (Stopped())
+            break;
     }
     return res;
 }
+
+/**
+ * Przesuwa schematem Hornera wielomian zadany tablicą współczynników
+ * kolejnych potęg zmiennej; wynik zastępuje zawartość tablicy.
+ * @param[in,out] arr : współczynniki przy @f$x^0, \ldots, x^{deg}@f$
+ * @param[in] a : przesunięcie
+ * @param[in] deg : największy wykładnik
+ */
+static void ShiftArray(poly_coeff_t arr[], poly_coeff_t a, poly_exp_t deg){
+    for (poly_exp_t i = 0; i < deg && !memLocal.failed; i++)
+        for (poly_exp_t j = deg - 1; j >= i && !Stopped(); j--)
+            arr[j] += a * arr[j + 1];
+}
+
+/**
+ * Przesuwa wielomian o współczynnikach będących stałymi.
+ * Cała praca odbywa się na tablicy liczb, wielomian wynikowy
+ * jest budowany od razu w postaci normalnej.
+ * @param[in] p : wielomian normalny o stałych współczynnikach
+ * @param[in] a : przesunięcie
+ * @param[in] deg : stopień wielomianu względem zmiennej głównej
+ * @return `p(x + a)`
+ */
+static Poly PolyShiftCoeffs(const Poly *p, poly_coeff_t a, poly_exp_t deg){
+    poly_coeff_t *arr = ScratchAlloc((size_t) deg + 1, sizeof(poly_coeff_t));
+    if (arr == NULL)
+        return PolyZero();
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next)
+        arr[tmp->exp] = tmp->p.coeff;
+    ShiftArray(arr, a, deg);
+    if (memLocal.failed) {
+        ScratchFree(arr, (size_t) deg + 1, sizeof(poly_coeff_t));
+        return PolyZero();
+    }
+    Mono *first = NULL, *new;
+    for (poly_exp_t j = deg; j >= 0; j--) {
+        if (arr[j] == 0)
+            continue;
+        new = MonoAlloc();
+        new->p = PolyFromCoeff(arr[j]);
+        new->exp = j;
+        new->next = first;
+        first = new;
+    }
+    ScratchFree(arr, (size_t) deg + 1, sizeof(poly_coeff_t));
+    return PolyFromMonoList(first);
+}
+
+/**
+ * Stan kolumny w ShiftColumn dla jednego wielomianu wejściowego
+ * i jednego wyniku.
+ */
+typedef struct ShiftCursor {
+    Mono *cur; ///< pierwszy nieprzetworzony jednomian wejścia
+    const Poly *coeff; ///< wejście będące niezerową stałą, jeszcze nieużyte
+    Mono *first; ///< pierwszy jednomian wyniku
+    Mono *last; ///< ostatni jednomian wyniku
+} ShiftCursor;
+
+/**
+ * Wylicza współczynniki przy kolejnych potęgach @f$x@f$ wielomianu
+ * @f$\sum_e c_e (x + a)^e@f$, gdzie @f$c_e@f$ są wielomianami zmiennych
+ * innych niż @f$x@f$. Przesunięcie jest liniowe, więc jednomiany
+ * @f$c_e@f$ są grupowane po wykładniku ich zmiennej głównej, każda grupa
+ * jest przesuwana rekurencyjnie, a na poziomie stałych tablica liczb jest
+ * przesuwana w miejscu przez ShiftArray. Wyniki są budowane raz,
+ * bez pośrednich sum i iloczynów wielomianów.
+ * @param[in] c : współczynniki @f$c_0, \ldots, c_{deg}@f$, NULL oznacza zero
+ * @param[in] deg : największy indeks w @p c
+ * @param[in] a : przesunięcie
+ * @param[out] res : współczynniki wyniku przy @f$x^0, \ldots, x^{deg}@f$
+ */
+static void ShiftColumn(const Poly *c[], poly_exp_t deg, poly_coeff_t a,
+        Poly res[]){
+    size_t n = (size_t) deg + 1;
+    bool scalar = true;
+    for (size_t e = 0; e < n; e++) {
+        res[e] = PolyZero();
+        if (c[e] != NULL && !PolyIsCoeff(c[e]))
+            scalar = false;
+    }
+    if (scalar) {
+        poly_coeff_t *arr = ScratchAlloc(n, sizeof(poly_coeff_t));
+        if (arr == NULL)
+            return ;
+        for (size_t e = 0; e < n; e++)
+            arr[e] = c[e] != NULL ? c[e]->coeff : 0;
+        ShiftArray(arr, a, deg);
+        for (size_t e = 0; e < n && !memLocal.failed; e++)
+            res[e] = PolyFromCoeff(arr[e]);
+        ScratchFree(arr, n, sizeof(poly_coeff_t));
+        return ;
+    }
+    ShiftCursor *cur = ScratchAlloc(n, sizeof(ShiftCursor));
+    const Poly **col = ScratchAlloc(n, sizeof(const Poly *));
+    Poly *sub = ScratchAlloc(n, sizeof(Poly));
+    for (size_t e = 0; cur != NULL && e < n; e++) {
+        if (c[e] == NULL)
+            continue;
+        if (!PolyIsCoeff(c[e]))
+            cur[e].cur = c[e]->first;
+        else if (!PolyIsZero(c[e]))
+            cur[e].coeff = c[e];
+    }
+    while (col != NULL && sub != NULL && !memLocal.failed) {
+        poly_exp_t f = -1, top = -1;
+        for (size_t e = 0; e < n; e++) {
+            if (cur[e].coeff != NULL)
+                f = 0;
+            else if (cur[e].cur != NULL && (f < 0 || cur[e].cur->exp < f))
+                f = cur[e].cur->exp;
+        }
+        if (f < 0)
+            break;
+        for (size_t e = 0; e < n; e++) {
+            col[e] = NULL;
+            if (f == 0 && cur[e].coeff != NULL) {
+                col[e] = cur[e].coeff;
+                cur[e].coeff = NULL;
+            }
+            else if (cur[e].cur != NULL && cur[e].cur->exp == f) {
+                col[e] = &cur[e].cur->p;
+                cur[e].cur = cur[e].cur->next;
+            }
+            if (col[e] != NULL)
+                top = (poly_exp_t) e;
+        }
+        ShiftColumn(col, top, a, sub);
+        for (poly_exp_t k = 0; k <= top; k++) {
+            if (PolyIsZero(&sub[k]))
+                continue;
+            Mono *new = MonoAlloc();
+            *new = MonoFromPoly(&sub[k], f);
+            if (cur[k].last == NULL)
+                cur[k].first = new;
+            else
+                cur[k].last->next = new;
+            cur[k].last = new;
+        }
+    }
+    for (size_t e = 0; cur != NULL && e < n; e++) {
+        res[e] = PolyFromMonoList(cur[e].first);
+        if (memLocal.failed) {
+            PolyDestroy(&res[e]);
+            res[e] = PolyZero();
+        }
+    }
+    if (sub != NULL)
+        ScratchFree(sub, n, sizeof(Poly));
+    if (col != NULL)
+        ScratchFree(col, n, sizeof(const Poly *));
+    if (cur != NULL)
+        ScratchFree(cur, n, sizeof(ShiftCursor));
+}
+
+/**
+ * Przesuwa wielomian, którego współczynniki mogą być wielomianami.
+ * @param[in] p : wielomian normalny
+ * @param[in] a : przesunięcie
+ * @param[in] deg : stopień wielomianu względem zmiennej głównej
+ * @return `p(x + a)`
+ */
+static Poly PolyShiftPolys(const Poly *p, poly_coeff_t a, poly_exp_t deg){
+    size_t n = (size_t) deg + 1;
+    const Poly **c = ScratchAlloc(n, sizeof(const Poly *));
+    Poly *res = ScratchAlloc(n, sizeof(Poly));
+    Mono *first = NULL, *new;
+    if (c != NULL && res != NULL) {
+        for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next)
+            c[tmp->exp] = &tmp->p;
+        ShiftColumn(c, deg, a, res);
+        for (poly_exp_t j = deg; j >= 0; j--) {
+            if (PolyIsZero(&res[j]))
+                continue;
+            if (memLocal.failed) {
+                PolyDestroy(&res[j]);
+                continue;
+            }
+            new = MonoAlloc();
+            *new = MonoFromPoly(&res[j], j);
+            new->next = first;
+            first = new;
+        }
+    }
+    if (res != NULL)
+        ScratchFree(res, n, sizeof(Poly));
+    if (c != NULL)
+        ScratchFree(c, n, sizeof(const Poly *));
+    return PolyFromMonoList(first);
+}
+
+Poly PolyShift(const Poly *p, poly_coeff_t a){
+    if (PolyIsCoeff(p) || a == 0)
+        return PolyClone(p);
+    bool onlyCoeffs = true;
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next)
+        if (!PolyIsCoeff(&tmp->p))
+            onlyCoeffs = false;
+    poly_exp_t deg = PolyDegBy(p, 0);
+    if (onlyCoeffs)
+        return MemCheck(PolyShiftCoeffs(p, a, deg));
+    else
+        return MemCheck(PolyShiftPolys(p, a, deg));
+}
+
+/** Brak ograniczenia stopnia całkowitego w obliczeniach obciętych */
+#define TRUNC_NONE LONG_MAX
+
+/**
+ * Zwraca dopuszczalny stopień całkowity wyniku obciętego.
+ * @param[in] cap : ograniczenie stopni
+ * @return stopień całkowity lub TRUNC_NONE
+ */
+static inline long TruncBudget(const PolyDegCap *cap){
+    return cap->total < 0 ? TRUNC_NONE : cap->total;
+}
+
+/**
+ * Zwraca największy wykładnik zmiennej @f$x_v@f$, który może wystąpić
+ * w wyniku obciętym.
+ * @param[in] cap : ograniczenie stopni
+ * @param[in] v : numer zmiennej
+ * @param[in] budget : pozostały stopień całkowity
+ * @return największy dopuszczalny wykładnik
+ */
+static inline long TruncLimit(const PolyDegCap *cap, unsigned v, long budget){
+    if (v < cap->count && cap->vars[v] < budget)
+        return cap->vars[v];
+    return budget;
+}
+
+/**
+ * Obcina wielomian, którego zmienną główną jest @f$x_v@f$.
+ * @param[in] p : wielomian normalny
+ * @param[in] cap : ograniczenie stopni
+ * @param[in] v : numer zmiennej głównej
+ * @param[in] budget : pozostały stopień całkowity
+ * @return `p` bez jednomianów przekraczających ograniczenie
+ */
+static Poly PolyTruncRec(const Poly *p, const PolyDegCap *cap, unsigned v,
+        long budget){
+    if (budget < 0)
+        return PolyZero();
+    if (PolyIsCoeff(p))
+        return *p;
+    long limit = TruncLimit(cap, v, budget);
+    Mono *first = NULL, *last = NULL, *new;
+    for (Mono *m = p->first; m != NULL && m->exp <= limit && !Stopped();
+         m = m->next) {
+        Poly c = PolyTruncRec(&m->p, cap, v + 1, budget - m->exp);
+        if (PolyIsZero(&c))
+            continue;
+        new = MonoAlloc();
+        *new = MonoFromPoly(&c, m->exp);
+        if (last == NULL)
+            first = new;
+        else
+            last->next = new;
+        last = new;
+    }
+    return PolyFromMonoList(first);
+}
+
+/**
+ * Mnoży wielomiany, których zmienną główną jest @f$x_v@f$, pomijając
+ * pary jednomianów, których iloczyn przekracza ograniczenie. Jednomiany
+ * są posortowane rosnąco, więc przeglądanie drugiego czynnika kończy się
+ * na pierwszym za dużym wykładniku.
+ * @param[in] p : wielomian normalny
+ * @param[in] q : wielomian normalny
+ * @param[in] cap : ograniczenie stopni
+ * @param[in] v : numer zmiennej głównej
+ * @param[in] budget : pozostały stopień całkowity
+ * @return obcięty iloczyn `p * q`
+ */
+static Poly PolyMulTruncRec(const Poly *p, const Poly *q,
+        const PolyDegCap *cap, unsigned v, long budget){
+    if (budget < 0)
+        return PolyZero();
+    if (PolyIsCoeff(q)) {
+        const Poly *tmp = p;
+        p = q;
+        q = tmp;
+    }
+    if (PolyIsCoeff(p)) {
+        Poly t = PolyTruncRec(q, cap, v, budget);
+        Poly res = PolyMulCoeff(&t, p->coeff);
+        PolyDestroy(&t);
+        return res;
+    }
+    long limit = TruncLimit(cap, v, budget);
+    unsigned count = 0, k = 0;
+    Mono *tmpp, *tmpq;
+    for (tmpp = p->first; tmpp != NULL && tmpp->exp <= limit;
+         tmpp = tmpp->next)
+        for (tmpq = q->first; tmpq != NULL &&
+             tmpp->exp + (long) tmpq->exp <= limit; tmpq = tmpq->next)
+            count++;
+    if (count == 0)
+        return PolyZero();
+    Mono *arr = ScratchAlloc(count, sizeof(Mono));
+    if (arr == NULL)
+        return PolyZero();
+    for (tmpp = p->first; tmpp != NULL && tmpp->exp <= limit;
+         tmpp = tmpp->next) {
+        for (tmpq = q->first; tmpq != NULL &&
+             tmpp->exp + (long) tmpq->exp <= limit && !Stopped();
+             tmpq = tmpq->next) {
+            poly_exp_t exp = tmpp->exp + tmpq->exp;
+            arr[k++] = (Mono) {.p = PolyMulTruncRec(&tmpp->p, &tmpq->p, cap,
+                                                    v + 1, budget - exp),
+                               .exp = exp};
+        }
+        if (memLocal.failed) {
+            while (k > 0)
+                PolyDestroy(&arr[--k].p);
+            ScratchFree(arr, count, sizeof(Mono));
+            return PolyZero();
+        }
+    }
+    Poly res = PolyAddMonos(count, arr);
+    ScratchFree(arr, count, sizeof(Mono));
+    return res;
+}
+
+/**
+ * Podnosi wielomian do potęgi przez podnoszenie do kwadratu, obcinając
+ * każdy iloczyn pośredni. Obcięcie jest zgodne z mnożeniem, więc wynik
+ * jest równy obciętej pełnej potędze.
+ * @param[in] p : podstawa
+ * @param[in] exp : wykładnik
+ * @param[in] cap : ograniczenie stopni
+ * @return obcięta potęga `p^exp`
+ */
+static Poly PolyPowTruncRec(const Poly *p, poly_exp_t exp,
+        const PolyDegCap *cap){
+    long budget = TruncBudget(cap);
+    Poly tmp, res = PolyFromCoeff(1), base = PolyTruncRec(p, cap, 0, budget);
+    while (exp > 0) {
+        if (Stopped() || PolyIsZero(&base)) {
+            PolyDestroy(&res);
+            res = PolyZero();
+            break;
+        }
+        if (exp & 1) {
+            tmp = PolyMulTruncRec(&res, &base, cap, 0, budget);
+            PolyDestroy(&res);
+            res = tmp;
+        }
+        exp >>= 1;
+        if (exp > 0) {
+            tmp = PolyMulTruncRec(&base, &base, cap, 0, budget);
+            PolyDestroy(&base);
+            base = tmp;
+        }
+    }
+    PolyDestroy(&base);
+    return res;
+}
+
+/**
+ * Złożenie obcięte dla wielomianu, którego zmienną główną jest
+ * @f$x_v@f$. Kolejne potęgi wstawianego wielomianu są wyliczane
+ * przyrostowo; gdy potęga obcina się do zera, wyższe jednomiany nie
+ * mogą już nic wnieść i nie są odwiedzane.
+ * @param[in] p : wielomian normalny
+ * @param[in] v : numer zmiennej głównej
+ * @param[in] count : liczba wielomianów w tablicy
+ * @param[in] x : tablica wstawianych wielomianów
+ * @param[in] cap : ograniczenie stopni
+ * @return obcięte złożenie
+ */
+static Poly PolyComposeTruncRec(const Poly *p, unsigned v, unsigned count,
+        const Poly x[], const PolyDegCap *cap){
+    if (PolyIsCoeff(p))
+        return *p;
+    long budget = TruncBudget(cap);
+    Poly zero = PolyZero(), tmp, res = PolyZero(), pw = PolyFromCoeff(1);
+    const Poly *xv = v < count ? &x[v] : &zero;
+    poly_exp_t prev = 0;
+    for (Mono *m = p->first; m != NULL && !Stopped(); m = m->next) {
+        Poly step = PolyPowTruncRec(xv, m->exp - prev, cap);
+        tmp = PolyMulTruncRec(&pw, &step, cap, 0, budget);
+        PolyDestroy(&pw);
+        PolyDestroy(&step);
+        pw = tmp;
+        prev = m->exp;
+        if (PolyIsZero(&pw))
+            break;
+        Poly inner = PolyComposeTruncRec(&m->p, v + 1, count, x, cap);
+        Poly term = PolyMulTruncRec(&pw, &inner, cap, 0, budget);
+        tmp = PolyAdd(&res, &term);
+        PolyDestroy(&inner);
+        PolyDestroy(&term);
+        PolyDestroy(&res);
+        res = tmp;
+    }
+    PolyDestroy(&pw);
+    return res;
+}
+
+Poly PolyTrunc(const Poly *p, const PolyDegCap *cap){
+    return MemCheck(PolyTruncRec(p, cap, 0, TruncBudget(cap)));
+}
+
+Poly PolyMulTrunc(const Poly *p, const Poly *q, const PolyDegCap *cap){
+    if (PolyIsCoeff(p) && PolyIsCoeff(q))
+        return PolyMulTruncRec(p, q, cap, 0, TruncBudget(cap));
+    PolyTraceBegin("PolyMulTrunc");
+    Poly res = PolyMulTruncRec(p, q, cap, 0, TruncBudget(cap));
+    PolyTraceEnd("PolyMulTrunc");
+    return MemCheck(res);
+}
+
+Poly PolyPowTrunc(const Poly *p, poly_exp_t exp, const PolyDegCap *cap){
+    assert(exp >= 0);
+    PolyTraceBegin("PolyPowTrunc");
+    Poly res = PolyPowTruncRec(p, exp, cap);
+    PolyTraceEnd("PolyPowTrunc");
+    return MemCheck(res);
+}
+
+Poly PolyComposeTrunc(const Poly *p, unsigned count, const Poly x[],
+        const PolyDegCap *cap){
+    PolyTraceBegin("PolyComposeTrunc");
+    Poly res = PolyComposeTruncRec(p, 0, count, x, cap);
+    PolyTraceEnd("PolyComposeTrunc");
+    return MemCheck(res);
+}
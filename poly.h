@@ -11,6 +11,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdatomic.h>
 #include <assert.h>
 
 /** Typ współczynników wielomianu */
@@ -106,6 +107,188 @@ static inline void MonoDestroy(Mono *m) {
     PolyDestroy(&m->p);
 }
 
+/**
+ * Zwalnia pamięć jednomianów zachowanych przez bieżący wątek
+ * do ponownego użycia.
+ */
+void PolyReleaseCache();
+
+/**
+ * Przydziela jednomian listy wielomianu. Wszystkie jednomiany list
+ * (także tworzonych poza poly.c) muszą pochodzić z tej funkcji,
+ * bo są zwalniane przez PolyDestroy i wliczane do statystyk pamięci.
+ * @return jednomian z zerowym współczynnikiem i wykładnikiem
+ */
+Mono *MonoAlloc();
+
+/**
+ * Zwalnia jednomian przydzielony przez MonoAlloc (bez jego współczynnika).
+ * @param[in] m : jednomian
+ */
+void MonoFree(Mono *m);
+
+/**
+ * Kopiuje wielomian do jednego bloku pamięci, w którym jednomiany leżą
+ * w porządku przechodzenia drzewa w głąb, więc odczyt wielomianu
+ * przebiega po pamięci sekwencyjnie. Kopia jest tylko do odczytu: nie
+ * wolno jej przekazywać PolyDestroy ani funkcjom przejmującym jej
+ * jednomiany; zwalnia ją PolyCompactFree. Blok jest wliczany do
+ * statystyk i limitu pamięci jednomianów; jeśli przekroczyłby limit,
+ * funkcja zwraca wielomian zerowy i ustawia błąd PolyMemFailed.
+ * @param[in] p : wielomian
+ * @return zwarta kopia wielomianu
+ */
+Poly PolyCompact(const Poly *p);
+
+/**
+ * Zwalnia naraz wielomian utworzony przez PolyCompact.
+ * @param[in] p : zwarty wielomian
+ */
+void PolyCompactFree(Poly *p);
+
+/**
+ * Statystyki pamięci zajmowanej przez jednomiany wszystkich wielomianów.
+ * Liczniki są aktualizowane przez wątki paczkami, więc mogą się różnić
+ * od dokładnej wartości o kilkaset jednomianów na wątek.
+ */
+typedef struct PolyMemStats {
+    size_t liveMonos; ///< liczba używanych jednomianów
+    size_t liveBytes; ///< pamięć używanych jednomianów
+    size_t peakBytes; ///< największa wartość liveBytes
+    size_t budget; ///< limit pamięci (0 - brak limitu)
+} PolyMemStats;
+
+/**
+ * Zwraca pamięć zajmowaną przez jednomiany wielomianu.
+ * @param[in] p : wielomian
+ * @return liczba bajtów
+ */
+size_t PolyMemSize(const Poly *p);
+
+/**
+ * Zwraca liczbę niezerowych współczynników wielomianu po rozwinięciu
+ * go do sumy jednomianów wszystkich zmiennych.
+ * @param[in] p : wielomian
+ * @return liczba składników
+ */
+size_t PolyTermCount(const Poly *p);
+
+/**
+ * Zwraca liczbę zmiennych, od których zależy wielomian, tj. głębokość
+ * jego drzewa.
+ * @param[in] p : wielomian
+ * @return głębokość drzewa wielomianu
+ */
+unsigned PolyDepth(const Poly *p);
+
+/**
+ * Zwraca liczbę jednomianów przydzielonych dotąd przez bieżący wątek.
+ * @return liczba przydziałów
+ */
+unsigned long PolyMemAllocCount();
+
+/**
+ * Odczytuje statystyki pamięci.
+ * @param[out] stats : statystyki
+ */
+void PolyMemGetStats(PolyMemStats *stats);
+
+/**
+ * Ustawia szczytowe użycie pamięci na bieżące.
+ */
+void PolyMemResetPeak();
+
+/**
+ * Powody przerwania operacji.
+ */
+typedef enum PolyStop {
+    POLY_STOP_NONE, ///< operacja nie została przerwana
+    POLY_STOP_MEMORY, ///< przekroczono limit pamięci
+    POLY_STOP_DEADLINE, ///< minął termin ustawiony przez PolySetDeadline
+    POLY_STOP_INTERRUPT ///< ustawiono flagę przerwania lub funkcja postępu
+                        ///< zwróciła false
+} PolyStop;
+
+/**
+ * Funkcja postępu wołana co pewną liczbę kroków długich operacji.
+ * @param[in] arg : argument przekazany do PolySetProgress
+ * @param[in] steps : liczba kroków wykonanych dotąd przez wątek
+ * @return czy kontynuować operację
+ */
+typedef bool (*PolyProgress)(void *arg, unsigned long steps);
+
+/**
+ * Ustawia limit pamięci jednomianów wszystkich wielomianów albo,
+ * w wątkach z ustawionym PolySetMemAccount, każdej sesji z osobna.
+ * Operacja, w trakcie której limit zostanie przekroczony, przerywa
+ * obliczenia, zwalnia częściowe wyniki, zwraca wielomian zerowy
+ * i ustawia błąd odczytywany przez PolyMemFailed.
+ * @param[in] bytes : limit w bajtach (0 - brak limitu)
+ */
+void PolyMemSetBudget(size_t bytes);
+
+/**
+ * Ustawia licznik jednomianów sesji, do której należą operacje bieżącego
+ * wątku. Jeśli jest ustawiony, limit z PolyMemSetBudget dotyczy tylko
+ * jednomianów przydzielonych i zwolnionych w ramach sesji, więc sesje
+ * wykonywane równolegle w różnych wątkach nie wyczerpują go sobie nawzajem.
+ * @param[in] account : licznik (początkowo 0) lub NULL - limit dotyczy
+ * wszystkich wielomianów
+ */
+void PolySetMemAccount(atomic_long *account);
+
+/**
+ * Sprawdza, czy od ostatniego PolyMemClearError w bieżącym wątku
+ * któraś operacja została przerwana: przekroczyła limit pamięci,
+ * minął jej termin lub ją przerwano. Błąd jest trwały: dopóki nie
+ * zostanie skasowany, wszystkie operacje zwracają wielomian zerowy.
+ * Argumenty przerwanej operacji pozostają nienaruszone.
+ * @return czy wystąpił błąd
+ */
+bool PolyMemFailed();
+
+/**
+ * Kasuje błąd przerwania operacji w bieżącym wątku.
+ */
+void PolyMemClearError();
+
+/**
+ * Zwraca powód błędu odczytywanego przez PolyMemFailed.
+ * @return powód przerwania
+ */
+PolyStop PolyStopReason();
+
+/**
+ * Ustawia termin operacji bieżącego wątku. Pętle długich operacji
+ * (PolyStep) sprawdzają go co pewną liczbę kroków i po jego upływie
+ * przerywają obliczenia jak przy przekroczeniu limitu pamięci.
+ * @param[in] ns : czas monotoniczny w nanosekundach, jak w PolyTraceNow
+ * (0 - brak terminu)
+ */
+void PolySetDeadline(long ns);
+
+/**
+ * Ustawia flagę, której ustawienie (np. przez obsługę sygnału lub inny
+ * wątek) przerywa operacje bieżącego wątku.
+ * @param[in] flag : flaga lub NULL
+ */
+void PolySetInterrupt(const atomic_bool *flag);
+
+/**
+ * Liczy krok długiej operacji bieżącego wątku i co pewną liczbę kroków
+ * sprawdza termin, flagę przerwania i funkcję postępu, tak jak pętle
+ * operacji tej biblioteki.
+ * @return czy operacja została przerwana (PolyMemFailed)
+ */
+bool PolyStep();
+
+/**
+ * Ustawia funkcję postępu operacji bieżącego wątku.
+ * @param[in] fn : funkcja lub NULL
+ * @param[in] arg : argument funkcji
+ */
+void PolySetProgress(PolyProgress fn, void *arg);
+
 /**
  * Robi pełną, głęboką kopię wielomianu.
  * @param[in] p : wielomian
@@ -213,4 +396,66 @@ Poly PolyAt(const Poly *p, poly_coeff_t x);
  */
 Poly PolyCompose(const Poly *p, unsigned count, const Poly x[]);
 
+/**
+ * Przesuwa wielomian wzdłuż zmiennej głównej, tj. wylicza
+ * @f$p(x_0 + a, x_1, x_2, \ldots)@f$.
+ * Działa schematem Hornera w O(n^2) operacji na współczynnikach,
+ * gdzie n to stopień wielomianu względem zmiennej głównej.
+ * @param[in] p : zadany wielomian
+ * @param[in] a : przesunięcie
+ * @return @f$p(x_0 + a, x_1, x_2, \ldots)@f$
+ */
+Poly PolyShift(const Poly *p, poly_coeff_t a);
+
+/**
+ * Ograniczenie stopni wyniku w obliczeniach obciętych. Jednomian wyniku
+ * jest zachowywany, jeśli jego stopień całkowity nie przekracza
+ * @p total, a wykładnik każdej zmiennej @f$x_i@f$, i < @p count,
+ * nie przekracza vars[i].
+ */
+typedef struct PolyDegCap {
+    poly_exp_t total; ///< największy stopień całkowity (ujemny - dowolny)
+    unsigned count; ///< liczba zmiennych o ograniczonym wykładniku
+    const poly_exp_t *vars; ///< największe wykładniki zmiennych
+} PolyDegCap;
+
+/**
+ * Usuwa z wielomianu jednomiany przekraczające ograniczenie stopni.
+ * @param[in] p : wielomian
+ * @param[in] cap : ograniczenie stopni
+ * @return obcięty wielomian
+ */
+Poly PolyTrunc(const Poly *p, const PolyDegCap *cap);
+
+/**
+ * Mnoży wielomiany, wyliczając tylko jednomiany spełniające ograniczenie
+ * stopni. Pary jednomianów, których iloczyn przekracza ograniczenie,
+ * nie są odwiedzane.
+ * @param[in] p : wielomian
+ * @param[in] q : wielomian
+ * @param[in] cap : ograniczenie stopni
+ * @return obcięty iloczyn `p * q`
+ */
+Poly PolyMulTrunc(const Poly *p, const Poly *q, const PolyDegCap *cap);
+
+/**
+ * Podnosi wielomian do potęgi, obcinając wyniki pośrednie.
+ * @param[in] p : podstawa
+ * @param[in] exp : nieujemny wykładnik
+ * @param[in] cap : ograniczenie stopni
+ * @return obcięta potęga `p^exp`
+ */
+Poly PolyPowTrunc(const Poly *p, poly_exp_t exp, const PolyDegCap *cap);
+
+/**
+ * Wylicza PolyCompose z obcięciem wyniku do ograniczenia stopni.
+ * @param[in] p : zadany wielomian
+ * @param[in] count : liczba wielomianów w tablicy
+ * @param[in] x : tablica wstawianych wielomianów
+ * @param[in] cap : ograniczenie stopni
+ * @return obcięte złożenie
+ */
+Poly PolyComposeTrunc(const Poly *p, unsigned count, const Poly x[],
+                      const PolyDegCap *cap);
+
 #endif /* __POLY_H__ */
@@ -0,0 +1,543 @@
+/** @file
+   Testy wydajności biblioteki wielomianów i kalkulatora
+
+   Każdy test jest wykonywany na danych wygenerowanych ze stałego ziarna,
+   więc kolejne uruchomienia z tymi samymi parametrami mierzą to samo.
+   Dla każdego testu zapisywany jest czas (minimum, mediana, średnia),
+   liczba i rozmiar alokacji na wykonanie, szczytowa ilość zajętej pamięci
+   sterty oraz szczytowe RSS procesu. Wyniki są wypisywane w formacie JSON.
+
+   Program jest linkowany z calc_poly.c skompilowanym z
+   -Dmain=calculator_main (tak jak testy jednostkowe).
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "poly.h"
+#include "poly_builder.h"
+#include "calc_poly.h"
+
+/** Domyślne ziarno generatora */
+#define BENCH_SEED 20170615
+
+/** Domyślna liczba powtórzeń każdego testu */
+#define BENCH_REPEAT 10
+
+/** Maksymalna liczba zmiennych */
+#define BENCH_MAX_VARS 16
+
+/** Gęstość wykładników w teście mnożenia gęstych wielomianów */
+#define BENCH_DENSE 1.0
+
+/** Liczba wierszy skryptu kalkulatora */
+#define BENCH_SCRIPT_LINES 2000
+
+/** Szacowana liczba składników, powyżej której skrypt nie używa MUL */
+#define BENCH_SCRIPT_MAX_TERMS 4096
+
+/**
+ * Liczniki alokacji. Funkcje malloc, calloc, realloc i free są
+ * przesłonięte poniżej, więc liczone są wszystkie alokacje procesu.
+ */
+static struct {
+    atomic_ullong count; ///< liczba alokacji
+    atomic_ullong bytes; ///< łączny rozmiar alokacji
+    atomic_llong live; ///< rozmiar zajętej pamięci
+    atomic_llong peak; ///< szczytowy rozmiar zajętej pamięci
+} allocStats;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+/**
+ * Odnotowuje zmianę zajętej pamięci.
+ * @param[in] ptr : przydzielony blok lub NULL
+ * @param[in] sign : 1 dla przydziału, -1 dla zwolnienia
+ */
+static void AllocNote(void *ptr, int sign) {
+    if (ptr == NULL)
+        return;
+    long long size = (long long) malloc_usable_size(ptr);
+    if (sign > 0) {
+        atomic_fetch_add_explicit(&allocStats.count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&allocStats.bytes, size,
+                                  memory_order_relaxed);
+    }
+    long long live = atomic_fetch_add_explicit(&allocStats.live, sign * size,
+                                               memory_order_relaxed)
+                     + sign * size;
+    long long peak = atomic_load_explicit(&allocStats.peak,
+                                          memory_order_relaxed);
+    while (live > peak
+           && !atomic_compare_exchange_weak_explicit(&allocStats.peak, &peak,
+                                                     live,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed));
+}
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    AllocNote(ptr, 1);
+    return ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+    void *ptr = __libc_calloc(count, size);
+    AllocNote(ptr, 1);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+    AllocNote(ptr, -1);
+    void *res = __libc_realloc(ptr, size);
+    AllocNote(res != NULL ? res : (size == 0 ? NULL : ptr), 1);
+    return res;
+}
+
+void free(void *ptr) {
+    AllocNote(ptr, -1);
+    __libc_free(ptr);
+}
+#endif /* __GLIBC__ */
+
+/**
+ * Parametry generowanych danych.
+ */
+typedef struct BenchParams {
+    unsigned vars; ///< liczba zmiennych
+    unsigned terms; ///< liczba składników wielomianu
+    unsigned degree; ///< maksymalny wykładnik przy gęstości 1
+    double density; ///< gęstość wykładników z przedziału (0, 1]
+    uint64_t seed; ///< ziarno generatora
+    unsigned repeat; ///< liczba powtórzeń testu
+} BenchParams;
+
+/**
+ * Stan testu: dane wejściowe i wynik ostatniego wykonania.
+ */
+typedef struct BenchCtx {
+    const BenchParams *par; ///< parametry
+    uint64_t rng; ///< stan generatora liczb losowych
+    Poly a; ///< pierwszy argument
+    Poly b; ///< drugi argument
+    Poly res; ///< wynik
+    Poly *args; ///< argumenty PolyCompose
+    unsigned count; ///< liczba argumentów PolyCompose
+    char *script; ///< skrypt kalkulatora
+    size_t scriptLen; ///< długość skryptu
+    FILE *devNull; ///< wyjście kalkulatora
+} BenchCtx;
+
+/**
+ * Opis testu.
+ */
+typedef struct Bench {
+    const char *name; ///< nazwa testu
+    void (*setup)(BenchCtx *ctx); ///< przygotowuje dane (bez pomiaru)
+    void (*run)(BenchCtx *ctx); ///< mierzona operacja
+    void (*clear)(BenchCtx *ctx); ///< sprząta po wykonaniu (bez pomiaru)
+} Bench;
+
+/**
+ * Generator xorshift64*, niezależny od implementacji rand().
+ * @param[in,out] state : stan generatora
+ * @return kolejna liczba losowa
+ */
+static uint64_t Rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Zwraca liczbę losową z przedziału [0, n).
+ * @param[in,out] state : stan generatora
+ * @param[in] n : górna granica
+ * @return liczba losowa
+ */
+static unsigned RandBelow(uint64_t *state, unsigned n) {
+    return n == 0 ? 0 : (unsigned) (Rand(state) % n);
+}
+
+/**
+ * Tworzy losowy wielomian. Wykładniki każdej zmiennej są losowane
+ * z przedziału [0, (degree + 1) / density), więc przy gęstości 1
+ * składniki często się pokrywają, a przy małej gęstości są rozproszone.
+ * @param[in,out] rng : stan generatora
+ * @param[in] vars : liczba zmiennych
+ * @param[in] terms : liczba składników
+ * @param[in] degree : maksymalny wykładnik przy gęstości 1
+ * @param[in] density : gęstość
+ * @return wielomian
+ */
+static Poly RandomPoly(uint64_t *rng, unsigned vars, unsigned terms,
+                       unsigned degree, double density) {
+    PolyBuilder b;
+    poly_exp_t exps[BENCH_MAX_VARS];
+    unsigned span = (unsigned) ((degree + 1) / density);
+    PolyBuilderInit(&b, vars);
+    PolyBuilderReserve(&b, terms);
+    for (unsigned i = 0; i < terms; i++) {
+        for (unsigned v = 0; v < vars; v++)
+            exps[v] = RandBelow(rng, span > 0 ? span : 1);
+        PolyBuilderAdd(&b, (poly_coeff_t) RandBelow(rng, 2001) - 1000, exps);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    PolyBuilderDestroy(&b);
+    return p;
+}
+
+/**
+ * Tworzy losowy wielomian o parametrach testu.
+ * @param[in] ctx : stan testu
+ * @return wielomian
+ */
+static Poly ParamPoly(BenchCtx *ctx) {
+    const BenchParams *par = ctx->par;
+    return RandomPoly(&ctx->rng, par->vars, par->terms, par->degree,
+                      par->density);
+}
+
+/**
+ * Dopisuje tekst do skryptu.
+ * @param[in] ctx : stan testu
+ * @param[in] s : tekst
+ * @param[in] len : długość tekstu
+ */
+static void ScriptAppend(BenchCtx *ctx, const char *s, size_t len) {
+    ctx->script = realloc(ctx->script, ctx->scriptLen + len + 1);
+    assert(ctx->script != NULL);
+    memcpy(ctx->script + ctx->scriptLen, s, len);
+    ctx->scriptLen += len;
+    ctx->script[ctx->scriptLen] = '\0';
+}
+
+/**
+ * Dopisuje wielomian do skryptu w formacie wejściowym kalkulatora.
+ * @param[in] ctx : stan testu
+ * @param[in] p : wielomian
+ */
+static void ScriptAppendPoly(BenchCtx *ctx, const Poly *p) {
+    char buf[32];
+    if (PolyIsCoeff(p)) {
+        ScriptAppend(ctx, buf, sprintf(buf, "%ld", p->coeff));
+        return;
+    }
+    for (Mono *m = p->first; m != NULL; m = m->next) {
+        if (m != p->first)
+            ScriptAppend(ctx, "+", 1);
+        ScriptAppend(ctx, "(", 1);
+        ScriptAppendPoly(ctx, &m->p);
+        ScriptAppend(ctx, buf, sprintf(buf, ",%d)", m->exp));
+    }
+}
+
+static void SetupAdd(BenchCtx *ctx) {
+    ctx->a = ParamPoly(ctx);
+    ctx->b = ParamPoly(ctx);
+}
+
+static void RunAdd(BenchCtx *ctx) {
+    ctx->res = PolyAdd(&ctx->a, &ctx->b);
+}
+
+static void RunMul(BenchCtx *ctx) {
+    ctx->res = PolyMul(&ctx->a, &ctx->b);
+}
+
+static void SetupMulDense(BenchCtx *ctx) {
+    const BenchParams *par = ctx->par;
+    ctx->a = RandomPoly(&ctx->rng, par->vars, par->terms, par->degree,
+                        BENCH_DENSE);
+    ctx->b = RandomPoly(&ctx->rng, par->vars, par->terms, par->degree,
+                        BENCH_DENSE);
+}
+
+static void SetupOne(BenchCtx *ctx) {
+    ctx->a = ParamPoly(ctx);
+}
+
+static void RunAt(BenchCtx *ctx) {
+    ctx->res = PolyAt(&ctx->a, 3);
+}
+
+static void SetupCompose(BenchCtx *ctx) {
+    const BenchParams *par = ctx->par;
+    unsigned degree = par->degree < 4 ? par->degree : 4;
+    ctx->a = RandomPoly(&ctx->rng, par->vars, par->terms / 4 + 1, degree,
+                        BENCH_DENSE);
+    ctx->count = par->vars;
+    ctx->args = malloc((ctx->count > 0 ? ctx->count : 1) * sizeof(Poly));
+    assert(ctx->args != NULL);
+    for (unsigned i = 0; i < ctx->count; i++)
+        ctx->args[i] = RandomPoly(&ctx->rng, par->vars, 4, 2, BENCH_DENSE);
+}
+
+static void RunCompose(BenchCtx *ctx) {
+    ctx->res = PolyCompose(&ctx->a, ctx->count, ctx->args);
+}
+
+static void SetupIsEq(BenchCtx *ctx) {
+    ctx->a = ParamPoly(ctx);
+    ctx->b = PolyClone(&ctx->a);
+}
+
+static void RunIsEq(BenchCtx *ctx) {
+    ctx->res = PolyFromCoeff(PolyIsEq(&ctx->a, &ctx->b));
+}
+
+static void RunCloneDestroy(BenchCtx *ctx) {
+    Poly p = PolyClone(&ctx->a);
+    PolyDestroy(&p);
+}
+
+/**
+ * Generuje skrypt kalkulatora: wielomiany przeplatane poleceniami,
+ * tak by stos nigdy nie był pusty. Generator śledzi szacowaną liczbę
+ * składników wielomianów na stosie i zamienia MUL na ADD, gdy iloczyn
+ * przekroczyłby BENCH_SCRIPT_MAX_TERMS, więc koszt skryptu nie rośnie
+ * wykładniczo.
+ */
+static void SetupScript(BenchCtx *ctx) {
+    static const char *unary[] = {"CLONE\n", "NEG\n", "AT 2\n", "DEG\n",
+                                  "IS_ZERO\n", "PRINT\n"};
+    static const char *binary[] = {"ADD\n", "SUB\n", "MUL\n", "IS_EQ\n"};
+    const BenchParams *par = ctx->par;
+    unsigned terms = par->terms / 8 + 1;
+    size_t *est = malloc(BENCH_SCRIPT_LINES * sizeof(size_t)), depth = 0;
+    assert(est != NULL);
+    for (unsigned i = 0; i < BENCH_SCRIPT_LINES; i++) {
+        unsigned kind = RandBelow(&ctx->rng, 4);
+        if (depth < 2 || kind == 0) {
+            Poly p = RandomPoly(&ctx->rng, par->vars, terms, par->degree,
+                                par->density);
+            ScriptAppendPoly(ctx, &p);
+            ScriptAppend(ctx, "\n", 1);
+            PolyDestroy(&p);
+            est[depth++] = terms;
+        }
+        else if (kind == 1) {
+            const char *cmd = binary[RandBelow(&ctx->rng, 4)];
+            size_t a = est[depth - 1], b = est[depth - 2];
+            if (cmd == binary[2] && a * b > BENCH_SCRIPT_MAX_TERMS)
+                cmd = binary[0];
+            ScriptAppend(ctx, cmd, strlen(cmd));
+            if (cmd == binary[2])
+                est[--depth - 1] = a * b;
+            else if (cmd != binary[3])
+                est[--depth - 1] = a + b;
+        }
+        else if (kind == 2 && depth > 8) {
+            ScriptAppend(ctx, "POP\n", 4);
+            depth--;
+        }
+        else {
+            const char *cmd = unary[RandBelow(&ctx->rng, 6)];
+            ScriptAppend(ctx, cmd, strlen(cmd));
+            if (cmd == unary[0]) {
+                est[depth] = est[depth - 1];
+                depth++;
+            }
+        }
+    }
+    free(est);
+    ctx->devNull = fopen("/dev/null", "w");
+    assert(ctx->devNull != NULL);
+}
+
+static void RunScript(BenchCtx *ctx) {
+    FILE *in = fmemopen(ctx->script, ctx->scriptLen, "r");
+    assert(in != NULL);
+    PolyStack *s = Init();
+    Read(s, in, ctx->devNull, ctx->devNull);
+    CleanStack(s);
+    fclose(in);
+}
+
+/**
+ * Zwalnia wynik ostatniego wykonania.
+ */
+static void ClearResult(BenchCtx *ctx) {
+    PolyDestroy(&ctx->res);
+    ctx->res = PolyZero();
+}
+
+/** Wszystkie testy */
+static const Bench benches[] = {
+    {"add", SetupAdd, RunAdd, ClearResult},
+    {"mul_sparse", SetupAdd, RunMul, ClearResult},
+    {"mul_dense", SetupMulDense, RunMul, ClearResult},
+    {"at", SetupOne, RunAt, ClearResult},
+    {"compose", SetupCompose, RunCompose, ClearResult},
+    {"is_eq", SetupIsEq, RunIsEq, ClearResult},
+    {"clone_destroy", SetupOne, RunCloneDestroy, ClearResult},
+    {"calc_script", SetupScript, RunScript, ClearResult},
+};
+
+/**
+ * Zwalnia dane testu.
+ */
+static void Teardown(BenchCtx *ctx) {
+    PolyDestroy(&ctx->a);
+    PolyDestroy(&ctx->b);
+    for (unsigned i = 0; i < ctx->count; i++)
+        PolyDestroy(&ctx->args[i]);
+    free(ctx->args);
+    free(ctx->script);
+    if (ctx->devNull != NULL)
+        fclose(ctx->devNull);
+}
+
+/**
+ * Zwraca bieżący czas monotoniczny.
+ * @return czas w nanosekundach
+ */
+static uint64_t NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int CmpU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Wykonuje test i wypisuje jego wyniki jako obiekt JSON.
+ * @param[in] bench : test
+ * @param[in] par : parametry
+ * @param[in] out : wyjście
+ * @param[in] first : czy to pierwszy wypisywany test
+ */
+static void RunBench(const Bench *bench, const BenchParams *par, FILE *out,
+                     bool first) {
+    BenchCtx ctx = {.par = par, .rng = par->seed, .a = PolyZero(),
+                    .b = PolyZero(), .res = PolyZero()};
+    uint64_t *times = malloc(par->repeat * sizeof(uint64_t));
+    unsigned long long allocs = 0, bytes = 0;
+    long long peak = 0;
+    uint64_t total = 0;
+    struct rusage ru;
+    assert(times != NULL);
+    for (const char *c = bench->name; *c != '\0'; c++)
+        ctx.rng = ctx.rng * 31 + (unsigned char) *c;
+    bench->setup(&ctx);
+    for (unsigned r = 0; r < par->repeat; r++) {
+        unsigned long long count0 = atomic_load(&allocStats.count);
+        unsigned long long bytes0 = atomic_load(&allocStats.bytes);
+        long long live0 = atomic_load(&allocStats.live);
+        atomic_store(&allocStats.peak, live0);
+        uint64_t t0 = NowNs();
+        bench->run(&ctx);
+        times[r] = NowNs() - t0;
+        total += times[r];
+        allocs += atomic_load(&allocStats.count) - count0;
+        bytes += atomic_load(&allocStats.bytes) - bytes0;
+        if (atomic_load(&allocStats.peak) - live0 > peak)
+            peak = atomic_load(&allocStats.peak) - live0;
+        bench->clear(&ctx);
+        PolyReleaseCache();
+    }
+    Teardown(&ctx);
+    qsort(times, par->repeat, sizeof(uint64_t), CmpU64);
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(out, "%s    {\"name\": \"%s\", \"iterations\": %u, "
+            "\"wall_ns_min\": %llu, \"wall_ns_median\": %llu, "
+            "\"wall_ns_mean\": %llu, \"allocs_per_iter\": %llu, "
+            "\"alloc_bytes_per_iter\": %llu, \"peak_heap_bytes\": %lld, "
+            "\"peak_rss_kb\": %ld}",
+            first ? "" : ",\n", bench->name, par->repeat,
+            (unsigned long long) times[0],
+            (unsigned long long) times[par->repeat / 2],
+            (unsigned long long) (total / par->repeat),
+            allocs / par->repeat, bytes / par->repeat, peak, ru.ru_maxrss);
+    free(times);
+}
+
+int main(int argc, char *argv[]) {
+    BenchParams par = {.vars = 3, .terms = 200, .degree = 8, .density = 0.1,
+                       .seed = BENCH_SEED, .repeat = BENCH_REPEAT};
+    const char *filter = NULL, *outName = NULL;
+    bool first = true;
+    int opt;
+    while ((opt = getopt(argc, argv, "v:t:d:D:s:n:f:o:")) != -1) {
+        switch (opt) {
+            case 'v':
+                par.vars = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                par.terms = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                par.degree = strtoul(optarg, NULL, 10);
+                break;
+            case 'D':
+                par.density = strtod(optarg, NULL);
+                break;
+            case 's':
+                par.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'n':
+                par.repeat = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'o':
+                outName = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-v vars] [-t terms] [-d degree] "
+                        "[-D density] [-s seed] [-n repeat] [-f filter] "
+                        "[-o out.json]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (par.vars > BENCH_MAX_VARS || par.density <= 0 || par.density > 1
+        || par.repeat == 0 || par.seed == 0) {
+        fprintf(stderr, "invalid parameters\n");
+        return 1;
+    }
+    FILE *out = outName != NULL ? fopen(outName, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot write %s\n", outName);
+        return 1;
+    }
+    fprintf(out, "{\n  \"params\": {\"vars\": %u, \"terms\": %u, "
+            "\"degree\": %u, \"density\": %g, \"seed\": %llu, "
+            "\"repeat\": %u},\n  \"benchmarks\": [\n",
+            par.vars, par.terms, par.degree, par.density,
+            (unsigned long long) par.seed, par.repeat);
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (filter != NULL && strstr(benches[i].name, filter) == NULL)
+            continue;
+        RunBench(&benches[i], &par, out, first);
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,391 @@
+/** @file
+   Implementacja budowania wielomianów z nieuporządkowanych składników
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include "poly_builder.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Początkowa liczba miejsc na składniki */
+#define BUILDER_INIT_SIZE 64
+
+/** Liczba bitów cyfry sortowania pozycyjnego */
+#define RADIX_BITS 8
+
+/** Liczba kubełków sortowania pozycyjnego */
+#define RADIX (1 << RADIX_BITS)
+
+void PolyBuilderInit(PolyBuilder *b, unsigned nvars){
+    b->nvars = nvars;
+    b->count = b->size = 0;
+    b->coeffs = NULL;
+    b->exps = NULL;
+}
+
+void PolyBuilderReserve(PolyBuilder *b, size_t count){
+    if (count <= b->size)
+        return;
+    b->coeffs = realloc(b->coeffs, count * sizeof(poly_coeff_t));
+    assert(b->coeffs != NULL);
+    if (b->nvars > 0) {
+        b->exps = realloc(b->exps, count * b->nvars * sizeof(poly_exp_t));
+        assert(b->exps != NULL);
+    }
+    b->size = count;
+}
+
+void PolyBuilderAdd(PolyBuilder *b, poly_coeff_t coeff,
+                    const poly_exp_t exps[]){
+    if (b->count == b->size)
+        PolyBuilderReserve(b, b->size > 0 ? 2 * b->size : BUILDER_INIT_SIZE);
+    b->coeffs[b->count] = coeff;
+    for (unsigned i = 0; i < b->nvars; i++) {
+        assert(exps[i] >= 0);
+        b->exps[b->count * b->nvars + i] = exps[i];
+    }
+    b->count++;
+}
+
+/**
+ * Sprawdza, czy zebrane składniki są już uporządkowane, jak wtedy, gdy
+ * pochodzą z odbiorcy PolyTermFn.
+ * @param[in] b : budowniczy
+ * @return czy wykładniki kolejnych składników nie maleją
+ */
+static bool IsSorted(const PolyBuilder *b){
+    for (size_t i = 1; i < b->count; i++) {
+        const poly_exp_t *x = b->exps + (i - 1) * b->nvars;
+        const poly_exp_t *y = x + b->nvars;
+        unsigned v = 0;
+        while (v < b->nvars && x[v] == y[v])
+            v++;
+        if (v < b->nvars && x[v] > y[v])
+            return false;
+    }
+    return true;
+}
+
+size_t *PolyBuilderSort(const PolyBuilder *b){
+    size_t n = b->count, *idx, *tmp, *swap;
+    size_t hist[RADIX];
+    idx = malloc(n * sizeof(size_t));
+    tmp = malloc(n * sizeof(size_t));
+    assert(idx != NULL && tmp != NULL);
+    for (size_t i = 0; i < n; i++)
+        idx[i] = i;
+    if (IsSorted(b)) {
+        free(tmp);
+        return idx;
+    }
+    for (unsigned v = b->nvars; v-- > 0;) {
+        for (unsigned shift = 0; shift < 8 * sizeof(poly_exp_t);
+             shift += RADIX_BITS) {
+            memset(hist, 0, sizeof(hist));
+            for (size_t i = 0; i < n; i++)
+                hist[(b->exps[i * b->nvars + v] >> shift) & (RADIX - 1)]++;
+            if (hist[(b->exps[v] >> shift) & (RADIX - 1)] == n)
+                continue;
+            for (size_t d = 0, sum = 0; d < RADIX; d++) {
+                size_t h = hist[d];
+                hist[d] = sum;
+                sum += h;
+            }
+            for (size_t i = 0; i < n; i++) {
+                poly_exp_t e = b->exps[idx[i] * b->nvars + v];
+                tmp[hist[(e >> shift) & (RADIX - 1)]++] = idx[i];
+            }
+            swap = idx, idx = tmp, tmp = swap;
+        }
+    }
+    free(tmp);
+    return idx;
+}
+
+/**
+ * Tworzy wielomian nad zmienną @f$x_v@f$ z posortowanych składników
+ * o indeksach @p idx[lo..hi), których wykładniki przy @f$x_0, \ldots,
+ * x_{v-1}@f$ są równe.
+ * @param[in] b : budowniczy
+ * @param[in] idx : posortowane indeksy składników
+ * @param[in] lo : początek przedziału
+ * @param[in] hi : koniec przedziału
+ * @param[in] v : numer zmiennej
+ * @return wielomian
+ */
+static Poly BuildLevel(const PolyBuilder *b, const size_t *idx,
+                       size_t lo, size_t hi, unsigned v){
+    if (v == b->nvars) {
+        unsigned long sum = 0;
+        for (size_t i = lo; i < hi; i++)
+            sum += (unsigned long) b->coeffs[idx[i]];
+        return PolyFromCoeff((poly_coeff_t) sum);
+    }
+    Mono *first = NULL, *last = NULL;
+    size_t i = lo;
+    while (i < hi && !PolyStep()) {
+        poly_exp_t e = b->exps[idx[i] * b->nvars + v];
+        size_t j = i + 1;
+        while (j < hi && b->exps[idx[j] * b->nvars + v] == e)
+            j++;
+        Poly coeff = BuildLevel(b, idx, i, j, v + 1);
+        i = j;
+        if (PolyIsZero(&coeff))
+            continue;
+        Mono *new = MonoAlloc();
+        *new = MonoFromPoly(&coeff, e);
+        if (last == NULL)
+            first = new;
+        else
+            last->next = new;
+        last = new;
+    }
+    if (first == NULL)
+        return PolyZero();
+    if (first->next == NULL && first->exp == 0 && PolyIsCoeff(&first->p)) {
+        Poly res = first->p;
+        MonoFree(first);
+        return res;
+    }
+    return (Poly) {.coeff = 0, .first = first};
+}
+
+Poly PolyBuilderBuild(PolyBuilder *b){
+    if (b->count == 0)
+        return PolyZero();
+    size_t *idx = PolyBuilderSort(b);
+    Poly res = BuildLevel(b, idx, 0, b->count, 0);
+    free(idx);
+    b->count = 0;
+    if (PolyMemFailed()) {
+        PolyDestroy(&res);
+        return PolyZero();
+    }
+    return res;
+}
+
+void PolyBuilderDestroy(PolyBuilder *b){
+    free(b->coeffs);
+    free(b->exps);
+    PolyBuilderInit(b, b->nvars);
+}
+
+/**
+ * Dodaje do budowniczego składniki wielomianu nad zmiennymi
+ * @f$x_v, x_{v+1}, \ldots@f$.
+ * @param[in] p : wielomian
+ * @param[in] v : numer zmiennej
+ * @param[in] exps : wykładniki przy @f$x_0, \ldots, x_{v-1}@f$
+ * @param[in] b : budowniczy
+ */
+static void Flatten(const Poly *p, unsigned v, poly_exp_t *exps,
+                    PolyBuilder *b){
+    if (PolyIsCoeff(p)) {
+        if (PolyIsZero(p))
+            return ;
+        for (unsigned i = v; i < b->nvars; i++)
+            exps[i] = 0;
+        PolyBuilderAdd(b, p->coeff, exps);
+        return ;
+    }
+    for (Mono *m = p->first; m != NULL; m = m->next) {
+        assert(v < b->nvars);
+        exps[v] = m->exp;
+        Flatten(&m->p, v + 1, exps, b);
+    }
+}
+
+void PolyBuilderAddPoly(PolyBuilder *b, const Poly *p){
+    poly_exp_t *exps = malloc((b->nvars > 0 ? b->nvars : 1)
+                              * sizeof(poly_exp_t));
+    assert(exps != NULL);
+    Flatten(p, 0, exps, b);
+    free(exps);
+}
+
+Poly PolyPermuteVars(const Poly *p, unsigned n, const unsigned perm[]){
+    if (PolyIsCoeff(p))
+        return *p;
+    unsigned nvars = PolyDepth(p);
+    if (n > nvars)
+        nvars = n;
+    PolyBuilder src, dst;
+    PolyBuilderInit(&src, nvars);
+    PolyBuilderInit(&dst, nvars);
+    PolyBuilderAddPoly(&src, p);
+    PolyBuilderReserve(&dst, src.count);
+    poly_exp_t *exps = malloc(nvars * sizeof(poly_exp_t));
+    assert(exps != NULL);
+    for (size_t t = 0; t < src.count && !PolyStep(); t++) {
+        for (unsigned i = 0; i < nvars; i++) {
+            assert(i >= n || perm[i] < n);
+            exps[i < n ? perm[i] : i] = src.exps[t * nvars + i];
+        }
+        PolyBuilderAdd(&dst, src.coeffs[t], exps);
+    }
+    Poly res = PolyBuilderBuild(&dst);
+    free(exps);
+    PolyBuilderDestroy(&src);
+    PolyBuilderDestroy(&dst);
+    return res;
+}
+
+/**
+ * Składnik przypisany do klasy prefiksu, rozróżniany wykładnikiem
+ * kolejnej zmiennej.
+ */
+typedef struct PrefixKey {
+    size_t group; ///< klasa prefiksu wykładników
+    poly_exp_t exp; ///< wykładnik kolejnej zmiennej
+    size_t term; ///< numer składnika
+} PrefixKey;
+
+/**
+ * Porównuje klucze najpierw po klasie, potem po wykładniku.
+ * @param[in] a : klucz
+ * @param[in] b : klucz
+ * @return wynik porównania dla qsort
+ */
+static int PrefixKeyCmp(const void *a, const void *b){
+    const PrefixKey *x = a, *y = b;
+    if (x->group != y->group)
+        return x->group < y->group ? -1 : 1;
+    return (x->exp > y->exp) - (x->exp < y->exp);
+}
+
+/**
+ * Zaznacza klasy prefiksów, których poddrzewa nie są stałymi, tj. mają
+ * składnik z niezerowym wykładnikiem zmiennej jeszcze nieustawionej.
+ * @param[in] b : budowniczy ze składnikami
+ * @param[in] group : klasy prefiksów składników
+ * @param[in] used : czy zmienna jest już ustawiona
+ * @param[out] live : czy klasa nie jest stałą
+ */
+static void MarkLive(const PolyBuilder *b, const size_t *group,
+                     const bool *used, bool *live){
+    memset(live, 0, b->count * sizeof(bool));
+    for (size_t t = 0; t < b->count; t++)
+        for (unsigned v = 0; v < b->nvars && !live[group[t]]; v++)
+            if (!used[v] && b->exps[t * b->nvars + v] != 0)
+                live[group[t]] = true;
+}
+
+/**
+ * Przedłuża prefiksy wykładników składników o zmienną @f$x_w@f$.
+ * @param[in] b : budowniczy ze składnikami
+ * @param[in] group : klasy prefiksów składników
+ * @param[in] live : czy klasa nie jest stałą
+ * @param[in] w : numer zmiennej
+ * @param[in] keys : bufor na b->count kluczy
+ * @param[out] next : klasy przedłużonych prefiksów lub NULL
+ * @return liczba jednomianów na poziomie zmiennej @f$x_w@f$
+ */
+static size_t ExtendPrefixes(const PolyBuilder *b, const size_t *group,
+                             const bool *live, unsigned w, PrefixKey *keys,
+                             size_t *next){
+    size_t classes = 0, monos = 0;
+    for (size_t t = 0; t < b->count; t++) {
+        PolyStep();
+        keys[t] = (PrefixKey) {.group = group[t],
+                               .exp = b->exps[t * b->nvars + w], .term = t};
+    }
+    qsort(keys, b->count, sizeof(PrefixKey), PrefixKeyCmp);
+    for (size_t t = 0; t < b->count; t++) {
+        if (t == 0 || PrefixKeyCmp(&keys[t - 1], &keys[t]) != 0) {
+            classes++;
+            monos += live[keys[t].group];
+        }
+        if (next != NULL)
+            next[keys[t].term] = classes - 1;
+    }
+    return monos;
+}
+
+/**
+ * Wylicza liczbę jednomianów drzew wielomianów w zadanej kolejności
+ * zmiennych, a jeśli kolejność nie jest ustalona, dobiera ją zachłannie.
+ * @param[in] b : budowniczy ze składnikami
+ * @param[in] owner : numer wielomianu każdego składnika (spośród
+ * wielomianów, które mają składniki)
+ * @param[in,out] order : zmienne od zewnętrznej
+ * @param[in] greedy : czy dobierać kolejność
+ * @return liczba jednomianów
+ */
+static size_t OrderNodes(const PolyBuilder *b, const size_t *owner,
+                         unsigned *order, bool greedy){
+    size_t *group = malloc(b->count * sizeof(size_t));
+    size_t *next = malloc(b->count * sizeof(size_t)), *swap;
+    PrefixKey *keys = malloc(b->count * sizeof(PrefixKey));
+    bool *live = malloc(b->count * sizeof(bool));
+    bool *used = calloc(b->nvars, sizeof(bool));
+    assert(group != NULL && next != NULL && keys != NULL);
+    assert(live != NULL && used != NULL);
+    memcpy(group, owner, b->count * sizeof(size_t));
+    size_t nodes = 0;
+    for (unsigned k = 0; k < b->nvars && !PolyMemFailed(); k++) {
+        size_t best = SIZE_MAX;
+        MarkLive(b, group, used, live);
+        for (unsigned w = 0; greedy && w < b->nvars && !PolyMemFailed(); w++) {
+            if (used[w])
+                continue;
+            size_t monos = ExtendPrefixes(b, group, live, w, keys, NULL);
+            if (monos < best) {
+                best = monos;
+                order[k] = w;
+            }
+        }
+        used[order[k]] = true;
+        nodes += ExtendPrefixes(b, group, live, order[k], keys, next);
+        swap = group, group = next, next = swap;
+    }
+    free(group), free(next), free(keys), free(live), free(used);
+    return nodes;
+}
+
+unsigned *PolyChooseVarOrder(unsigned count, const Poly ps[], unsigned *n){
+    unsigned nvars = 0;
+    for (unsigned i = 0; i < count; i++)
+        if (PolyDepth(&ps[i]) > nvars)
+            nvars = PolyDepth(&ps[i]);
+    *n = nvars;
+    if (nvars < 2)
+        return NULL;
+    PolyBuilder b;
+    PolyBuilderInit(&b, nvars);
+    size_t *owner = NULL, owners = 0;
+    for (unsigned i = 0; i < count; i++) {
+        size_t from = b.count;
+        PolyBuilderAddPoly(&b, &ps[i]);
+        if (b.count == from)
+            continue;
+        owner = realloc(owner, b.count * sizeof(size_t));
+        assert(owner != NULL);
+        for (size_t t = from; t < b.count; t++)
+            owner[t] = owners;
+        owners++;
+    }
+    unsigned *order = malloc(nvars * sizeof(unsigned)), *perm = NULL;
+    assert(order != NULL);
+    for (unsigned k = 0; k < nvars; k++)
+        order[k] = k;
+    size_t current = OrderNodes(&b, owner, order, false);
+    if (OrderNodes(&b, owner, order, true) < current) {
+        perm = malloc(nvars * sizeof(unsigned));
+        assert(perm != NULL);
+        for (unsigned k = 0; k < nvars; k++)
+            perm[order[k]] = k;
+    }
+    free(order);
+    free(owner);
+    PolyBuilderDestroy(&b);
+    if (PolyMemFailed()) {
+        free(perm);
+        return NULL;
+    }
+    return perm;
+}
@@ -0,0 +1,124 @@
+/** @file
+   Interfejs budowania wielomianów z nieuporządkowanych składników
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __POLY_BUILDER_H__
+#define __POLY_BUILDER_H__
+
+#include "poly.h"
+
+/**
+ * Budowniczy wielomianu nad @p nvars zmiennymi. Zbiera składniki postaci
+ * @f$c x_0^{e_0} x_1^{e_1} \ldots@f$ w dowolnej kolejności, także
+ * powtarzające się, i tworzy z nich za jednym razem wielomian w postaci
+ * znormalizowanej. Składniki o tych samych wykładnikach są sumowane,
+ * a zerowe pomijane.
+ */
+typedef struct PolyBuilder {
+    unsigned nvars; ///< liczba zmiennych
+    size_t count; ///< liczba zebranych składników
+    size_t size; ///< liczba składników, na które jest miejsce
+    poly_coeff_t *coeffs; ///< współczynniki kolejnych składników
+    poly_exp_t *exps; ///< wykładniki: @p nvars kolejnych na składnik
+} PolyBuilder;
+
+/**
+ * Odbiorca kolejnych składników @f$c x_0^{e_0} \ldots x_{n-1}^{e_{n-1}}@f$
+ * wielomianu.
+ * @param[in] arg : argument odbiorcy
+ * @param[in] coeff : współczynnik @f$c@f$
+ * @param[in] nvars : liczba zmiennych @f$n@f$
+ * @param[in] exps : wykładniki @f$e_0, \ldots, e_{n-1}@f$
+ * @return czy przyjmować dalsze składniki
+ */
+typedef bool (*PolyTermFn)(void *arg, poly_coeff_t coeff, unsigned nvars,
+                           const poly_exp_t exps[]);
+
+/**
+ * Inicjuje pustego budowniczego.
+ * @param[out] b : budowniczy
+ * @param[in] nvars : liczba zmiennych
+ */
+void PolyBuilderInit(PolyBuilder *b, unsigned nvars);
+
+/**
+ * Przygotowuje miejsce na co najmniej @p count składników.
+ * @param[in] b : budowniczy
+ * @param[in] count : liczba składników
+ */
+void PolyBuilderReserve(PolyBuilder *b, size_t count);
+
+/**
+ * Dodaje składnik @f$c x_0^{e_0} x_1^{e_1} \ldots x_{n-1}^{e_{n-1}}@f$.
+ * @param[in] b : budowniczy
+ * @param[in] coeff : współczynnik @f$c@f$
+ * @param[in] exps : nieujemne wykładniki @f$e_0, \ldots, e_{n-1}@f$
+ */
+void PolyBuilderAdd(PolyBuilder *b, poly_coeff_t coeff,
+                    const poly_exp_t exps[]);
+
+/**
+ * Sortuje stabilnie indeksy zebranych składników leksykograficznie
+ * po wykładnikach (najpierw po @f$x_0@f$), czyli w kolejności,
+ * w jakiej występują w wielomianie znormalizowanym. Sortowanie
+ * pozycyjne od najmniej znaczącej cyfry ostatniej zmiennej; przebiegi,
+ * w których wszystkie składniki mają tę samą cyfrę, są pomijane, a gdy
+ * składniki są już uporządkowane, sortowanie jest pomijane w całości.
+ * @param[in] b : budowniczy
+ * @return posortowane indeksy (do zwolnienia przez wywołującego)
+ */
+size_t *PolyBuilderSort(const PolyBuilder *b);
+
+/**
+ * Tworzy wielomian będący sumą zebranych składników
+ * i opróżnia budowniczego, który może być dalej używany.
+ * @param[in] b : budowniczy
+ * @return wielomian lub wielomian zerowy po przerwaniu operacji
+ */
+Poly PolyBuilderBuild(PolyBuilder *b);
+
+/**
+ * Zwalnia pamięć budowniczego.
+ * @param[in] b : budowniczy
+ */
+void PolyBuilderDestroy(PolyBuilder *b);
+
+/**
+ * Dodaje do budowniczego wszystkie składniki wielomianu, który zależy
+ * od co najwyżej @p nvars zmiennych.
+ * @param[in] b : budowniczy
+ * @param[in] p : wielomian
+ */
+void PolyBuilderAddPoly(PolyBuilder *b, const Poly *p);
+
+/**
+ * Przenumerowuje zmienne wielomianu: zmienna @f$x_i@f$ staje się
+ * zmienną @f$x_{perm[i]}@f$ dla i < @p n, pozostałe zmienne nie
+ * zmieniają numerów. Składniki wielomianu są przepisywane
+ * z przestawionymi wykładnikami i sortowane, bez składania wielomianów.
+ * @param[in] p : wielomian
+ * @param[in] n : długość permutacji
+ * @param[in] perm : permutacja liczb 0, ..., n - 1
+ * @return wielomian z przenumerowanymi zmiennymi
+ */
+Poly PolyPermuteVars(const Poly *p, unsigned n, const unsigned perm[]);
+
+/**
+ * Dobiera kolejność zmiennych, w której drzewa wielomianów mają mało
+ * węzłów. Zmienne są wybierane zachłannie od zewnętrznej: na kolejny
+ * poziom trafia ta, która daje najmniej różnych prefiksów wykładników
+ * składników wszystkich wielomianów.
+ * @param[in] count : liczba wielomianów
+ * @param[in] ps : wielomiany
+ * @param[out] n : liczba zmiennych
+ * @return permutacja dla PolyPermuteVars długości @p n (do zwolnienia
+ * przez wywołującego) lub NULL, jeśli obecna kolejność nie jest gorsza
+ * albo operację przerwano
+ */
+unsigned *PolyChooseVarOrder(unsigned count, const Poly ps[], unsigned *n);
+
+#endif /* __POLY_BUILDER_H__ */
@@ -0,0 +1,411 @@
+/** @file
+   Implementacja mnożenia wielomianów poza pamięcią operacyjną
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include "poly_extmul.h"
+#include "poly_builder.h"
+#include "poly_heap.h"
+#include "poly_io.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Najmniejsza liczba składników w porcji, niezależnie od limitu */
+#define EXTMUL_MIN_CHUNK 1024
+
+/** Największa liczba przebiegów scalanych naraz */
+#define EXTMUL_FANIN 64
+
+/**
+ * Przebieg w trakcie scalania: plik z uporządkowanymi składnikami
+ * i jego najmniejszy nieodczytany składnik.
+ */
+typedef struct Run {
+    poly_exp_t *exps; ///< wykładniki bieżącego składnika (pierwsze pole, HeapExps)
+    FILE *f; ///< plik przebiegu
+    poly_coeff_t coeff; ///< współczynnik bieżącego składnika
+} Run;
+
+/**
+ * Stan zamiany uporządkowanego ciągu składników w drzewo wielomianu.
+ * Węzły drzewa o tej samej głębokości są otwierane i zamykane w tej
+ * samej kolejności, więc liczby jednomianów węzłów każdej głębokości
+ * można zapisać sekwencyjnie do osobnego pliku, a potem sekwencyjnie
+ * odczytać przy zapisie drzewa w porządku prefiksowym.
+ */
+struct PolyTermWriter {
+    unsigned nvars; ///< liczba zmiennych
+    FILE *terms; ///< scalone składniki
+    FILE **counts; ///< liczby jednomianów węzłów kolejnych głębokości
+    poly_exp_t *exps; ///< wykładniki ostatniego składnika
+    poly_coeff_t coeff; ///< współczynnik ostatniego składnika
+    unsigned long *children; ///< liczby jednomianów otwartych węzłów
+    bool *single; ///< czy otwarty węzeł jest współczynnikiem
+    size_t total; ///< liczba składników
+    bool ok; ///< czy nie wystąpił błąd zapisu lub odczytu
+};
+
+/**
+ * Zapisuje składnik do pliku tymczasowego.
+ * @param[in] f : plik
+ * @param[in] nvars : liczba zmiennych
+ * @param[in] coeff : współczynnik
+ * @param[in] exps : wykładniki
+ */
+static void WriteTerm(FILE *f, unsigned nvars, poly_coeff_t coeff,
+                      const poly_exp_t *exps){
+    WriteCoeff(coeff, f);
+    for (unsigned v = 0; v < nvars; v++)
+        WriteVarint((unsigned long) exps[v], f);
+}
+
+/**
+ * Odczytuje składnik zapisany przez WriteTerm.
+ * @param[in] f : plik
+ * @param[in] nvars : liczba zmiennych
+ * @param[out] coeff : współczynnik
+ * @param[out] exps : wykładniki
+ * @return czy odczytano składnik (fałsz na końcu pliku)
+ */
+static bool ReadTerm(FILE *f, unsigned nvars, poly_coeff_t *coeff,
+                     poly_exp_t *exps){
+    unsigned long e;
+    if (!ReadCoeff(f, coeff))
+        return false;
+    for (unsigned v = 0; v < nvars; v++) {
+        if (!ReadVarint(f, &e))
+            return false;
+        exps[v] = (poly_exp_t) e;
+    }
+    return true;
+}
+
+/**
+ * Sortuje i sumuje porcję składników i zapisuje ją jako nowy przebieg.
+ * @param[in] chunk : porcja (opróżniana)
+ * @param[in] runs : tablica przebiegów
+ * @param[in] count : liczba przebiegów
+ * @return czy udało się utworzyć przebieg
+ */
+static bool FlushChunk(PolyBuilder *chunk, FILE ***runs, size_t *count){
+    unsigned nvars = chunk->nvars;
+    if (chunk->count == 0)
+        return true;
+    FILE *f = tmpfile();
+    if (f == NULL)
+        return false;
+    size_t *idx = PolyBuilderSort(chunk);
+    for (size_t i = 0, j; i < chunk->count; i = j) {
+        const poly_exp_t *exps = chunk->exps + idx[i] * nvars;
+        unsigned long sum = 0;
+        for (j = i; j < chunk->count
+             && ExpsCmp(chunk->exps + idx[j] * nvars, exps, nvars) == 0; j++)
+            sum += (unsigned long) chunk->coeffs[idx[j]];
+        if (sum != 0)
+            WriteTerm(f, nvars, (poly_coeff_t) sum, exps);
+    }
+    free(idx);
+    chunk->count = 0;
+    *runs = realloc(*runs, (*count + 1) * sizeof(FILE *));
+    assert(*runs != NULL);
+    (*runs)[(*count)++] = f;
+    return !ferror(f);
+}
+
+/**
+ * Otwiera węzły drzewa od głębokości @p from dla bieżącego składnika.
+ * @param[in] t : drzewo
+ * @param[in] from : głębokość
+ */
+static void TreeOpen(PolyTermWriter *t, unsigned from){
+    unsigned zeros = t->nvars;
+    while (zeros > 0 && t->exps[zeros - 1] == 0)
+        zeros--;
+    for (unsigned d = from; d < t->nvars; d++) {
+        t->children[d] = 1;
+        t->single[d] = d >= zeros;
+    }
+}
+
+/**
+ * Zamyka otwarte węzły drzewa od głębokości @p from i zapisuje ich
+ * liczby jednomianów (0 dla węzłów będących współczynnikami).
+ * @param[in] t : drzewo
+ * @param[in] from : głębokość
+ */
+static void TreeClose(PolyTermWriter *t, unsigned from){
+    for (unsigned d = t->nvars; d-- > from;)
+        WriteVarint(t->single[d] ? 0 : t->children[d], t->counts[d]);
+}
+
+/**
+ * Dodaje do drzewa kolejny składnik scalonego ciągu.
+ * @param[in] t : drzewo
+ * @param[in] coeff : współczynnik
+ * @param[in] exps : wykładniki, większe od poprzednich
+ */
+static void TreeAdd(PolyTermWriter *t, poly_coeff_t coeff,
+                    const poly_exp_t *exps){
+    unsigned k = 0;
+    if (t->total > 0) {
+        while (exps[k] == t->exps[k])
+            k++;
+        TreeClose(t, k + 1);
+        t->children[k]++;
+        for (unsigned d = 0; d <= k; d++)
+            t->single[d] = false;
+        k++;
+    }
+    memcpy(t->exps, exps, t->nvars * sizeof(poly_exp_t));
+    TreeOpen(t, k);
+    WriteTerm(t->terms, t->nvars, coeff, exps);
+    t->total++;
+}
+
+/**
+ * Scala przebiegi, sumując składniki o równych wykładnikach, i zamyka
+ * ich pliki. Wynik trafia do drzewa @p t lub, gdy jest ono NULL,
+ * do pliku @p out jako nowy przebieg.
+ * @param[in] runs : pliki przebiegów
+ * @param[in] count : liczba przebiegów
+ * @param[in] nvars : liczba zmiennych
+ * @param[in] t : drzewo lub NULL
+ * @param[in] out : plik nowego przebiegu
+ * @return czy odczyt przebiegów się powiódł
+ */
+static bool MergeRuns(FILE **runs, size_t count, unsigned nvars,
+                      PolyTermWriter *t, FILE *out){
+    Run *arr = malloc(count * sizeof(Run));
+    void **heap = malloc(count * sizeof(void *));
+    poly_exp_t *exps = malloc((count + 1) * nvars * sizeof(poly_exp_t));
+    poly_exp_t *cur = exps + count * nvars;
+    size_t n = 0;
+    bool ok = true;
+    assert(arr != NULL && heap != NULL && exps != NULL);
+    for (size_t r = 0; r < count; r++) {
+        arr[r] = (Run) {.f = runs[r], .exps = exps + r * nvars};
+        rewind(runs[r]);
+        if (ReadTerm(runs[r], nvars, &arr[r].coeff, arr[r].exps))
+            heap[n++] = &arr[r];
+    }
+    for (size_t i = n / 2; i-- > 0;)
+        HeapDown(heap, n, i, nvars);
+    while (n > 0 && !PolyStep()) {
+        unsigned long sum = 0;
+        memcpy(cur, HeapExps(heap[0]), nvars * sizeof(poly_exp_t));
+        do {
+            Run *r = heap[0];
+            sum += (unsigned long) r->coeff;
+            if (!ReadTerm(r->f, nvars, &r->coeff, r->exps))
+                heap[0] = heap[--n];
+            HeapDown(heap, n, 0, nvars);
+        } while (n > 0 && ExpsCmp(HeapExps(heap[0]), cur, nvars) == 0);
+        if (sum == 0)
+            continue;
+        if (t != NULL)
+            TreeAdd(t, (poly_coeff_t) sum, cur);
+        else
+            WriteTerm(out, nvars, (poly_coeff_t) sum, cur);
+    }
+    for (size_t r = 0; r < count; r++) {
+        ok = ok && !ferror(runs[r]);
+        fclose(runs[r]);
+    }
+    ok = ok && !PolyMemFailed();
+    free(arr);
+    free(heap);
+    free(exps);
+    return ok;
+}
+
+/**
+ * Zapisuje w formacie PolyWrite węzeł drzewa głębokości @p d,
+ * czytając jego składniki i liczby jednomianów zapisane przez TreeAdd.
+ * @param[in] t : drzewo; t->coeff i t->exps to pierwszy składnik węzła
+ * @param[in] d : głębokość
+ * @param[in] out : plik
+ */
+static void TreeWrite(PolyTermWriter *t, unsigned d, FILE *out){
+    unsigned long n = 0, skip;
+    if (d < t->nvars && !ReadVarint(t->counts[d], &n)) {
+        t->ok = false;
+        return ;
+    }
+    if (n == 0) {
+        for (unsigned e = d + 1; e < t->nvars; e++)
+            t->ok = t->ok && ReadVarint(t->counts[e], &skip);
+        WriteVarint(0, out);
+        WriteCoeff(t->coeff, out);
+        t->total--;
+        if (t->total > 0)
+            t->ok = t->ok && ReadTerm(t->terms, t->nvars, &t->coeff, t->exps);
+        return ;
+    }
+    WriteVarint(n, out);
+    poly_exp_t prev = -1;
+    for (unsigned long i = 0; i < n && t->ok; i++) {
+        WriteVarint((unsigned long) (t->exps[d] - prev - 1), out);
+        prev = t->exps[d];
+        TreeWrite(t, d + 1, out);
+    }
+}
+
+/**
+ * Przygotowuje drzewo do przyjmowania składników nad @p nvars zmiennymi.
+ * @param[in] t : drzewo
+ * @param[in] nvars : liczba zmiennych
+ */
+static void TreeStart(PolyTermWriter *t, unsigned nvars){
+    t->nvars = nvars;
+    t->terms = tmpfile();
+    t->counts = calloc(nvars > 0 ? nvars : 1, sizeof(FILE *));
+    t->exps = malloc((nvars > 0 ? nvars : 1) * sizeof(poly_exp_t));
+    t->children = malloc((nvars > 0 ? nvars : 1) * sizeof(unsigned long));
+    t->single = malloc((nvars > 0 ? nvars : 1) * sizeof(bool));
+    assert(t->counts != NULL && t->exps != NULL && t->children != NULL
+           && t->single != NULL);
+    t->ok = t->terms != NULL;
+    for (unsigned d = 0; d < nvars && t->ok; d++)
+        t->ok = (t->counts[d] = tmpfile()) != NULL;
+}
+
+PolyTermWriter *PolyTermWriterNew(){
+    PolyTermWriter *t = calloc(1, sizeof(PolyTermWriter));
+    assert(t != NULL);
+    t->ok = true;
+    return t;
+}
+
+bool PolyTermWriterAdd(void *w, poly_coeff_t coeff, unsigned nvars,
+                       const poly_exp_t exps[]){
+    PolyTermWriter *t = w;
+    if (t->counts == NULL)
+        TreeStart(t, nvars);
+    assert(nvars == t->nvars);
+    if (t->ok && coeff != 0)
+        TreeAdd(t, coeff, exps);
+    return t->ok;
+}
+
+bool PolyTermWriterFinish(PolyTermWriter *t, FILE *out){
+    bool ok = t->ok && out != NULL;
+    if (ok && t->total > 0)
+        TreeClose(t, 0);
+    if (ok) {
+        PolyWriteHeader(out);
+        if (t->total == 0) {
+            WriteVarint(0, out);
+            WriteCoeff(0, out);
+        }
+        else {
+            rewind(t->terms);
+            for (unsigned d = 0; d < t->nvars; d++)
+                rewind(t->counts[d]);
+            t->ok = ReadTerm(t->terms, t->nvars, &t->coeff, t->exps);
+            TreeWrite(t, 0, out);
+        }
+        ok = t->ok && (t->terms == NULL || !ferror(t->terms));
+    }
+    for (unsigned d = 0; t->counts != NULL && d < t->nvars; d++)
+        if (t->counts[d] != NULL) {
+            ok = ok && !ferror(t->counts[d]);
+            fclose(t->counts[d]);
+        }
+    if (t->terms != NULL)
+        fclose(t->terms);
+    free(t->counts);
+    free(t->exps);
+    free(t->children);
+    free(t->single);
+    free(t);
+    return ok && !ferror(out);
+}
+
+/**
+ * Scala przebiegi i zapisuje iloczyn.
+ * @param[in] runs : pliki przebiegów
+ * @param[in] count : liczba przebiegów
+ * @param[in] nvars : liczba zmiennych
+ * @param[in] out : plik wyniku
+ * @return czy się powiodło
+ */
+static bool MergeAll(FILE **runs, size_t count, unsigned nvars, FILE *out){
+    bool ok = true;
+    while (ok && count > EXTMUL_FANIN) {
+        FILE *f = tmpfile();
+        if (f == NULL)
+            break;
+        ok = MergeRuns(runs, EXTMUL_FANIN, nvars, NULL, f) && !ferror(f);
+        memmove(runs, runs + EXTMUL_FANIN,
+                (count - EXTMUL_FANIN) * sizeof(FILE *));
+        count -= EXTMUL_FANIN;
+        runs[count++] = f;
+    }
+    PolyTermWriter *t = PolyTermWriterNew();
+    TreeStart(t, nvars);
+    if (!ok || !t->ok || count > EXTMUL_FANIN) {
+        while (count > 0)
+            fclose(runs[--count]);
+        t->ok = false;
+    }
+    else {
+        t->ok = MergeRuns(runs, count, nvars, t, NULL) && t->ok;
+    }
+    return PolyTermWriterFinish(t, out);
+}
+
+bool PolyMulExternal(const Poly *p, const Poly *q, size_t memLimit, FILE *out){
+    unsigned dp = PolyDepth(p), dq = PolyDepth(q);
+    unsigned nvars = dp > dq ? dp : dq;
+    if (nvars == 0) {
+        Poly r = PolyMul(p, q);
+        bool ok = PolySerialize(&r, out);
+        PolyDestroy(&r);
+        return ok;
+    }
+    PolyBuilder a, b, chunk;
+    FILE **runs = NULL;
+    size_t count = 0;
+    bool ok = true;
+    size_t termSize = sizeof(poly_coeff_t) + nvars * sizeof(poly_exp_t)
+                      + 2 * sizeof(size_t);
+    size_t chunkSize = memLimit / termSize;
+    if (chunkSize < EXTMUL_MIN_CHUNK)
+        chunkSize = EXTMUL_MIN_CHUNK;
+    poly_exp_t *exps = malloc(nvars * sizeof(poly_exp_t));
+    assert(exps != NULL);
+    PolyBuilderInit(&a, nvars);
+    PolyBuilderInit(&b, nvars);
+    PolyBuilderInit(&chunk, nvars);
+    PolyBuilderAddPoly(&a, p);
+    PolyBuilderAddPoly(&b, q);
+    PolyBuilderReserve(&chunk, chunkSize);
+    for (size_t i = 0; i < a.count && ok; i++) {
+        for (size_t j = 0; j < b.count && ok && !PolyStep(); j++) {
+            for (unsigned v = 0; v < nvars; v++)
+                exps[v] = a.exps[i * nvars + v] + b.exps[j * nvars + v];
+            PolyBuilderAdd(&chunk, (poly_coeff_t) ((unsigned long) a.coeffs[i]
+                                   * (unsigned long) b.coeffs[j]), exps);
+            if (chunk.count == chunkSize)
+                ok = FlushChunk(&chunk, &runs, &count);
+        }
+    }
+    ok = ok && !PolyMemFailed() && FlushChunk(&chunk, &runs, &count);
+    PolyBuilderDestroy(&a);
+    PolyBuilderDestroy(&b);
+    PolyBuilderDestroy(&chunk);
+    free(exps);
+    if (ok) {
+        ok = MergeAll(runs, count, nvars, out);
+    }
+    else {
+        while (count > 0)
+            fclose(runs[--count]);
+    }
+    free(runs);
+    return ok;
+}
@@ -0,0 +1,68 @@
+/** @file
+   Interfejs mnożenia wielomianów poza pamięcią operacyjną
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __POLY_EXTMUL_H__
+#define __POLY_EXTMUL_H__
+
+#include "poly.h"
+#include <stdio.h>
+
+/**
+ * Mnoży wielomiany i zapisuje iloczyn w formacie PolySerialize, nie
+ * tworząc go w pamięci. Składniki iloczynu są generowane porcjami
+ * mieszczącymi się w @p memLimit bajtach; każda porcja jest sortowana,
+ * sumowana i zapisywana do pliku tymczasowego jako uporządkowany
+ * przebieg. Przebiegi są następnie scalane (po co najwyżej 64 naraz),
+ * a scalony ciąg składników jest zamieniany w zapis drzewa wielomianu.
+ * Wszystkie pliki są zapisywane i czytane sekwencyjnie. Czynniki muszą
+ * mieścić się w pamięci, iloczyn - nie. Mnożenie kończy się
+ * niepowodzeniem także po przerwaniu operacji (PolyMemFailed).
+ * @param[in] p : wielomian
+ * @param[in] q : wielomian
+ * @param[in] memLimit : pamięć na porcję składników w bajtach
+ * @param[in] out : plik otwarty do zapisu
+ * @return czy zapis się powiódł
+ */
+bool PolyMulExternal(const Poly *p, const Poly *q, size_t memLimit, FILE *out);
+
+/**
+ * Zapis wielomianu w formacie PolySerialize z uporządkowanego ciągu
+ * składników, bez tworzenia go w pamięci. Składniki i liczby jednomianów
+ * węzłów trafiają sekwencyjnie do plików tymczasowych, a drzewo jest
+ * zapisywane w drugim przebiegu.
+ */
+typedef struct PolyTermWriter PolyTermWriter;
+
+/**
+ * Tworzy pusty zapis.
+ * @return zapis
+ */
+PolyTermWriter *PolyTermWriterNew();
+
+/**
+ * Dodaje kolejny składnik; można przekazać jako PolyTermFn. Składniki
+ * muszą mieć tę samą liczbę zmiennych i rosnące leksykograficznie
+ * wykładniki.
+ * @param[in] w : zapis
+ * @param[in] coeff : współczynnik (zerowe są pomijane)
+ * @param[in] nvars : liczba zmiennych
+ * @param[in] exps : wykładniki
+ * @return czy zapis plików tymczasowych się powiódł
+ */
+bool PolyTermWriterAdd(void *w, poly_coeff_t coeff, unsigned nvars,
+                       const poly_exp_t exps[]);
+
+/**
+ * Zapisuje wielomian złożony z dodanych składników i zwalnia zapis.
+ * @param[in] w : zapis
+ * @param[in] out : plik otwarty do zapisu lub NULL, by porzucić zapis
+ * @return czy cały zapis się powiódł
+ */
+bool PolyTermWriterFinish(PolyTermWriter *w, FILE *out);
+
+#endif /* __POLY_EXTMUL_H__ */
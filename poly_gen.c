@@ -0,0 +1,421 @@
+/** @file
+   Generator danych testowych: skryptów kalkulatora i wielomianów
+   w formacie binarnym PolySerialize
+
+   Dane są zapisywane strumieniowo w miarę generowania, więc rozmiar
+   wyjścia nie jest ograniczony pamięcią. Kształt wielomianów opisują:
+   liczba zmiennych (głębokość zagnieżdżenia), liczba jednomianów na każdym
+   poziomie, rozkład wykładników i wielkość współczynników. Jednomiany
+   każdego poziomu mają rosnące wykładniki i niezerowe współczynniki,
+   więc wielomiany są w postaci normalnej.
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "poly_io.h"
+
+/** Domyślne ziarno generatora */
+#define GEN_SEED 20170615
+
+/** Rozmiar bufora wyjścia */
+#define GEN_BUFFER_SIZE (1 << 20)
+
+/** Wykładnik rozkładu potęgowego odstępów między wykładnikami */
+#define GEN_POWER_ALPHA 1.5
+
+/** Największy parametr COMPOSE w generowanych skryptach */
+#define GEN_MAX_COMPOSE 3
+
+/** Największa liczba zmiennych */
+#define GEN_MAX_VARS 64
+
+/**
+ * Rozkłady wykładników jednomianów jednego poziomu.
+ */
+typedef enum ExpDist {
+    DIST_DENSE, ///< kolejne wykładniki 0, 1, 2, ...
+    DIST_SPARSE, ///< odstępy jednostajne z przedziału [1, gap]
+    DIST_POWER ///< odstępy z rozkładu potęgowego o skali gap
+} ExpDist;
+
+/**
+ * Polecenia skryptu wraz z liczbą wielomianów, których wymagają na stosie.
+ */
+typedef enum GenCommand {
+    GEN_POLY, GEN_ZERO, GEN_ADD, GEN_SUB, GEN_MUL, GEN_NEG, GEN_CLONE,
+    GEN_AT, GEN_SHIFT, GEN_COMPOSE, GEN_DEG, GEN_DEG_BY, GEN_IS_EQ,
+    GEN_IS_ZERO, GEN_IS_COEFF, GEN_PRINT, GEN_POP, GEN_COMMANDS
+} GenCommand;
+
+/** Nazwy poleceń używane w skryptach i w opcji -x */
+static const char *genNames[GEN_COMMANDS] = {
+    [GEN_POLY] = "POLY", [GEN_ZERO] = "ZERO", [GEN_ADD] = "ADD",
+    [GEN_SUB] = "SUB", [GEN_MUL] = "MUL", [GEN_NEG] = "NEG",
+    [GEN_CLONE] = "CLONE", [GEN_AT] = "AT", [GEN_SHIFT] = "SHIFT",
+    [GEN_COMPOSE] = "COMPOSE", [GEN_DEG] = "DEG", [GEN_DEG_BY] = "DEG_BY",
+    [GEN_IS_EQ] = "IS_EQ", [GEN_IS_ZERO] = "IS_ZERO",
+    [GEN_IS_COEFF] = "IS_COEFF", [GEN_PRINT] = "PRINT", [GEN_POP] = "POP",
+};
+
+/** Liczba wielomianów zdejmowanych ze stosu przez polecenie */
+static const unsigned genNeeds[GEN_COMMANDS] = {
+    [GEN_ADD] = 2, [GEN_SUB] = 2, [GEN_MUL] = 2, [GEN_NEG] = 1,
+    [GEN_CLONE] = 1, [GEN_AT] = 1, [GEN_SHIFT] = 1, [GEN_COMPOSE] = 1,
+    [GEN_DEG] = 1, [GEN_DEG_BY] = 1, [GEN_IS_EQ] = 2, [GEN_IS_ZERO] = 1,
+    [GEN_IS_COEFF] = 1, [GEN_PRINT] = 1, [GEN_POP] = 1,
+};
+
+/** Domyślne wagi poleceń */
+static const unsigned genDefaultMix[GEN_COMMANDS] = {
+    [GEN_POLY] = 30, [GEN_ADD] = 10, [GEN_SUB] = 5, [GEN_MUL] = 5,
+    [GEN_NEG] = 2, [GEN_CLONE] = 10, [GEN_AT] = 5, [GEN_COMPOSE] = 1,
+    [GEN_DEG] = 2, [GEN_IS_EQ] = 2, [GEN_PRINT] = 5, [GEN_POP] = 5,
+};
+
+/**
+ * Stan generatora.
+ */
+typedef struct Gen {
+    uint64_t rng; ///< stan generatora liczb losowych
+    unsigned vars; ///< liczba zmiennych
+    unsigned terms; ///< liczba jednomianów na poziomie
+    ExpDist dist; ///< rozkład wykładników
+    unsigned gap; ///< parametr rozkładu wykładników
+    poly_coeff_t maxCoeff; ///< największa wartość bezwzględna współczynnika
+    poly_exp_t *exps; ///< wykładniki bieżących jednomianów kolejnych poziomów
+    FILE *out; ///< wyjście
+} Gen;
+
+/**
+ * Generator xorshift64*.
+ * @param[in,out] g : stan generatora
+ * @return kolejna liczba losowa
+ */
+static uint64_t Rand(Gen *g) {
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return g->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Zwraca liczbę losową z przedziału [0, n).
+ * @param[in,out] g : stan generatora
+ * @param[in] n : górna granica
+ * @return liczba losowa
+ */
+static uint64_t RandBelow(Gen *g, uint64_t n) {
+    return n == 0 ? 0 : Rand(g) % n;
+}
+
+/**
+ * Losuje niezerowy współczynnik o wartości bezwzględnej co najwyżej
+ * maxCoeff.
+ * @param[in,out] g : stan generatora
+ * @return współczynnik
+ */
+static poly_coeff_t RandCoeff(Gen *g) {
+    poly_coeff_t c = (poly_coeff_t) RandBelow(g, g->maxCoeff) + 1;
+    return Rand(g) & 1 ? -c : c;
+}
+
+/**
+ * Losuje odstęp między kolejnymi wykładnikami.
+ * @param[in,out] g : stan generatora
+ * @return odstęp (co najmniej 1)
+ */
+static uint64_t RandGap(Gen *g) {
+    switch (g->dist) {
+        case DIST_DENSE:
+            return 1;
+        case DIST_SPARSE:
+            return RandBelow(g, g->gap) + 1;
+        default: {
+            double u = ((Rand(g) >> 11) + 1) * 0x1.0p-53;
+            double gap = g->gap * (pow(u, -1 / GEN_POWER_ALPHA) - 1);
+            return gap < (double) INT_MAX ? (uint64_t) gap + 1 : INT_MAX;
+        }
+    }
+}
+
+/**
+ * Losuje rosnące wykładniki jednomianów jednego poziomu.
+ * Gdy kolejny wykładnik przekroczyłby zakres poly_exp_t, poziom
+ * ma mniej jednomianów.
+ * @param[in,out] g : stan generatora
+ * @param[out] exps : wykładniki
+ * @return liczba jednomianów
+ */
+static unsigned RandExps(Gen *g, poly_exp_t *exps) {
+    uint64_t exp = g->dist == DIST_DENSE ? 0 : RandGap(g) - 1;
+    unsigned n = 0;
+    while (n < g->terms && exp <= INT_MAX) {
+        exps[n++] = (poly_exp_t) exp;
+        exp += RandGap(g);
+    }
+    return n;
+}
+
+/**
+ * Zapisuje liczbę w zapisie dziesiętnym.
+ * @param[in] g : stan generatora
+ * @param[in] n : liczba
+ */
+static void PutNumber(Gen *g, long n) {
+    char digits[24];
+    int it = sizeof(digits);
+    unsigned long u = n < 0 ? -(unsigned long) n : (unsigned long) n;
+    do {
+        digits[--it] = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    if (n < 0)
+        digits[--it] = '-';
+    fwrite(digits + it, 1, sizeof(digits) - it, g->out);
+}
+
+/**
+ * Zapisuje losowy wielomian nad zmiennymi od @p level
+ * w formacie wejściowym kalkulatora.
+ * @param[in,out] g : stan generatora
+ * @param[in] level : numer zmiennej
+ */
+static void GenText(Gen *g, unsigned level) {
+    if (level == g->vars) {
+        PutNumber(g, RandCoeff(g));
+        return;
+    }
+    poly_exp_t *exps = g->exps + (size_t) level * g->terms;
+    unsigned n = RandExps(g, exps);
+    for (unsigned i = 0; i < n; i++) {
+        if (i > 0)
+            putc_unlocked('+', g->out);
+        putc_unlocked('(', g->out);
+        GenText(g, level + 1);
+        putc_unlocked(',', g->out);
+        PutNumber(g, exps[i]);
+        putc_unlocked(')', g->out);
+    }
+}
+
+/**
+ * Zapisuje losowy wielomian nad zmiennymi od @p level
+ * w formacie PolyWrite. Węzeł z jedynym jednomianem o wykładniku zero
+ * jest odkładany, bo jeśli jego współczynnik okaże się stałą, w postaci
+ * normalnej zostaje z niego sam współczynnik.
+ * @param[in,out] g : stan generatora
+ * @param[in] level : numer zmiennej
+ * @param[in] pending : liczba odłożonych węzłów nad @p level
+ */
+static void GenBinary(Gen *g, unsigned level, unsigned pending) {
+    if (level == g->vars) {
+        WriteVarint(0, g->out);
+        WriteCoeff(RandCoeff(g), g->out);
+        return;
+    }
+    poly_exp_t *exps = g->exps + (size_t) level * g->terms;
+    unsigned n = RandExps(g, exps);
+    if (n == 1 && exps[0] == 0) {
+        GenBinary(g, level + 1, pending + 1);
+        return;
+    }
+    for (; pending > 0; pending--) {
+        WriteVarint(1, g->out);
+        WriteVarint(0, g->out);
+    }
+    poly_exp_t prev = -1;
+    WriteVarint(n, g->out);
+    for (unsigned i = 0; i < n; i++) {
+        WriteVarint((unsigned long) ((long) exps[i] - prev - 1), g->out);
+        prev = exps[i];
+        GenBinary(g, level + 1, 0);
+    }
+}
+
+/**
+ * Zapisuje skrypt kalkulatora. Polecenia są losowane z wagami @p mix;
+ * polecenie, dla którego na stosie jest za mało wielomianów, jest
+ * zastępowane wielomianem, więc skrypt nie powoduje błędów STACK UNDERFLOW.
+ * @param[in,out] g : stan generatora
+ * @param[in] lines : liczba wierszy
+ * @param[in] mix : wagi poleceń
+ */
+static void GenScript(Gen *g, unsigned long lines, const unsigned mix[]) {
+    unsigned long depth = 0, total = 0;
+    for (int c = 0; c < GEN_COMMANDS; c++)
+        total += mix[c];
+    for (unsigned long line = 0; line < lines; line++) {
+        unsigned long pick = RandBelow(g, total);
+        int cmd = 0;
+        while (pick >= mix[cmd])
+            pick -= mix[cmd++];
+        unsigned arg = 0;
+        if (cmd == GEN_COMPOSE)
+            arg = RandBelow(g, GEN_MAX_COMPOSE + 1);
+        if (depth < genNeeds[cmd] + arg)
+            cmd = GEN_POLY;
+        if (cmd == GEN_POLY) {
+            GenText(g, 0);
+        }
+        else {
+            fputs(genNames[cmd], g->out);
+            if (cmd == GEN_AT || cmd == GEN_SHIFT) {
+                putc_unlocked(' ', g->out);
+                PutNumber(g, (long) RandBelow(g, 7) - 3);
+            }
+            else if (cmd == GEN_DEG_BY) {
+                putc_unlocked(' ', g->out);
+                PutNumber(g, RandBelow(g, g->vars + 1));
+            }
+            else if (cmd == GEN_COMPOSE) {
+                putc_unlocked(' ', g->out);
+                PutNumber(g, arg);
+            }
+        }
+        putc_unlocked('\n', g->out);
+        if (cmd == GEN_POLY || cmd == GEN_ZERO || cmd == GEN_CLONE)
+            depth++;
+        else if (cmd == GEN_ADD || cmd == GEN_SUB || cmd == GEN_MUL
+                 || cmd == GEN_POP)
+            depth--;
+        else if (cmd == GEN_COMPOSE)
+            depth -= arg;
+    }
+}
+
+/**
+ * Odczytuje wagi poleceń w postaci "ADD=3,MUL=1,...".
+ * Polecenia niewymienione mają wagę 0.
+ * @param[in] spec : opis wag
+ * @param[out] mix : wagi
+ * @return czy opis jest poprawny
+ */
+static bool ParseMix(const char *spec, unsigned mix[]) {
+    char *copy = strdup(spec), *save = NULL;
+    bool ok = true, any = false;
+    assert(copy != NULL);
+    memset(mix, 0, GEN_COMMANDS * sizeof(unsigned));
+    for (char *tok = strtok_r(copy, ",", &save); tok != NULL && ok;
+         tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        int cmd = 0;
+        if (eq == NULL) {
+            ok = false;
+            break;
+        }
+        *eq = '\0';
+        while (cmd < GEN_COMMANDS && strcmp(genNames[cmd], tok) != 0)
+            cmd++;
+        if (cmd == GEN_COMMANDS) {
+            ok = false;
+            break;
+        }
+        mix[cmd] = strtoul(eq + 1, NULL, 10);
+        any = any || mix[cmd] > 0;
+    }
+    free(copy);
+    return ok && any;
+}
+
+/**
+ * Wypisuje sposób użycia programu.
+ * @param[in] prog : nazwa programu
+ * @return kod wyjścia
+ */
+static int Usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-b] [-v vars] [-t terms] "
+            "[-e dense|sparse|powerlaw] [-g gap] [-c max_coeff]\n"
+            "       [-x POLY=30,ADD=10,...] [-n lines] [-s seed] "
+            "[-o file]\n", prog);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    Gen g = {.rng = GEN_SEED, .vars = 2, .terms = 4, .dist = DIST_SPARSE,
+             .gap = 8, .maxCoeff = 1000, .out = stdout};
+    unsigned mix[GEN_COMMANDS];
+    unsigned long lines = 1000;
+    bool binary = false;
+    const char *outName = NULL;
+    int opt;
+    memcpy(mix, genDefaultMix, sizeof(mix));
+    while ((opt = getopt(argc, argv, "bv:t:e:g:c:x:n:s:o:")) != -1) {
+        switch (opt) {
+            case 'b':
+                binary = true;
+                break;
+            case 'v':
+                g.vars = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                g.terms = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                if (strcmp(optarg, "dense") == 0)
+                    g.dist = DIST_DENSE;
+                else if (strcmp(optarg, "sparse") == 0)
+                    g.dist = DIST_SPARSE;
+                else if (strcmp(optarg, "powerlaw") == 0)
+                    g.dist = DIST_POWER;
+                else
+                    return Usage(argv[0]);
+                break;
+            case 'g':
+                g.gap = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                g.maxCoeff = strtol(optarg, NULL, 10);
+                break;
+            case 'x':
+                if (!ParseMix(optarg, mix))
+                    return Usage(argv[0]);
+                break;
+            case 'n':
+                lines = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                g.rng = strtoull(optarg, NULL, 10);
+                break;
+            case 'o':
+                outName = optarg;
+                break;
+            default:
+                return Usage(argv[0]);
+        }
+    }
+    if (g.vars > GEN_MAX_VARS || g.terms == 0 || g.gap == 0
+        || g.maxCoeff <= 0 || g.rng == 0)
+        return Usage(argv[0]);
+    if (outName != NULL && (g.out = fopen(outName, "wb")) == NULL) {
+        fprintf(stderr, "cannot write %s\n", outName);
+        return 1;
+    }
+    setvbuf(g.out, NULL, _IOFBF, GEN_BUFFER_SIZE);
+    g.exps = malloc(((size_t) g.vars * g.terms + 1) * sizeof(poly_exp_t));
+    assert(g.exps != NULL);
+    if (binary) {
+        PolyWriteHeader(g.out);
+        GenBinary(&g, 0, 0);
+    }
+    else {
+        GenScript(&g, lines, mix);
+    }
+    free(g.exps);
+    if (fclose(g.out) != 0) {
+        fprintf(stderr, "write error\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+/** @file
+   Wspólne operacje kopców scalających składniki wielomianów
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __POLY_HEAP_H__
+#define __POLY_HEAP_H__
+
+#include "poly.h"
+#include <stddef.h>
+
+/**
+ * Porównuje leksykograficznie wykładniki dwóch składników.
+ * @param[in] a : wykładniki
+ * @param[in] b : wykładniki
+ * @param[in] nvars : liczba zmiennych
+ * @return wynik ujemny, zero lub dodatni
+ */
+static inline int ExpsCmp(const poly_exp_t *a, const poly_exp_t *b,
+                          unsigned nvars) {
+    for (unsigned v = 0; v < nvars; v++)
+        if (a[v] != b[v])
+            return a[v] < b[v] ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Zwraca wykładniki bieżącego składnika elementu kopca. Pierwszym polem
+ * struktury elementu musi być wskaźnik na te wykładniki.
+ * @param[in] item : element kopca
+ * @return wykładniki
+ */
+static inline const poly_exp_t *HeapExps(const void *item) {
+    return *(poly_exp_t * const *) item;
+}
+
+/**
+ * Przywraca porządek kopca od pozycji @p i w dół.
+ * @param[in] heap : kopiec elementów według bieżących składników
+ * @param[in] n : rozmiar kopca
+ * @param[in] i : pozycja
+ * @param[in] nvars : liczba zmiennych
+ */
+static inline void HeapDown(void **heap, size_t n, size_t i, unsigned nvars) {
+    for (;;) {
+        size_t min = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && ExpsCmp(HeapExps(heap[l]), HeapExps(heap[min]), nvars) < 0)
+            min = l;
+        if (r < n && ExpsCmp(HeapExps(heap[r]), HeapExps(heap[min]), nvars) < 0)
+            min = r;
+        if (min == i)
+            return ;
+        void *swap = heap[i];
+        heap[i] = heap[min];
+        heap[min] = swap;
+        i = min;
+    }
+}
+
+#endif /* __POLY_HEAP_H__ */
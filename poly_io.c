@@ -0,0 +1,165 @@
+/** @file
+   Implementacja binarnego zapisu i odczytu wielomianów
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include "poly_io.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Znacznik na początku pliku */
+#define POLY_IO_MAGIC "POLY"
+
+/** Długość znacznika */
+#define POLY_IO_MAGIC_LEN 4
+
+void WriteVarint(unsigned long n, FILE *f){
+    while (n >= 0x80) {
+        putc_unlocked((int) (n & 0x7f) | 0x80, f);
+        n >>= 7;
+    }
+    putc_unlocked((int) n, f);
+}
+
+bool ReadVarint(FILE *f, unsigned long *n){
+    unsigned long res = 0;
+    unsigned shift = 0;
+    int c;
+    do {
+        c = getc_unlocked(f);
+        if (c == EOF || shift >= sizeof(unsigned long) * CHAR_BIT)
+            return false;
+        res |= (unsigned long) (c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    *n = res;
+    return true;
+}
+
+/**
+ * Koduje współczynnik tak, by liczby o małej wartości bezwzględnej
+ * zajmowały mało bajtów.
+ * @param[in] c : współczynnik
+ * @return zakodowany współczynnik
+ */
+static inline unsigned long ZigZag(poly_coeff_t c){
+    return ((unsigned long) c << 1) ^ (unsigned long) (c >> (sizeof(c) * CHAR_BIT - 1));
+}
+
+/**
+ * Odwraca ZigZag.
+ * @param[in] n : zakodowany współczynnik
+ * @return współczynnik
+ */
+static inline poly_coeff_t UnZigZag(unsigned long n){
+    return (poly_coeff_t) (n >> 1) ^ -(poly_coeff_t) (n & 1);
+}
+
+void WriteCoeff(poly_coeff_t c, FILE *f){
+    WriteVarint(ZigZag(c), f);
+}
+
+bool ReadCoeff(FILE *f, poly_coeff_t *c){
+    unsigned long n;
+    if (!ReadVarint(f, &n))
+        return false;
+    *c = UnZigZag(n);
+    return true;
+}
+
+void PolyWrite(const Poly *p, FILE *f){
+    if (PolyIsCoeff(p)) {
+        WriteVarint(0, f);
+        WriteCoeff(p->coeff, f);
+        return ;
+    }
+    unsigned long count = 0;
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next)
+        count++;
+    WriteVarint(count, f);
+    poly_exp_t prevExp = -1;
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next) {
+        WriteVarint((unsigned long) (tmp->exp - prevExp - 1), f);
+        prevExp = tmp->exp;
+        PolyWrite(&tmp->p, f);
+    }
+}
+
+void PolyWriteHeader(FILE *f){
+    fwrite(POLY_IO_MAGIC, 1, POLY_IO_MAGIC_LEN, f);
+    putc_unlocked(POLY_IO_VERSION, f);
+}
+
+bool PolySerialize(const Poly *p, FILE *f){
+    PolyWriteHeader(f);
+    PolyWrite(p, f);
+    return !ferror(f);
+}
+
+/**
+ * Odczytuje wielomian zapisany przez PolyWrite, którego węzeł leży
+ * na głębokości @p depth.
+ * @param[in] f : plik otwarty do odczytu
+ * @param[out] p : odczytany wielomian (zerowy w razie błędu)
+ * @param[in] depth : głębokość węzła
+ * @return czy odczyt się powiódł
+ */
+static bool PolyReadRec(FILE *f, Poly *p, unsigned depth){
+    unsigned long count, n;
+    *p = PolyZero();
+    if (!ReadVarint(f, &count))
+        return false;
+    if (count == 0) {
+        poly_coeff_t c;
+        if (!ReadCoeff(f, &c))
+            return false;
+        *p = PolyFromCoeff(c);
+        return true;
+    }
+    if (depth >= POLY_IO_MAX_DEPTH)
+        return false;
+    Mono *first = NULL, *last = NULL;
+    long exp = -1;
+    for (unsigned long i = 0; i < count; i++) {
+        Mono *new = MonoAlloc();
+        if (last == NULL)
+            first = new;
+        else
+            last->next = new;
+        last = new;
+        *p = (Poly) {.first = first};
+        if (!ReadVarint(f, &n) || n > (unsigned long) INT_MAX - exp - 1) {
+            PolyDestroy(p);
+            *p = PolyZero();
+            return false;
+        }
+        exp += n + 1;
+        new->exp = (poly_exp_t) exp;
+        if (!PolyReadRec(f, &new->p, depth + 1) || PolyIsZero(&new->p)
+            || (count == 1 && exp == 0 && PolyIsCoeff(&new->p))) {
+            PolyDestroy(p);
+            *p = PolyZero();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PolyRead(FILE *f, Poly *p){
+    return PolyReadRec(f, p, 0);
+}
+
+bool PolyDeserialize(FILE *f, Poly *p){
+    char magic[POLY_IO_MAGIC_LEN];
+    *p = PolyZero();
+    if (fread(magic, 1, POLY_IO_MAGIC_LEN, f) != POLY_IO_MAGIC_LEN
+        || memcmp(magic, POLY_IO_MAGIC, POLY_IO_MAGIC_LEN) != 0
+        || getc_unlocked(f) != POLY_IO_VERSION)
+        return false;
+    return PolyRead(f, p);
+}
@@ -0,0 +1,106 @@
+/** @file
+   Interfejs binarnego zapisu i odczytu wielomianów
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __POLY_IO_H__
+#define __POLY_IO_H__
+
+#include "poly.h"
+#include <stdio.h>
+
+/** Wersja formatu binarnego zapisywana w nagłówku */
+#define POLY_IO_VERSION 1
+
+/** Największa głębokość zagnieżdżenia wielomianu przyjmowana przy odczycie */
+#define POLY_IO_MAX_DEPTH 16384
+
+/**
+ * Zapisuje wielomian w formacie binarnym.
+ * Format: nagłówek "POLY" i bajt wersji, a następnie wielomian w porządku
+ * prefiksowym. Wielomian to liczba jednomianów n (varint), po której
+ * dla n = 0 następuje współczynnik (varint w kodowaniu zigzag),
+ * a dla n > 0 kolejne jednomiany: przyrost wykładnika względem poprzedniego
+ * jednomianu pomniejszony o jeden (dla pierwszego - sam wykładnik)
+ * i wielomian-współczynnik.
+ * @param[in] p : wielomian
+ * @param[in] f : plik otwarty do zapisu
+ * @return czy zapis się powiódł
+ */
+bool PolySerialize(const Poly *p, FILE *f);
+
+/**
+ * Odczytuje wielomian zapisany przez PolySerialize.
+ * Zapisany wielomian jest już w postaci normalnej, więc nie jest
+ * ani sortowany, ani sumowany. Dane niepoprawne (np. jednomiany
+ * o zerowym współczynniku lub nierosnących wykładnikach, jedyny
+ * jednomian o wykładniku zero ze stałym współczynnikiem, który
+ * w postaci normalnej jest samym współczynnikiem, albo zagnieżdżenie
+ * głębsze niż POLY_IO_MAX_DEPTH) są odrzucane.
+ * @param[in] f : plik otwarty do odczytu
+ * @param[out] p : odczytany wielomian (zerowy w razie błędu)
+ * @return czy odczyt się powiódł
+ */
+bool PolyDeserialize(FILE *f, Poly *p);
+
+/**
+ * Zapisuje nagłówek formatu PolySerialize. Po nim należy zapisać
+ * wielomian w formacie PolyWrite; pozwala to generować plik strumieniowo,
+ * bez budowania wielomianu w pamięci.
+ * @param[in] f : plik otwarty do zapisu
+ */
+void PolyWriteHeader(FILE *f);
+
+/**
+ * Zapisuje wielomian w formacie PolySerialize, ale bez nagłówka.
+ * Służy do osadzania wielomianów w innych formatach binarnych.
+ * @param[in] p : wielomian
+ * @param[in] f : plik otwarty do zapisu
+ */
+void PolyWrite(const Poly *p, FILE *f);
+
+/**
+ * Odczytuje wielomian zapisany przez PolyWrite. Dane są sprawdzane
+ * jak w PolyDeserialize.
+ * @param[in] f : plik otwarty do odczytu
+ * @param[out] p : odczytany wielomian (zerowy w razie błędu)
+ * @return czy odczyt się powiódł
+ */
+bool PolyRead(FILE *f, Poly *p);
+
+/**
+ * Zapisuje liczbę nieujemną w kodowaniu varint
+ * (po 7 bitów na bajt, najstarszy bit oznacza kontynuację).
+ * @param[in] n : liczba
+ * @param[in] f : plik
+ */
+void WriteVarint(unsigned long n, FILE *f);
+
+/**
+ * Czyta liczbę zapisaną przez WriteVarint.
+ * @param[in] f : plik
+ * @param[out] n : odczytana liczba
+ * @return czy odczyt się powiódł
+ */
+bool ReadVarint(FILE *f, unsigned long *n);
+
+/**
+ * Zapisuje współczynnik jako varint w kodowaniu zigzag, dzięki czemu
+ * liczby o małej wartości bezwzględnej zajmują mało bajtów.
+ * @param[in] c : współczynnik
+ * @param[in] f : plik
+ */
+void WriteCoeff(poly_coeff_t c, FILE *f);
+
+/**
+ * Czyta współczynnik zapisany przez WriteCoeff.
+ * @param[in] f : plik
+ * @param[out] c : odczytany współczynnik
+ * @return czy odczyt się powiódł
+ */
+bool ReadCoeff(FILE *f, poly_coeff_t *c);
+
+#endif /* __POLY_IO_H__ */
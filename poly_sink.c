@@ -0,0 +1,551 @@
+/** @file
+   Implementacja operacji scalających iloczyny wielomianów składnik po składniku
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include "poly_sink.h"
+#include "poly_heap.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Strumień iloczynów jednego składnika czynnika przez kolejne składniki
+ * drugiego czynnika. Porządek składników jest zgodny z mnożeniem, więc
+ * iloczyny pojawiają się rosnąco.
+ */
+typedef struct Stream {
+    poly_exp_t *exps; ///< wykładniki bieżącego iloczynu (pierwsze pole, HeapExps)
+    const PolyBuilder *a; ///< czynnik
+    const PolyBuilder *b; ///< czynnik
+    size_t i; ///< składnik czynnika @p a
+    size_t j; ///< bieżący składnik czynnika @p b
+} Stream;
+
+/**
+ * Wylicza wykładniki bieżącego iloczynu strumienia.
+ * @param[in] s : strumień
+ * @param[in] nvars : liczba zmiennych
+ */
+static void StreamLoad(Stream *s, unsigned nvars){
+    for (unsigned v = 0; v < nvars; v++)
+        s->exps[v] = s->a->exps[s->i * nvars + v]
+                     + s->b->exps[s->j * nvars + v];
+}
+
+/**
+ * Przekazuje odbiorcy składniki sumy iloczynów @f$a_k b_k@f$.
+ * @param[in] count : liczba iloczynów
+ * @param[in] a : czynniki, których składniki dają strumienie
+ * @param[in] b : drugie czynniki
+ * @param[in] nvars : liczba zmiennych
+ * @param[in] fn : odbiorca składników
+ * @param[in] arg : argument odbiorcy
+ * @return czy odbiorca przyjął wszystkie składniki
+ */
+static bool SumProducts(size_t count, const PolyBuilder a[],
+                        const PolyBuilder b[], unsigned nvars, PolyTermFn fn,
+                        void *arg){
+    size_t total = 0, n = 0;
+    unsigned width = nvars > 0 ? nvars : 1;
+    for (size_t k = 0; k < count; k++)
+        if (b[k].count > 0)
+            total += a[k].count;
+    Stream *arr = malloc((total > 0 ? total : 1) * sizeof(Stream));
+    void **heap = malloc((total > 0 ? total : 1) * sizeof(void *));
+    poly_exp_t *exps = malloc((total + 1) * width * sizeof(poly_exp_t));
+    poly_exp_t *cur = exps + total * width;
+    assert(arr != NULL && heap != NULL && exps != NULL);
+    for (size_t k = 0; k < count; k++) {
+        for (size_t i = 0; i < a[k].count && b[k].count > 0; i++, n++) {
+            arr[n] = (Stream) {.a = &a[k], .b = &b[k], .i = i, .j = 0,
+                               .exps = exps + n * width};
+            StreamLoad(&arr[n], nvars);
+            heap[n] = &arr[n];
+        }
+    }
+    for (size_t i = n / 2; i-- > 0;)
+        HeapDown(heap, n, i, nvars);
+    bool ok = true;
+    while (n > 0 && ok) {
+        unsigned long sum = 0;
+        memcpy(cur, HeapExps(heap[0]), nvars * sizeof(poly_exp_t));
+        do {
+            Stream *s = heap[0];
+            sum += (unsigned long) s->a->coeffs[s->i]
+                   * (unsigned long) s->b->coeffs[s->j];
+            if (++s->j < s->b->count)
+                StreamLoad(s, nvars);
+            else
+                heap[0] = heap[--n];
+            HeapDown(heap, n, 0, nvars);
+            ok = !PolyStep();
+        } while (ok && n > 0 && ExpsCmp(HeapExps(heap[0]), cur, nvars) == 0);
+        if (ok && sum != 0)
+            ok = fn(arg, (poly_coeff_t) sum, nvars, cur);
+    }
+    free(arr);
+    free(heap);
+    free(exps);
+    return ok;
+}
+
+/**
+ * Wylicza liczbę zmiennych sumy iloczynów.
+ * @param[in] count : liczba iloczynów
+ * @param[in] p : czynniki
+ * @param[in] q : czynniki
+ * @return największa głębokość czynnika
+ */
+static unsigned ProductsDepth(size_t count, const Poly p[], const Poly q[]){
+    unsigned nvars = 0;
+    for (size_t k = 0; k < count; k++) {
+        if (PolyDepth(&p[k]) > nvars)
+            nvars = PolyDepth(&p[k]);
+        if (PolyDepth(&q[k]) > nvars)
+            nvars = PolyDepth(&q[k]);
+    }
+    return nvars;
+}
+
+/**
+ * Przekazuje odbiorcy składniki sumy iloczynów @f$p_k q_k@f$. Strumienie
+ * powstają ze składników mniejszego czynnika każdego iloczynu.
+ * @param[in] count : liczba iloczynów
+ * @param[in] p : czynniki
+ * @param[in] q : czynniki
+ * @param[in] fn : odbiorca składników
+ * @param[in] arg : argument odbiorcy
+ * @return czy odbiorca przyjął wszystkie składniki, a operacja nie
+ * została przerwana
+ */
+static bool SinkProducts(size_t count, const Poly p[], const Poly q[],
+                         PolyTermFn fn, void *arg){
+    unsigned nvars = ProductsDepth(count, p, q);
+    PolyBuilder *a = malloc((count > 0 ? count : 1) * sizeof(PolyBuilder));
+    PolyBuilder *b = malloc((count > 0 ? count : 1) * sizeof(PolyBuilder));
+    assert(a != NULL && b != NULL);
+    for (size_t k = 0; k < count; k++) {
+        bool swap = PolyTermCount(&p[k]) > PolyTermCount(&q[k]);
+        PolyBuilderInit(&a[k], nvars);
+        PolyBuilderInit(&b[k], nvars);
+        PolyBuilderAddPoly(&a[k], swap ? &q[k] : &p[k]);
+        PolyBuilderAddPoly(&b[k], swap ? &p[k] : &q[k]);
+    }
+    bool ok = SumProducts(count, a, b, nvars, fn, arg) && !PolyMemFailed();
+    for (size_t k = 0; k < count; k++) {
+        PolyBuilderDestroy(&a[k]);
+        PolyBuilderDestroy(&b[k]);
+    }
+    free(a);
+    free(b);
+    return ok;
+}
+
+bool PolyMulSink(const Poly *p, const Poly *q, PolyTermFn fn, void *arg){
+    return !PolyMemFailed() && SinkProducts(1, p, q, fn, arg);
+}
+
+bool PolyPowSink(const Poly *p, poly_exp_t exp, PolyTermFn fn, void *arg){
+    assert(exp >= 0);
+    PolyDegCap none = {.total = -1};
+    Poly f[2];
+    f[0] = PolyPowTrunc(p, exp / 2, &none);
+    f[1] = exp % 2 == 0 ? f[0] : PolyMul(&f[0], p);
+    bool ok = !PolyMemFailed() && SinkProducts(1, &f[0], &f[1], fn, arg);
+    if (exp % 2 != 0)
+        PolyDestroy(&f[1]);
+    PolyDestroy(&f[0]);
+    return ok;
+}
+
+/**
+ * Składa współczynnik jednomianu z wielomianami wstawianymi za zmienne
+ * @f$x_1, x_2, \ldots@f$.
+ * @param[in] m : jednomian
+ * @param[in] count : liczba wielomianów w tablicy
+ * @param[in] x : tablica wstawianych wielomianów
+ * @return złożony współczynnik
+ */
+static Poly ComposeCoeff(const Mono *m, unsigned count, const Poly x[]){
+    return PolyCompose(&m->p, count > 0 ? count - 1 : 0,
+                       count > 0 ? x + 1 : x);
+}
+
+bool PolyComposeSink(const Poly *p, unsigned count, const Poly x[],
+                     PolyTermFn fn, void *arg){
+    Poly one = PolyFromCoeff(1), zero = PolyZero();
+    if (PolyIsCoeff(p))
+        return !PolyMemFailed() && SinkProducts(1, p, &one, fn, arg);
+    PolyDegCap none = {.total = -1};
+    const Poly *x0 = count > 0 ? &x[0] : &zero;
+    size_t len = 0, k;
+    for (Mono *m = p->first; m != NULL; m = m->next)
+        len++;
+    const Mono **monos = malloc(len * sizeof(Mono *));
+    assert(monos != NULL);
+    k = 0;
+    for (Mono *m = p->first; m != NULL; m = m->next)
+        monos[k++] = m;
+    Poly acc = ComposeCoeff(monos[len - 1], count, x);
+    for (k = len - 1; k-- > 1 && !PolyMemFailed();) {
+        Poly step = PolyPowTrunc(x0, monos[k + 1]->exp - monos[k]->exp, &none);
+        Poly c = ComposeCoeff(monos[k], count, x);
+        PolyFma(&c, &step, &acc);
+        PolyDestroy(&step);
+        PolyDestroy(&acc);
+        acc = c;
+    }
+    Poly pows[2], coeffs[2];
+    pows[0] = PolyPowTrunc(x0, monos[0]->exp, &none);
+    if (len == 1) {
+        coeffs[0] = acc;
+    }
+    else {
+        Poly step = PolyPowTrunc(x0, monos[1]->exp - monos[0]->exp, &none);
+        pows[1] = PolyMul(&pows[0], &step);
+        PolyDestroy(&step);
+        coeffs[0] = ComposeCoeff(monos[0], count, x);
+        coeffs[1] = acc;
+    }
+    size_t n = len == 1 ? 1 : 2;
+    bool ok = !PolyMemFailed() && SinkProducts(n, pows, coeffs, fn, arg);
+    for (k = 0; k < n; k++) {
+        PolyDestroy(&pows[k]);
+        PolyDestroy(&coeffs[k]);
+    }
+    free(monos);
+    return ok;
+}
+
+/**
+ * Odbiorca dodający składniki do budowniczego.
+ * @param[in] arg : budowniczy
+ * @param[in] coeff : współczynnik
+ * @param[in] nvars : liczba zmiennych
+ * @param[in] exps : wykładniki
+ * @return true
+ */
+static bool AddTerm(void *arg, poly_coeff_t coeff, unsigned nvars,
+                    const poly_exp_t exps[]){
+    (void) nvars;
+    PolyBuilderAdd(arg, coeff, exps);
+    return true;
+}
+
+Poly PolyDot(unsigned k, const Poly a[], const Poly b[]){
+    PolyBuilder r;
+    PolyBuilderInit(&r, ProductsDepth(k, a, b));
+    Poly res = PolyZero();
+    if (!PolyMemFailed() && SinkProducts(k, a, b, AddTerm, &r))
+        res = PolyBuilderBuild(&r);
+    PolyBuilderDestroy(&r);
+    return res;
+}
+
+void PolyFma(Poly *acc, const Poly *p, const Poly *q){
+    Poly a[2] = {*acc, *p}, b[2] = {PolyFromCoeff(1), *q};
+    Poly res = PolyDot(2, a, b);
+    if (PolyMemFailed()) {
+        PolyDestroy(&res);
+        return ;
+    }
+    PolyDestroy(acc);
+    *acc = res;
+}
+
+/**
+ * Obliczone potęgi wstawianego wielomianu, uporządkowane rosnąco
+ * według wykładnika.
+ */
+typedef struct PowCache {
+    const Poly *q; ///< podstawa
+    size_t count; ///< liczba potęg
+    size_t size; ///< rozmiar tablic
+    poly_exp_t *exps; ///< wykładniki
+    Poly *pows; ///< potęgi
+} PowCache;
+
+/**
+ * Inicjuje pamięć potęg zawierającą @f$q^0@f$.
+ * @param[out] c : pamięć potęg
+ * @param[in] q : podstawa
+ */
+static void PowCacheInit(PowCache *c, const Poly *q){
+    c->q = q;
+    c->count = 1;
+    c->size = 1;
+    c->exps = malloc(sizeof(poly_exp_t));
+    c->pows = malloc(sizeof(Poly));
+    assert(c->exps != NULL && c->pows != NULL);
+    c->exps[0] = 0;
+    c->pows[0] = PolyFromCoeff(1);
+}
+
+/**
+ * Zwalnia pamięć potęg.
+ * @param[in] c : pamięć potęg
+ */
+static void PowCacheDestroy(PowCache *c){
+    for (size_t i = 0; i < c->count; i++)
+        PolyDestroy(&c->pows[i]);
+    free(c->exps);
+    free(c->pows);
+}
+
+/**
+ * Wyszukuje potęgę w pamięci, a jeśli jej brak, wylicza ją z największej
+ * mniejszej potęgi w pamięci i dodaje.
+ * @param[in] c : pamięć potęg
+ * @param[in] e : wykładnik
+ * @return indeks potęgi w pamięci, ważny do dodania kolejnej potęgi
+ */
+static size_t PowCacheGet(PowCache *c, poly_exp_t e){
+    size_t lo = 0, hi = c->count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (c->exps[mid] <= e)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    if (c->exps[lo] == e)
+        return lo;
+    PolyDegCap none = {.total = -1};
+    Poly step = PolyPowTrunc(c->q, e - c->exps[lo], &none);
+    Poly pow = PolyMul(&c->pows[lo], &step);
+    PolyDestroy(&step);
+    if (c->count == c->size) {
+        c->size *= 2;
+        c->exps = realloc(c->exps, c->size * sizeof(poly_exp_t));
+        c->pows = realloc(c->pows, c->size * sizeof(Poly));
+        assert(c->exps != NULL && c->pows != NULL);
+    }
+    memmove(c->exps + lo + 2, c->exps + lo + 1,
+            (c->count - lo - 1) * sizeof(poly_exp_t));
+    memmove(c->pows + lo + 2, c->pows + lo + 1,
+            (c->count - lo - 1) * sizeof(Poly));
+    c->exps[lo + 1] = e;
+    c->pows[lo + 1] = pow;
+    c->count++;
+    return lo + 1;
+}
+
+/**
+ * Wylicza @f$\sum_m c_m q^{e_m}@f$ po jednomianach @f$c_m x_0^{e_m}@f$
+ * wielomianu jednym PolyDot. Współczynniki nie są kopiowane: czynniki
+ * są widokami, w których @f$c_m@f$ jest podpięty pod jednomian
+ * z wykładnikiem 0.
+ * @param[in] p : wielomian niebędący współczynnikiem
+ * @param[in] cache : potęgi wstawianego wielomianu
+ * @return wynik podstawienia
+ */
+static Poly SubstLevel(const Poly *p, PowCache *cache){
+    size_t len = 0, k = 0;
+    for (Mono *m = p->first; m != NULL; m = m->next)
+        len++;
+    Mono *wraps = malloc(len * sizeof(Mono));
+    Poly *a = malloc(len * sizeof(Poly)), *b = malloc(len * sizeof(Poly));
+    poly_exp_t *exps = malloc(len * sizeof(poly_exp_t));
+    assert(wraps != NULL && a != NULL && b != NULL && exps != NULL);
+    for (Mono *m = p->first; m != NULL; m = m->next, k++) {
+        wraps[k] = (Mono) {.p = m->p, .exp = 0, .next = NULL};
+        a[k] = PolyIsCoeff(&m->p) ? m->p : (Poly) {.first = &wraps[k]};
+        exps[k] = m->exp;
+        PowCacheGet(cache, m->exp);
+    }
+    for (k = 0; k < len; k++)
+        b[k] = cache->pows[PowCacheGet(cache, exps[k])];
+    Poly res = PolyDot(len, a, b);
+    free(wraps);
+    free(a);
+    free(b);
+    free(exps);
+    return res;
+}
+
+/**
+ * Podstawia za zmienną na głębokości @p depth, kopiując strukturalnie
+ * poziomy powyżej. Wstawiany wielomian nie zależy od zmiennych wyższych
+ * poziomów.
+ * @param[in] p : wielomian
+ * @param[in] depth : głębokość zmiennej względem @p p
+ * @param[in] cache : potęgi wstawianego wielomianu w układzie zmiennych
+ * tej głębokości
+ * @return wynik podstawienia
+ */
+static Poly SubstLocal(const Poly *p, unsigned depth, PowCache *cache){
+    if (PolyIsCoeff(p))
+        return *p;
+    if (depth == 0)
+        return SubstLevel(p, cache);
+    Mono *first = NULL, **link = &first;
+    for (Mono *m = p->first; m != NULL && !PolyMemFailed(); m = m->next) {
+        Poly c = SubstLocal(&m->p, depth - 1, cache);
+        if (PolyIsZero(&c))
+            continue;
+        *link = MonoAlloc();
+        **link = (Mono) {.p = c, .exp = m->exp, .next = NULL};
+        link = &(*link)->next;
+    }
+    if (first != NULL && first->next == NULL && first->exp == 0
+        && PolyIsCoeff(&first->p)) {
+        Poly res = first->p;
+        MonoFree(first);
+        return res;
+    }
+    return first != NULL ? (Poly) {.coeff = 0, .first = first} : PolyZero();
+}
+
+/**
+ * Składniki sumy, do której sprowadza się podstawienie wielomianu
+ * zależnego od zmiennych wyższych poziomów.
+ */
+typedef struct SubstTerms {
+    size_t count; ///< liczba składników
+    Mono *chains; ///< jednomiany widoków czynników
+    size_t used; ///< liczba użytych jednomianów @p chains
+    Poly *a; ///< czynniki: widoki współczynników z wykładnikami ścieżki
+    poly_exp_t *pow; ///< wykładniki potęg wstawianego wielomianu
+} SubstTerms;
+
+/**
+ * Dodaje składnik sumy. Jeśli tablice składników nie są jeszcze
+ * przydzielone, składnik jest tylko liczony.
+ * @param[in] t : składniki
+ * @param[in] path : wykładniki kolejnych poziomów widoku
+ * @param[in] levels : liczba poziomów widoku
+ * @param[in] inner : współczynnik podpinany pod ostatni poziom
+ * @param[in] pow : wykładnik potęgi wstawianego wielomianu
+ */
+static void SubstAdd(SubstTerms *t, const poly_exp_t path[], unsigned levels,
+                     const Poly *inner, poly_exp_t pow){
+    if (t->a != NULL) {
+        Mono *chain = t->chains + t->used;
+        for (unsigned l = 0; l < levels; l++)
+            chain[l] = (Mono) {.p = l + 1 < levels
+                                    ? (Poly) {.first = &chain[l + 1]}
+                                    : *inner,
+                               .exp = path[l], .next = NULL};
+        t->a[t->count] = levels > 0 ? (Poly) {.first = chain} : *inner;
+        t->pow[t->count] = pow;
+    }
+    t->used += levels;
+    t->count++;
+}
+
+/**
+ * Przechodzi wielomian do głębokości podstawianej zmiennej i dodaje
+ * składniki sumy: współczynniki niezależne od tej zmiennej z potęgą 0
+ * oraz współczynniki jej jednomianów z potęgą ich wykładnika.
+ * @param[in] p : wielomian
+ * @param[in] depth : głębokość @p p
+ * @param[in] var : głębokość podstawianej zmiennej
+ * @param[in] path : wykładniki na ścieżce od korzenia
+ * @param[in] t : składniki
+ */
+static void SubstCollect(const Poly *p, unsigned depth, unsigned var,
+                         poly_exp_t path[], SubstTerms *t){
+    if (PolyIsZero(p))
+        return ;
+    if (PolyIsCoeff(p)) {
+        SubstAdd(t, path, depth, p, 0);
+        return ;
+    }
+    for (Mono *m = p->first; m != NULL; m = m->next) {
+        if (depth < var) {
+            path[depth] = m->exp;
+            SubstCollect(&m->p, depth + 1, var, path, t);
+        }
+        else {
+            path[var] = 0;
+            SubstAdd(t, path, var + 1, &m->p, m->exp);
+        }
+    }
+}
+
+/**
+ * Porównuje wykładniki dla qsort.
+ * @param[in] a : wskaźnik na wykładnik
+ * @param[in] b : wskaźnik na wykładnik
+ * @return wynik ujemny, zero lub dodatni
+ */
+static int ExpCmp(const void *a, const void *b){
+    poly_exp_t x = *(const poly_exp_t *) a, y = *(const poly_exp_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Podstawia wielomian zależny od zmiennych wyższych poziomów. Każda
+ * ścieżka do współczynnika podstawianej zmiennej daje czynnik - widok
+ * współczynnika z wykładnikami ścieżki - mnożony przez potęgę @p q,
+ * a cała suma jest liczona jednym PolyDot. Potęgi są wyliczane
+ * w kolejności rosnących wykładników, każda z poprzedniej.
+ * @param[in] p : wielomian
+ * @param[in] var : numer zmiennej
+ * @param[in] q : wstawiany wielomian
+ * @return wynik podstawienia
+ */
+static Poly SubstGlobal(const Poly *p, unsigned var, const Poly *q){
+    poly_exp_t *path = malloc((var + 1) * sizeof(poly_exp_t));
+    assert(path != NULL);
+    SubstTerms t = {0};
+    SubstCollect(p, 0, var, path, &t);
+    assert(t.count <= UINT_MAX);
+    t.chains = malloc((t.used > 0 ? t.used : 1) * sizeof(Mono));
+    t.a = malloc((t.count > 0 ? t.count : 1) * sizeof(Poly));
+    t.pow = malloc((t.count > 0 ? t.count : 1) * sizeof(poly_exp_t));
+    Poly *b = malloc((t.count > 0 ? t.count : 1) * sizeof(Poly));
+    assert(t.chains != NULL && t.a != NULL && t.pow != NULL && b != NULL);
+    PowCache cache;
+    PowCacheInit(&cache, q);
+    t.count = t.used = 0;
+    SubstCollect(p, 0, var, path, &t);
+    poly_exp_t *sorted = malloc((t.count > 0 ? t.count : 1)
+                                * sizeof(poly_exp_t));
+    assert(sorted != NULL);
+    memcpy(sorted, t.pow, t.count * sizeof(poly_exp_t));
+    qsort(sorted, t.count, sizeof(poly_exp_t), ExpCmp);
+    for (size_t k = 0; k < t.count; k++)
+        PowCacheGet(&cache, sorted[k]);
+    free(sorted);
+    for (size_t k = 0; k < t.count; k++)
+        b[k] = cache.pows[PowCacheGet(&cache, t.pow[k])];
+    Poly res = PolyDot(t.count, t.a, b);
+    PowCacheDestroy(&cache);
+    free(path);
+    free(t.chains);
+    free(t.a);
+    free(t.pow);
+    free(b);
+    return res;
+}
+
+Poly PolySubst(const Poly *p, unsigned var_idx, const Poly *q){
+    if (PolyDepth(p) <= var_idx)
+        return PolyClone(p);
+    const Poly *local = q;
+    for (unsigned d = 0; d < var_idx && local != NULL; d++)
+        if (!PolyIsCoeff(local))
+            local = local->first->next == NULL && local->first->exp == 0
+                    ? &local->first->p : NULL;
+    Poly res;
+    if (local != NULL) {
+        PowCache cache;
+        PowCacheInit(&cache, local);
+        res = SubstLocal(p, var_idx, &cache);
+        PowCacheDestroy(&cache);
+    }
+    else {
+        res = SubstGlobal(p, var_idx, q);
+    }
+    if (PolyMemFailed()) {
+        PolyDestroy(&res);
+        return PolyZero();
+    }
+    return res;
+}
@@ -0,0 +1,104 @@
+/** @file
+   Interfejs operacji scalających iloczyny wielomianów składnik po składniku
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __POLY_SINK_H__
+#define __POLY_SINK_H__
+
+#include "poly_builder.h"
+
+/**
+ * Mnoży wielomiany i przekazuje odbiorcy kolejne składniki iloczynu
+ * w porządku, w jakim występują w wielomianie znormalizowanym
+ * (leksykograficznie po wykładnikach, najpierw po @f$x_0@f$), każdy
+ * wykładnik raz i bez zerowych współczynników. Iloczyn nie jest tworzony
+ * w pamięci: iloczyny składników są scalane kopcem z jednym strumieniem
+ * na składnik mniejszego czynnika, więc zajęta pamięć jest liniowa
+ * względem rozmiaru czynników.
+ * @param[in] p : wielomian
+ * @param[in] q : wielomian
+ * @param[in] fn : odbiorca składników
+ * @param[in] arg : argument odbiorcy
+ * @return czy odbiorca przyjął wszystkie składniki, a operacja nie
+ * została przerwana (PolyMemFailed)
+ */
+bool PolyMulSink(const Poly *p, const Poly *q, PolyTermFn fn, void *arg);
+
+/**
+ * Podnosi wielomian do potęgi i przekazuje odbiorcy kolejne składniki
+ * wyniku, jak PolyMulSink. W pamięci powstają tylko czynniki
+ * @f$p^{\lfloor n/2 \rfloor}@f$ i @f$p^{\lceil n/2 \rceil}@f$, więc
+ * zajęta pamięć rośnie z rozmiarem czynników: dla wielomianów rzadkich
+ * jest to około pierwiastka z rozmiaru wyniku, a dla gęstych, na przykład
+ * jednej zmiennej, rozmiar czynnika jest porównywalny z rozmiarem wyniku.
+ * @param[in] p : podstawa
+ * @param[in] exp : nieujemny wykładnik
+ * @param[in] fn : odbiorca składników
+ * @param[in] arg : argument odbiorcy
+ * @return czy odbiorca przyjął wszystkie składniki, a operacja nie
+ * została przerwana
+ */
+bool PolyPowSink(const Poly *p, poly_exp_t exp, PolyTermFn fn, void *arg);
+
+/**
+ * Wylicza PolyCompose i przekazuje odbiorcy kolejne składniki wyniku,
+ * jak PolyMulSink. Dla jednomianów @f$c_k x_0^{e_k}@f$ wielomianu @p p
+ * sumy częściowe @f$A_k = c_k + x[0]^{e_{k+1} - e_k} A_{k+1}@f$ są
+ * liczone schematem Hornera przez PolyFma, od najwyższego jednomianu.
+ * Ostatnia suma @f$x[0]^{e_0} c_0 + x[0]^{e_1} A_1@f$ nie powstaje
+ * w pamięci: jej składniki są scalane kopcem. Naraz w pamięci jest
+ * więc tylko bieżąca suma częściowa, jeden złożony współczynnik
+ * i potęgi @f$x[0]@f$, a nie osobna potęga dla każdego jednomianu.
+ * @param[in] p : zadany wielomian
+ * @param[in] count : liczba wielomianów w tablicy
+ * @param[in] x : tablica wstawianych wielomianów
+ * @param[in] fn : odbiorca składników
+ * @param[in] arg : argument odbiorcy
+ * @return czy odbiorca przyjął wszystkie składniki, a operacja nie
+ * została przerwana
+ */
+bool PolyComposeSink(const Poly *p, unsigned count, const Poly x[],
+                     PolyTermFn fn, void *arg);
+
+/**
+ * Wylicza sumę iloczynów @f$\sum_i a_i b_i@f$. Iloczyny nie są tworzone
+ * ani dodawane osobno: składniki wszystkich iloczynów są scalane jednym
+ * kopcem, jak w PolyMulSink, a wynik jest budowany raz.
+ * @param[in] k : liczba iloczynów
+ * @param[in] a : czynniki
+ * @param[in] b : czynniki
+ * @return @f$\sum_i a_i b_i@f$
+ */
+Poly PolyDot(unsigned k, const Poly a[], const Poly b[]);
+
+/**
+ * Dodaje iloczyn do akumulatora, scalając składniki akumulatora
+ * i iloczynu jak PolyDot. Gdy operacja zostanie przerwana
+ * (PolyMemFailed), akumulator się nie zmienia.
+ * @param[in] acc : akumulator
+ * @param[in] p : czynnik
+ * @param[in] q : czynnik
+ */
+void PolyFma(Poly *acc, const Poly *p, const Poly *q);
+
+/**
+ * Podstawia wielomian @p q za zmienną @f$x_{var\_idx}@f$, bez
+ * rozwijania PolyCompose na wszystkie zmienne. Potęgi @p q są liczone
+ * raz i zapamiętywane. Jeśli @p q nie zależy od zmiennych
+ * @f$x_0, \ldots, x_{var\_idx-1}@f$, poziomy powyżej podstawianej
+ * zmiennej są kopiowane strukturalnie, a każdy jej wielomian
+ * @f$\sum_e c_e x^e@f$ jest zastępowany przez PolyDot współczynników
+ * @f$c_e@f$ (bez ich kopiowania) i potęg @f$q^e@f$. W przeciwnym razie
+ * cały wynik jest jednym PolyDot po ścieżkach do tych współczynników.
+ * @param[in] p : wielomian
+ * @param[in] var_idx : numer zmiennej
+ * @param[in] q : wstawiany wielomian
+ * @return @f$p(x_0, \ldots, x_{var\_idx-1}, q, x_{var\_idx+1}, \ldots)@f$
+ */
+Poly PolySubst(const Poly *p, unsigned var_idx, const Poly *q);
+
+#endif /* __POLY_SINK_H__ */
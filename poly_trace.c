@@ -0,0 +1,79 @@
+/** @file
+   Implementacja zapisu śladu wykonania w formacie Chrome trace-event
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include "poly_trace.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+/** Największa głębokość zagnieżdżenia zapisywanych przedziałów */
+#define TRACE_MAX_DEPTH 8
+
+bool polyTraceOn = false;
+
+/**
+ * Wspólny stan zapisu śladu.
+ */
+static struct {
+    FILE *file; ///< plik śladu
+    long start; ///< czas otwarcia śladu
+    bool first; ///< czy nie zapisano jeszcze żadnego zdarzenia
+    atomic_uint threads; ///< liczba wątków, które zapisały zdarzenie
+} trace;
+
+/**
+ * Stan śladu wątku.
+ */
+static __thread struct {
+    unsigned tid; ///< numer wątku w śladzie (0 - jeszcze nie nadany)
+    unsigned depth; ///< liczba otwartych przedziałów
+} traceLocal;
+
+long PolyTraceNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+bool PolyTraceOpen(const char *path){
+    trace.file = fopen(path, "w");
+    if (trace.file == NULL)
+        return false;
+    fputs("[", trace.file);
+    trace.start = PolyTraceNow();
+    trace.first = true;
+    polyTraceOn = true;
+    return true;
+}
+
+void PolyTraceClose(){
+    if (trace.file == NULL)
+        return ;
+    polyTraceOn = false;
+    fputs("\n]\n", trace.file);
+    fclose(trace.file);
+    trace.file = NULL;
+}
+
+void PolyTraceEvent(const char *name, char phase, const char *args){
+    unsigned depth = phase == 'B' ? traceLocal.depth++ : --traceLocal.depth;
+    if (depth >= TRACE_MAX_DEPTH)
+        return ;
+    if (traceLocal.tid == 0)
+        traceLocal.tid = atomic_fetch_add(&trace.threads, 1) + 1;
+    long ns = PolyTraceNow() - trace.start;
+    flockfile(trace.file);
+    fprintf(trace.file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%ld.%03ld,"
+            "\"pid\":1,\"tid\":%u", trace.first ? "" : ",", name, phase,
+            ns / 1000, ns % 1000, traceLocal.tid);
+    if (args != NULL)
+        fprintf(trace.file, ",\"args\":%s", args);
+    fputs("}", trace.file);
+    trace.first = false;
+    funlockfile(trace.file);
+}
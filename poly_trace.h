@@ -0,0 +1,68 @@
+/** @file
+   Interfejs zapisu śladu wykonania w formacie Chrome trace-event
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __POLY_TRACE_H__
+#define __POLY_TRACE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Czy ślad jest zapisywany. Ustawiane tylko przez PolyTraceOpen
+ * i PolyTraceClose, przed uruchomieniem i po zakończeniu wątków
+ * liczących, więc odczyt nie wymaga synchronizacji.
+ */
+extern bool polyTraceOn;
+
+/**
+ * Rozpoczyna zapis śladu do pliku w formacie JSON odczytywanym przez
+ * chrome://tracing i Perfetto.
+ * @param[in] path : ścieżka pliku
+ * @return czy udało się otworzyć plik
+ */
+bool PolyTraceOpen(const char *path);
+
+/**
+ * Kończy zapis śladu i zamyka plik.
+ */
+void PolyTraceClose();
+
+/**
+ * Zwraca czas monotoniczny.
+ * @return czas w nanosekundach
+ */
+long PolyTraceNow();
+
+/**
+ * Zapisuje zdarzenie śladu bieżącego wątku. Zagnieżdżenie przedziałów
+ * jest ograniczone, głębsze zdarzenia są pomijane.
+ * @param[in] name : nazwa przedziału
+ * @param[in] phase : 'B' - początek, 'E' - koniec przedziału
+ * @param[in] args : obiekt JSON z argumentami zdarzenia lub NULL
+ */
+void PolyTraceEvent(const char *name, char phase, const char *args);
+
+/**
+ * Otwiera przedział śladu, jeśli ślad jest zapisywany.
+ * @param[in] name : nazwa przedziału
+ */
+static inline void PolyTraceBegin(const char *name) {
+    if (__builtin_expect(polyTraceOn, 0))
+        PolyTraceEvent(name, 'B', NULL);
+}
+
+/**
+ * Zamyka przedział śladu, jeśli ślad jest zapisywany.
+ * @param[in] name : nazwa przedziału
+ */
+static inline void PolyTraceEnd(const char *name) {
+    if (__builtin_expect(polyTraceOn, 0))
+        PolyTraceEvent(name, 'E', NULL);
+}
+
+#endif /* __POLY_TRACE_H__ */
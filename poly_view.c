@@ -0,0 +1,433 @@
+/** @file
+   Implementacja wielomianów tylko do odczytu mapowanych z pliku
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include "poly_view.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Znacznik na początku pliku */
+#define POLY_VIEW_MAGIC "POLYVIEW"
+
+/** Długość znacznika */
+#define POLY_VIEW_MAGIC_LEN 8
+
+/**
+ * Nagłówek pliku.
+ */
+typedef struct ViewHeader {
+    char magic[POLY_VIEW_MAGIC_LEN]; ///< znacznik
+    uint64_t version; ///< wersja układu
+    uint64_t root; ///< przesunięcie węzła korzenia
+} ViewHeader;
+
+/**
+ * Wpis jednomianu w węźle wielomianu.
+ */
+typedef struct ViewMono {
+    int32_t exp; ///< wykładnik
+    uint32_t isCoeff; ///< czy współczynnik jest stałą
+    int64_t value; ///< stała lub przesunięcie węzła współczynnika
+} ViewMono;
+
+/**
+ * Odwołanie do wielomianu w pliku: stała albo przesunięcie węzła.
+ */
+typedef struct ViewRef {
+    bool isCoeff; ///< czy wielomian jest stałą
+    int64_t value; ///< stała lub przesunięcie węzła
+} ViewRef;
+
+/**
+ * Zwraca liczbę jednomianów węzła.
+ * @param[in] v : widok wielomianu
+ * @param[in] off : przesunięcie węzła
+ * @return liczba jednomianów
+ */
+static inline uint64_t ViewCount(const PolyView *v, uint64_t off){
+    assert(off % sizeof(uint64_t) == 0 && off + sizeof(uint64_t) <= v->len);
+    return *(const uint64_t *) (v->base + off);
+}
+
+/**
+ * Zwraca tablicę jednomianów węzła.
+ * @param[in] v : widok wielomianu
+ * @param[in] off : przesunięcie węzła
+ * @return wskaźnik na pierwszy jednomian
+ */
+static inline const ViewMono *ViewMonos(const PolyView *v, uint64_t off){
+    const uint64_t count = ViewCount(v, off);
+    assert(count <= (v->len - off - sizeof(uint64_t)) / sizeof(ViewMono));
+    return (const ViewMono *) (v->base + off + sizeof(uint64_t));
+}
+
+/**
+ * Zwraca odwołanie do korzenia.
+ * @param[in] v : widok wielomianu
+ * @return odwołanie do korzenia
+ */
+static ViewRef ViewRoot(const PolyView *v){
+    if (ViewCount(v, v->root) == 0) {
+        assert(v->root + 2 * sizeof(uint64_t) <= v->len);
+        return (ViewRef) {.isCoeff = true,
+                          .value = *(const int64_t *) (v->base + v->root
+                                                      + sizeof(uint64_t))};
+    }
+    return (ViewRef) {.isCoeff = false, .value = (int64_t) v->root};
+}
+
+/**
+ * Zwraca odwołanie do współczynnika jednomianu.
+ * @param[in] m : jednomian
+ * @return odwołanie do współczynnika
+ */
+static inline ViewRef ViewMonoCoeff(const ViewMono *m){
+    return (ViewRef) {.isCoeff = m->isCoeff, .value = m->value};
+}
+
+/**
+ * Zapisuje węzeł wielomianu niebędącego stałą, poprzedzając go
+ * węzłami współczynników.
+ * @param[in] p : wielomian
+ * @param[in] f : plik
+ * @param[in,out] pos : bieżące przesunięcie w pliku
+ * @return przesunięcie zapisanego węzła
+ */
+static uint64_t ViewWriteNode(const Poly *p, FILE *f, uint64_t *pos){
+    uint64_t count = 0, i = 0, off;
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next)
+        count++;
+    ViewMono *monos = calloc(count, sizeof(ViewMono));
+    assert(monos != NULL);
+    for (Mono *tmp = p->first; tmp != NULL; tmp = tmp->next, i++) {
+        monos[i].exp = tmp->exp;
+        monos[i].isCoeff = PolyIsCoeff(&tmp->p);
+        if (monos[i].isCoeff)
+            monos[i].value = tmp->p.coeff;
+        else
+            monos[i].value = (int64_t) ViewWriteNode(&tmp->p, f, pos);
+    }
+    off = *pos;
+    fwrite(&count, sizeof(count), 1, f);
+    fwrite(monos, sizeof(ViewMono), count, f);
+    *pos += sizeof(count) + count * sizeof(ViewMono);
+    free(monos);
+    return off;
+}
+
+bool PolyViewWrite(const Poly *p, FILE *f){
+    ViewHeader header = {.version = POLY_VIEW_VERSION};
+    uint64_t pos = sizeof(header);
+    memcpy(header.magic, POLY_VIEW_MAGIC, POLY_VIEW_MAGIC_LEN);
+    fwrite(&header, sizeof(header), 1, f);
+    if (PolyIsCoeff(p)) {
+        uint64_t count = 0;
+        int64_t coeff = p->coeff;
+        header.root = pos;
+        fwrite(&count, sizeof(count), 1, f);
+        fwrite(&coeff, sizeof(coeff), 1, f);
+    }
+    else {
+        header.root = ViewWriteNode(p, f, &pos);
+    }
+    if (fseek(f, 0, SEEK_SET) != 0)
+        return false;
+    fwrite(&header, sizeof(header), 1, f);
+    return fflush(f) == 0 && !ferror(f);
+}
+
+bool PolyViewOpen(const char *path, PolyView *v){
+    struct stat st;
+    const ViewHeader *header;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(ViewHeader)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    header = map;
+    *v = (PolyView) {.base = map, .len = st.st_size, .root = header->root};
+    if (memcmp(header->magic, POLY_VIEW_MAGIC, POLY_VIEW_MAGIC_LEN) != 0
+        || header->version != POLY_VIEW_VERSION
+        || v->root % sizeof(uint64_t) != 0
+        || v->root < sizeof(ViewHeader)
+        || v->root > v->len - 2 * sizeof(uint64_t)
+        || *(const uint64_t *) (v->base + v->root)
+           > (v->len - v->root - sizeof(uint64_t)) / sizeof(ViewMono)) {
+        PolyViewClose(v);
+        return false;
+    }
+    return true;
+}
+
+bool PolyViewVerify(const PolyView *v){
+    uint64_t off = sizeof(ViewHeader), last = 0;
+    if (*(const uint64_t *) (v->base + v->root) == 0)
+        return v->root == off && v->len == off + 2 * sizeof(uint64_t);
+    unsigned char *starts = calloc(v->len / sizeof(uint64_t) / CHAR_BIT + 1, 1);
+    bool ok = starts != NULL;
+    while (ok && off < v->len) {
+        uint64_t count = 0;
+        ok = v->len - off >= sizeof(uint64_t);
+        if (ok) {
+            count = *(const uint64_t *) (v->base + off);
+            ok = count > 0 && count <= (v->len - off - sizeof(uint64_t))
+                                        / sizeof(ViewMono);
+        }
+        const ViewMono *monos = (const ViewMono *) (v->base + off
+                                                    + sizeof(uint64_t));
+        for (uint64_t i = 0; ok && i < count; i++) {
+            uint64_t child = (uint64_t) monos[i].value / sizeof(uint64_t);
+            ok = monos[i].exp >= 0 && monos[i].isCoeff <= 1
+                 && (i == 0 || monos[i].exp > monos[i - 1].exp)
+                 && (monos[i].isCoeff
+                     || (monos[i].value >= 0 && (uint64_t) monos[i].value < off
+                         && monos[i].value % sizeof(uint64_t) == 0
+                         && (starts[child / CHAR_BIT] >> child % CHAR_BIT) & 1));
+        }
+        uint64_t word = off / sizeof(uint64_t);
+        if (ok)
+            starts[word / CHAR_BIT] |= 1 << word % CHAR_BIT;
+        last = off;
+        off += sizeof(uint64_t) + count * sizeof(ViewMono);
+    }
+    free(starts);
+    return ok && off == v->len && last == v->root;
+}
+
+void PolyViewClose(PolyView *v){
+    munmap((void *) v->base, v->len);
+    *v = (PolyView) {.base = NULL, .len = 0, .root = 0};
+}
+
+/**
+ * Zamienia odwołanie na zwykły wielomian.
+ * @param[in] v : widok wielomianu
+ * @param[in] r : odwołanie
+ * @return wielomian
+ */
+static Poly ViewRefToPoly(const PolyView *v, ViewRef r){
+    if (r.isCoeff)
+        return PolyFromCoeff(r.value);
+    uint64_t count = ViewCount(v, r.value);
+    const ViewMono *monos = ViewMonos(v, r.value);
+    Mono *first = NULL, *last = NULL;
+    for (uint64_t i = 0; i < count; i++) {
+        Mono *new = MonoAlloc();
+        new->p = ViewRefToPoly(v, ViewMonoCoeff(&monos[i]));
+        new->exp = monos[i].exp;
+        if (last == NULL)
+            first = new;
+        else
+            last->next = new;
+        last = new;
+    }
+    return (Poly) {.first = first};
+}
+
+Poly PolyViewToPoly(const PolyView *v){
+    return ViewRefToPoly(v, ViewRoot(v));
+}
+
+/**
+ * Algorytm szybkiego potęgowania.
+ * @param[in] a : podstawa
+ * @param[in] n : wykładnik
+ * @return 'a^n'
+ */
+static poly_coeff_t CoeffPow(poly_coeff_t a, poly_exp_t n){
+    poly_coeff_t res = 1;
+    while (n > 0) {
+        if (n % 2 == 1)
+            res *= a;
+        a *= a;
+        n /= 2;
+    }
+    return res;
+}
+
+Poly PolyViewAt(const PolyView *v, poly_coeff_t x){
+    ViewRef root = ViewRoot(v);
+    if (root.isCoeff)
+        return PolyFromCoeff(root.value);
+    uint64_t count = ViewCount(v, root.value);
+    const ViewMono *monos = ViewMonos(v, root.value);
+    poly_coeff_t powRes = 1, constSum = 0;
+    poly_exp_t actExp = 0;
+    Poly res = PolyZero();
+    for (uint64_t i = 0; i < count; i++) {
+        powRes *= CoeffPow(x, monos[i].exp - actExp);
+        actExp = monos[i].exp;
+        if (monos[i].isCoeff) {
+            constSum += monos[i].value * powRes;
+            continue;
+        }
+        Poly coeff = ViewRefToPoly(v, ViewMonoCoeff(&monos[i]));
+        Poly mul = PolyFromCoeff(powRes);
+        Poly mulTmp = PolyMul(&coeff, &mul);
+        Poly addTmp = PolyAdd(&res, &mulTmp);
+        PolyDestroy(&coeff);
+        PolyDestroy(&mulTmp);
+        PolyDestroy(&res);
+        res = addTmp;
+    }
+    Poly constPoly = PolyFromCoeff(constSum);
+    Poly addTmp = PolyAdd(&res, &constPoly);
+    PolyDestroy(&res);
+    return addTmp;
+}
+
+/**
+ * Wylicza wartość wielomianu wskazywanego przez odwołanie.
+ * @param[in] v : widok wielomianu
+ * @param[in] r : odwołanie
+ * @param[in] depth : indeks zmiennej głównej wielomianu
+ * @param[in] count : liczba wartości w tablicy
+ * @param[in] x : wartości kolejnych zmiennych
+ * @return wartość wielomianu
+ */
+static poly_coeff_t ViewEval(const PolyView *v, ViewRef r, unsigned depth,
+                             unsigned count, const poly_coeff_t x[]){
+    if (r.isCoeff)
+        return r.value;
+    uint64_t len = ViewCount(v, r.value);
+    const ViewMono *monos = ViewMonos(v, r.value);
+    poly_coeff_t val = depth < count ? x[depth] : 0;
+    poly_coeff_t powRes = 1, res = 0;
+    poly_exp_t actExp = 0;
+    for (uint64_t i = 0; i < len; i++) {
+        powRes *= CoeffPow(val, monos[i].exp - actExp);
+        actExp = monos[i].exp;
+        res += powRes * ViewEval(v, ViewMonoCoeff(&monos[i]),
+                                 depth + 1, count, x);
+    }
+    return res;
+}
+
+poly_coeff_t PolyViewEval(const PolyView *v, unsigned count,
+                          const poly_coeff_t x[]){
+    return ViewEval(v, ViewRoot(v), 0, count, x);
+}
+
+/**
+ * Wylicza stopień wielomianu wskazywanego przez odwołanie.
+ * @param[in] v : widok wielomianu
+ * @param[in] r : odwołanie
+ * @return stopień wielomianu
+ */
+static poly_exp_t ViewDeg(const PolyView *v, ViewRef r){
+    if (r.isCoeff)
+        return r.value == 0 ? -1 : 0;
+    poly_exp_t deg = -1;
+    uint64_t count = ViewCount(v, r.value);
+    const ViewMono *monos = ViewMonos(v, r.value);
+    for (uint64_t i = 0; i < count; i++) {
+        poly_exp_t d = ViewDeg(v, ViewMonoCoeff(&monos[i])) + monos[i].exp;
+        if (d > deg)
+            deg = d;
+    }
+    return deg;
+}
+
+poly_exp_t PolyViewDeg(const PolyView *v){
+    return ViewDeg(v, ViewRoot(v));
+}
+
+/**
+ * Wylicza stopień wielomianu wskazywanego przez odwołanie
+ * ze względu na zadaną zmienną.
+ * @param[in] v : widok wielomianu
+ * @param[in] r : odwołanie
+ * @param[in] var_idx : indeks zmiennej
+ * @return stopień wielomianu
+ */
+static poly_exp_t ViewDegBy(const PolyView *v, ViewRef r, unsigned var_idx){
+    if (r.isCoeff)
+        return r.value == 0 ? -1 : 0;
+    uint64_t count = ViewCount(v, r.value);
+    const ViewMono *monos = ViewMonos(v, r.value);
+    if (var_idx == 0)
+        return monos[count - 1].exp;
+    poly_exp_t deg = -1;
+    for (uint64_t i = 0; i < count; i++) {
+        poly_exp_t d = ViewDegBy(v, ViewMonoCoeff(&monos[i]), var_idx - 1);
+        if (d > deg)
+            deg = d;
+    }
+    return deg;
+}
+
+poly_exp_t PolyViewDegBy(const PolyView *v, unsigned var_idx){
+    return ViewDegBy(v, ViewRoot(v), var_idx);
+}
+
+/**
+ * Porównuje wielomian wskazywany przez odwołanie ze zwykłym wielomianem.
+ * @param[in] v : widok wielomianu
+ * @param[in] r : odwołanie
+ * @param[in] q : wielomian
+ * @return czy wielomiany są równe
+ */
+static bool ViewIsEq(const PolyView *v, ViewRef r, const Poly *q){
+    if (r.isCoeff != PolyIsCoeff(q))
+        return false;
+    if (r.isCoeff)
+        return r.value == q->coeff;
+    uint64_t count = ViewCount(v, r.value), i = 0;
+    const ViewMono *monos = ViewMonos(v, r.value);
+    for (Mono *tmp = q->first; tmp != NULL; tmp = tmp->next, i++)
+        if (i == count || monos[i].exp != tmp->exp
+            || !ViewIsEq(v, ViewMonoCoeff(&monos[i]), &tmp->p))
+            return false;
+    return i == count;
+}
+
+bool PolyViewIsEq(const PolyView *v, const Poly *q){
+    return ViewIsEq(v, ViewRoot(v), q);
+}
+
+/**
+ * Porównuje wielomiany wskazywane przez odwołania do dwóch widoków.
+ * @param[in] v : widok wielomianu
+ * @param[in] r : odwołanie do @p v
+ * @param[in] w : widok wielomianu
+ * @param[in] s : odwołanie do @p w
+ * @return czy wielomiany są równe
+ */
+static bool ViewIsEqView(const PolyView *v, ViewRef r,
+                         const PolyView *w, ViewRef s){
+    if (r.isCoeff != s.isCoeff)
+        return false;
+    if (r.isCoeff)
+        return r.value == s.value;
+    uint64_t count = ViewCount(v, r.value);
+    if (count != ViewCount(w, s.value))
+        return false;
+    const ViewMono *rMonos = ViewMonos(v, r.value);
+    const ViewMono *sMonos = ViewMonos(w, s.value);
+    for (uint64_t i = 0; i < count; i++)
+        if (rMonos[i].exp != sMonos[i].exp
+            || !ViewIsEqView(v, ViewMonoCoeff(&rMonos[i]),
+                             w, ViewMonoCoeff(&sMonos[i])))
+            return false;
+    return true;
+}
+
+bool PolyViewIsEqView(const PolyView *v, const PolyView *w){
+    return ViewIsEqView(v, ViewRoot(v), w, ViewRoot(w));
+}
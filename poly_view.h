@@ -0,0 +1,134 @@
+/** @file
+   Interfejs wielomianów tylko do odczytu mapowanych z pliku
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __POLY_VIEW_H__
+#define __POLY_VIEW_H__
+
+#include "poly.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/** Wersja układu pliku zapisywana w nagłówku */
+#define POLY_VIEW_VERSION 1
+
+/**
+ * Wielomian zmapowany z pliku zapisanego przez PolyViewWrite.
+ * Plik nie zawiera wskaźników, tylko przesunięcia względem swojego
+ * początku, więc może być mapowany pod dowolny adres i współdzielony
+ * (przez pamięć podręczną stron) przez wiele procesów.
+ *
+ * Układ pliku (wszystkie pola wyrównane do 8 bajtów):
+ * - nagłówek: znacznik "POLYVIEW", wersja, przesunięcie korzenia;
+ * - węzeł wielomianu: liczba jednomianów n, po której następuje n wpisów
+ *   jednomianów posortowanych rosnąco po wykładniku;
+ * - wpis jednomianu: wykładnik, znacznik, czy współczynnik jest stałą,
+ *   oraz wartość stałej lub przesunięcie węzła współczynnika.
+ * Wielomian stały jest zapisywany jako węzeł z n = 0, po którym
+ * następuje jego wartość.
+ */
+typedef struct PolyView {
+    const unsigned char *base; ///< początek zmapowanego pliku
+    size_t len; ///< długość pliku
+    uint64_t root; ///< przesunięcie węzła korzenia
+} PolyView;
+
+/**
+ * Zapisuje wielomian w układzie przeznaczonym do mapowania.
+ * @param[in] p : wielomian
+ * @param[in] f : plik otwarty do zapisu
+ * @return czy zapis się powiódł
+ */
+bool PolyViewWrite(const Poly *p, FILE *f);
+
+/**
+ * Mapuje plik zapisany przez PolyViewWrite. Sprawdzane są tylko nagłówek
+ * i położenie węzła korzenia, więc czas otwarcia nie zależy od rozmiaru
+ * wielomianu. Pliku z niezaufanego źródła należy przed odczytem sprawdzić
+ * przez PolyViewVerify.
+ * @param[in] path : ścieżka do pliku
+ * @param[out] v : widok wielomianu
+ * @return czy otwarcie się powiodło
+ */
+bool PolyViewOpen(const char *path, PolyView *v);
+
+/**
+ * Sprawdza cały zmapowany plik jednym sekwencyjnym odczytem. Za nagłówkiem
+ * leżą kolejno węzły, z których ostatni jest korzeniem, a każdy węzeł jest
+ * zapisany po węzłach swoich współczynników. Dla każdego węzła sprawdzane
+ * jest, czy mieści się w pliku, czy wykładniki jego jednomianów rosną i czy
+ * węzły współczynników są wcześniejszymi węzłami pliku. Odczyt pliku, który
+ * przeszedł sprawdzenie, nie wychodzi więc poza plik ani się nie zapętla.
+ * @param[in] v : widok wielomianu
+ * @return czy plik jest poprawny
+ */
+bool PolyViewVerify(const PolyView *v);
+
+/**
+ * Usuwa mapowanie pliku.
+ * @param[in] v : widok wielomianu
+ */
+void PolyViewClose(PolyView *v);
+
+/**
+ * Tworzy zwykły wielomian o tej samej wartości co widok.
+ * @param[in] v : widok wielomianu
+ * @return wielomian
+ */
+Poly PolyViewToPoly(const PolyView *v);
+
+/**
+ * Działa jak PolyAt dla zmapowanego wielomianu.
+ * @param[in] v : widok wielomianu
+ * @param[in] x : wartość podstawiana pod zmienną główną
+ * @return @f$p(x, x_0, x_1, \ldots)@f$
+ */
+Poly PolyViewAt(const PolyView *v, poly_coeff_t x);
+
+/**
+ * Wylicza wartość wielomianu po podstawieniu liczby pod każdą zmienną.
+ * Zmienne o indeksie niemniejszym niż @p count przyjmują wartość 0.
+ * @param[in] v : widok wielomianu
+ * @param[in] count : liczba wartości w tablicy
+ * @param[in] x : wartości kolejnych zmiennych
+ * @return wartość wielomianu
+ */
+poly_coeff_t PolyViewEval(const PolyView *v, unsigned count,
+                          const poly_coeff_t x[]);
+
+/**
+ * Działa jak PolyDeg dla zmapowanego wielomianu.
+ * @param[in] v : widok wielomianu
+ * @return stopień wielomianu
+ */
+poly_exp_t PolyViewDeg(const PolyView *v);
+
+/**
+ * Działa jak PolyDegBy dla zmapowanego wielomianu.
+ * @param[in] v : widok wielomianu
+ * @param[in] var_idx : indeks zmiennej
+ * @return stopień wielomianu ze względu na zmienną o indeksie @p var_idx
+ */
+poly_exp_t PolyViewDegBy(const PolyView *v, unsigned var_idx);
+
+/**
+ * Sprawdza równość zmapowanego wielomianu ze zwykłym wielomianem.
+ * @param[in] v : widok wielomianu
+ * @param[in] q : wielomian
+ * @return `v = q`
+ */
+bool PolyViewIsEq(const PolyView *v, const Poly *q);
+
+/**
+ * Sprawdza równość dwóch zmapowanych wielomianów.
+ * @param[in] v : widok wielomianu
+ * @param[in] w : widok wielomianu
+ * @return `v = w`
+ */
+bool PolyViewIsEqView(const PolyView *v, const PolyView *w);
+
+#endif /* __POLY_VIEW_H__ */
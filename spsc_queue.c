@@ -0,0 +1,68 @@
+/** @file
+   Implementacja ograniczonej kolejki jeden producent - jeden konsument
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#include "spsc_queue.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Liczba prób oddania procesora, po której wątek zaczyna zasypiać */
+#define SPIN_LIMIT 64
+
+/** Czas drzemki wątku czekającego na kolejkę (w nanosekundach) */
+#define NAP_NSEC 50000
+
+/**
+ * Czeka chwilę na drugi wątek; najpierw oddaje procesor,
+ * a po SPIN_LIMIT próbach zasypia na krótko.
+ * @param[in,out] spins : liczba dotychczasowych prób
+ */
+static void Backoff(unsigned *spins){
+    if (++*spins < SPIN_LIMIT) {
+        sched_yield();
+    }
+    else {
+        struct timespec nap = {.tv_sec = 0, .tv_nsec = NAP_NSEC};
+        nanosleep(&nap, NULL);
+    }
+}
+
+void SpscInit(SpscQueue *q, size_t capacity, size_t elemSize){
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->mask = capacity - 1;
+    q->elemSize = elemSize;
+    q->data = malloc(capacity * elemSize);
+    assert(q->data != NULL);
+}
+
+void SpscDestroy(SpscQueue *q){
+    free(q->data);
+    q->data = NULL;
+}
+
+void SpscPush(SpscQueue *q, const void *elem){
+    unsigned spins = 0;
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&q->head, memory_order_acquire) > q->mask)
+        Backoff(&spins);
+    memcpy(q->data + (tail & q->mask) * q->elemSize, elem, q->elemSize);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+void SpscPop(SpscQueue *q, void *elem){
+    unsigned spins = 0;
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    while (atomic_load_explicit(&q->tail, memory_order_acquire) == head)
+        Backoff(&spins);
+    memcpy(elem, q->data + (head & q->mask) * q->elemSize, q->elemSize);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
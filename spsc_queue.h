@@ -0,0 +1,59 @@
+/** @file
+   Interfejs ograniczonej kolejki jeden producent - jeden konsument
+
+   @author Mateusz Biegański
+   @copyright Mateusz Biegański
+   @date 2017-06-15
+*/
+
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Kolejka o stałej pojemności, bez blokad, dla dokładnie jednego wątku
+ * wstawiającego i jednego wątku zdejmującego elementy.
+ * Elementy są kopiowane do i z kolejki.
+ */
+typedef struct SpscQueue {
+    _Atomic size_t head; ///< liczba zdjętych elementów
+    char padHead[64 - sizeof(size_t)]; ///< rozdziela liczniki w pamięci podręcznej
+    _Atomic size_t tail; ///< liczba wstawionych elementów
+    char padTail[64 - sizeof(size_t)]; ///< rozdziela liczniki w pamięci podręcznej
+    size_t mask; ///< pojemność pomniejszona o jeden
+    size_t elemSize; ///< rozmiar elementu
+    unsigned char *data; ///< bufor cykliczny
+} SpscQueue;
+
+/**
+ * Inicjuje kolejkę.
+ * @param[in] q : kolejka
+ * @param[in] capacity : pojemność, musi być potęgą dwójki
+ * @param[in] elemSize : rozmiar elementu
+ */
+void SpscInit(SpscQueue *q, size_t capacity, size_t elemSize);
+
+/**
+ * Zwalnia pamięć kolejki.
+ * @param[in] q : kolejka
+ */
+void SpscDestroy(SpscQueue *q);
+
+/**
+ * Wstawia element, czekając, jeśli kolejka jest pełna.
+ * @param[in] q : kolejka
+ * @param[in] elem : wskaźnik na wstawiany element
+ */
+void SpscPush(SpscQueue *q, const void *elem);
+
+/**
+ * Zdejmuje element, czekając, jeśli kolejka jest pusta.
+ * @param[in] q : kolejka
+ * @param[out] elem : miejsce na zdjęty element
+ */
+void SpscPop(SpscQueue *q, void *elem);
+
+#endif /* __SPSC_QUEUE_H__ */
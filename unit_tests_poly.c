@@ -1,20 +1,33 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <setjmp.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "calc_poly.h"
 #include "poly.h"
+#include "poly_io.h"
+#include "poly_builder.h"
+#include "poly_extmul.h"
+#include "poly_sink.h"
+#include "poly_view.h"
 #include "cmocka.h"
 
 static jmp_buf jmp_at_exit;
 static int exit_status;
 
-extern int calculator_main();
+extern int calculator_main(int argc, char *argv[]);
 
 
 int mock_main() {
+    char *argv[] = {"calc_poly", NULL};
     if (!setjmp(jmp_at_exit))
-        return calculator_main();
+        return calculator_main(1, argv);
     return exit_status;
 }
 
@@ -75,6 +88,17 @@ int mock_printf(const char *format, ...) {
 }
 
 
+size_t mock_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
+    size_t len = size * nmemb;
+
+    assert_true(stream == stdout);
+    assert_true(printf_position + len < sizeof(printf_buffer));
+    memcpy(printf_buffer + printf_position, ptr, len);
+    printf_position += len;
+    return nmemb;
+}
+
+
 /**
  * Buffers for functions using stdin.
  */
@@ -106,20 +130,23 @@ int mock_scanf(const char *format, ...) {
 }
 
 
-int mock_getchar() {
-    if (input_stream_position < input_stream_end)
-        return input_stream_buffer[input_stream_position++];
-    else
-        return EOF;
+size_t mock_fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
+    size_t len = size * nmemb;
+    assert_true(stream == stdin);
+    if (len > (size_t)(input_stream_end - input_stream_position))
+        len = input_stream_end - input_stream_position;
+    memcpy(ptr, input_stream_buffer + input_stream_position, len);
+    input_stream_position += len;
+    return len / size;
 }
 
 
-int mock_ungetc(int c, FILE *stream) {
-    assert_true(stream == stdin);
-    if (input_stream_position > 0)
-        return input_stream_buffer[--input_stream_position] = c;
-    else
-        return EOF;
+/**
+ * Input is never a regular file, so calculator reads it through mock_fread.
+ */
+int mock_fileno(FILE *stream) {
+    (void) stream;
+    return -1;
 }
 
 
@@ -258,6 +285,597 @@ static void test_polyvarzero_countone_polyvarzero(void **state) {
     PolyDestroy(&res);
 }
 
+/**
+ * PolyShift on x_0^2 - 4x_0 + 4 by 2 gives x_0^2.
+ */
+static void test_polyshift_square(void **state) {
+    (void) state;
+    Poly p1 = PolyFromCoeff(1);
+    Mono m1 = MonoFromPoly(&p1, 2);
+    Poly p2 = PolyFromCoeff(-4);
+    Mono m2 = MonoFromPoly(&p2, 1);
+    Poly p3 = PolyFromCoeff(4);
+    Mono m3 = MonoFromPoly(&p3, 0);
+    Mono monos1[] = {m1, m2, m3};
+    Poly p = PolyAddMonos(3, monos1);
+    Poly p4 = PolyFromCoeff(1);
+    Mono m4 = MonoFromPoly(&p4, 2);
+    Poly test = PolyAddMonos(1, &m4);
+    Poly res = PolyShift(&p, 2);
+    assert_true(PolyIsEq(&res, &test));
+    PolyDestroy(&p);
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+}
+
+/**
+ * PolySerialize followed by PolyDeserialize gives the same polynomial.
+ */
+static void test_polyserialize_roundtrip(void **state) {
+    (void) state;
+    Poly p1 = PolyFromCoeff(-3);
+    Mono m1 = MonoFromPoly(&p1, 5);
+    Poly p2 = PolyAddMonos(1, &m1);
+    Mono m2 = MonoFromPoly(&p2, 2);
+    Poly p3 = PolyFromCoeff(7);
+    Mono m3 = MonoFromPoly(&p3, 0);
+    Mono monos[] = {m2, m3};
+    Poly p = PolyAddMonos(2, monos);
+    Poly res;
+    FILE *f = tmpfile();
+    assert_non_null(f);
+    assert_true(PolySerialize(&p, f));
+    rewind(f);
+    assert_true(PolyDeserialize(f, &res));
+    assert_true(PolyIsEq(&res, &p));
+    fclose(f);
+    PolyDestroy(&p);
+    PolyDestroy(&res);
+}
+
+/**
+ * Deserializes a header followed by the given body.
+ */
+static bool deserialize_raw(const unsigned char *body, size_t size,
+                            size_t repeat, const unsigned char *tail,
+                            size_t tailSize) {
+    FILE *f = tmpfile();
+    assert_non_null(f);
+    fputs("POLY", f);
+    putc(POLY_IO_VERSION, f);
+    for (size_t i = 0; i < repeat; i++)
+        fwrite(body, 1, size, f);
+    fwrite(tail, 1, tailSize, f);
+    rewind(f);
+    Poly res;
+    bool ok = PolyDeserialize(f, &res);
+    fclose(f);
+    if (!ok)
+        assert_true(PolyIsZero(&res));
+    PolyDestroy(&res);
+    return ok;
+}
+
+/**
+ * PolyDeserialize rejects a lone constant term of exponent 0 and nesting
+ * deeper than POLY_IO_MAX_DEPTH.
+ */
+static void test_polydeserialize_malformed(void **state) {
+    (void) state;
+    const unsigned char mono[] = {1, 0}, var[] = {1, 3};
+    const unsigned char coeff[] = {0, 10}, nested[] = {1, 3, 0, 10};
+    assert_false(deserialize_raw(mono, sizeof(mono), 1, coeff, sizeof(coeff)));
+    assert_true(deserialize_raw(mono, sizeof(mono), 1,
+                                nested, sizeof(nested)));
+    assert_true(deserialize_raw(var, sizeof(var), POLY_IO_MAX_DEPTH,
+                                coeff, sizeof(coeff)));
+    assert_false(deserialize_raw(var, sizeof(var), POLY_IO_MAX_DEPTH + 1,
+                                 coeff, sizeof(coeff)));
+}
+
+/**
+ * PolyBuilder sums duplicate terms and drops the ones that cancel out.
+ */
+static void test_polybuilder_duplicates(void **state) {
+    (void) state;
+    PolyBuilder b;
+    poly_exp_t e1[] = {0, 1}, e2[] = {0, 0}, e3[] = {2, 0};
+    PolyBuilderInit(&b, 2);
+    PolyBuilderAdd(&b, 2, e1);
+    PolyBuilderAdd(&b, 4, e3);
+    PolyBuilderAdd(&b, 5, e2);
+    PolyBuilderAdd(&b, 1, e1);
+    PolyBuilderAdd(&b, -4, e3);
+    Poly res = PolyBuilderBuild(&b);
+    Poly p1 = PolyFromCoeff(5);
+    Mono m1 = MonoFromPoly(&p1, 0);
+    Poly p2 = PolyFromCoeff(3);
+    Mono m2 = MonoFromPoly(&p2, 1);
+    Mono monos[] = {m2, m1};
+    Poly p3 = PolyAddMonos(2, monos);
+    Mono m3 = MonoFromPoly(&p3, 0);
+    Poly test = PolyAddMonos(1, &m3);
+    assert_true(PolyIsEq(&res, &test));
+    PolyDestroy(&res);
+    PolyDestroy(&test);
+    PolyBuilderDestroy(&b);
+}
+
+/**
+ * Builds a two-variable polynomial of 60 terms with repeated exponents.
+ */
+static Poly build_test_poly(void) {
+    PolyBuilder b;
+    poly_exp_t e[2];
+    PolyBuilderInit(&b, 2);
+    for (int i = 0; i < 60; i++) {
+        e[0] = i % 7;
+        e[1] = (i * 5) % 11;
+        PolyBuilderAdd(&b, i % 5 - 2, e);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    PolyBuilderDestroy(&b);
+    return p;
+}
+
+/**
+ * PolyMulExternal split into several runs gives the same product as PolyMul.
+ */
+static void test_polymulexternal_runs(void **state) {
+    (void) state;
+    Poly p = build_test_poly();
+    Poly test = PolyMul(&p, &p);
+    Poly res;
+    FILE *f = tmpfile();
+    assert_non_null(f);
+    assert_true(PolyMulExternal(&p, &p, 0, f));
+    rewind(f);
+    assert_true(PolyDeserialize(f, &res));
+    assert_true(PolyIsEq(&res, &test));
+    fclose(f);
+    PolyDestroy(&p);
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+}
+
+/**
+ * Writes a polynomial with PolyViewWrite to a new temporary file.
+ */
+static FILE *write_view(const Poly *p, char *path) {
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    FILE *f = fdopen(fd, "w+b");
+    assert_non_null(f);
+    assert_true(PolyViewWrite(p, f));
+    return f;
+}
+
+/**
+ * A mapped view answers At, Deg, DegBy and IsEq like the polynomial.
+ */
+static void test_polyview_roundtrip(void **state) {
+    (void) state;
+    char path[] = "/tmp/unit_tests_polyXXXXXX";
+    Poly p = build_test_poly();
+    Poly other = PolyFromCoeff(5);
+    PolyView v;
+    fclose(write_view(&p, path));
+    assert_true(PolyViewOpen(path, &v));
+    assert_true(PolyViewVerify(&v));
+    Poly at = PolyAt(&p, 3);
+    Poly viewAt = PolyViewAt(&v, 3);
+    Poly copy = PolyViewToPoly(&v);
+    assert_true(PolyIsEq(&viewAt, &at));
+    assert_true(PolyIsEq(&copy, &p));
+    assert_int_equal(PolyViewDeg(&v), PolyDeg(&p));
+    assert_int_equal(PolyViewDegBy(&v, 0), PolyDegBy(&p, 0));
+    assert_int_equal(PolyViewDegBy(&v, 1), PolyDegBy(&p, 1));
+    assert_int_equal(PolyViewDegBy(&v, 2), PolyDegBy(&p, 2));
+    assert_true(PolyViewIsEq(&v, &p));
+    assert_false(PolyViewIsEq(&v, &other));
+    PolyViewClose(&v);
+    unlink(path);
+    PolyDestroy(&p);
+    PolyDestroy(&at);
+    PolyDestroy(&viewAt);
+    PolyDestroy(&copy);
+}
+
+/**
+ * PolyViewOpen rejects a truncated file, PolyViewVerify rejects a node
+ * pointing at itself.
+ */
+static void test_polyview_corrupt(void **state) {
+    (void) state;
+    char path[] = "/tmp/unit_tests_polyXXXXXX";
+    Poly p = build_test_poly();
+    PolyView v;
+    uint64_t root, len;
+    FILE *f = write_view(&p, path);
+    assert_int_equal(fseek(f, 0, SEEK_END), 0);
+    len = ftell(f);
+    assert_int_equal(ftruncate(fileno(f), len - sizeof(uint64_t)), 0);
+    assert_false(PolyViewOpen(path, &v));
+    assert_int_equal(ftruncate(fileno(f), 0), 0);
+    rewind(f);
+    assert_true(PolyViewWrite(&p, f));
+    assert_int_equal(fseek(f, 2 * sizeof(uint64_t), SEEK_SET), 0);
+    assert_int_equal(fread(&root, sizeof(root), 1, f), 1);
+    assert_true(PolyViewOpen(path, &v));
+    assert_true(PolyViewVerify(&v));
+    PolyViewClose(&v);
+    /* value of the first mono entry of the root node */
+    assert_int_equal(fseek(f, root + 2 * sizeof(uint64_t), SEEK_SET), 0);
+    assert_int_equal(fwrite(&root, sizeof(root), 1, f), 1);
+    fclose(f);
+    assert_true(PolyViewOpen(path, &v));
+    assert_false(PolyViewVerify(&v));
+    PolyViewClose(&v);
+    unlink(path);
+    PolyDestroy(&p);
+}
+
+/**
+ * PolyMulTrunc gives the same result as truncating the full product.
+ */
+static void test_polymultrunc(void **state) {
+    (void) state;
+    PolyBuilder b;
+    poly_exp_t e[2], vars[] = {3};
+    PolyBuilderInit(&b, 2);
+    for (int i = 0; i < 30; i++) {
+        e[0] = i % 6;
+        e[1] = (i * 3) % 7;
+        PolyBuilderAdd(&b, i % 5 - 2, e);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    PolyDegCap cap = {.total = 6, .count = 1, .vars = vars};
+    Poly full = PolyMul(&p, &p);
+    Poly test = PolyTrunc(&full, &cap);
+    Poly res = PolyMulTrunc(&p, &p, &cap);
+    assert_true(PolyIsEq(&res, &test));
+    assert_true(PolyDeg(&res) <= 6);
+    assert_true(PolyDegBy(&res, 0) <= 3);
+    PolyDestroy(&p);
+    PolyDestroy(&full);
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+    PolyBuilderDestroy(&b);
+}
+
+/**
+ * PolyPermuteVars swaps exponents and is undone by the inverse permutation.
+ */
+static void test_polypermutevars(void **state) {
+    (void) state;
+    PolyBuilder b, c;
+    poly_exp_t e[3];
+    unsigned perm[] = {2, 0, 1}, inv[] = {1, 2, 0};
+    PolyBuilderInit(&b, 3);
+    PolyBuilderInit(&c, 3);
+    for (int i = 0; i < 20; i++) {
+        e[0] = i % 4;
+        e[1] = (i * 3) % 5;
+        e[2] = i % 2;
+        PolyBuilderAdd(&b, i - 7, e);
+        poly_exp_t f[] = {e[1], e[2], e[0]};
+        PolyBuilderAdd(&c, i - 7, f);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    Poly test = PolyBuilderBuild(&c);
+    Poly res = PolyPermuteVars(&p, 3, perm);
+    Poly back = PolyPermuteVars(&res, 3, inv);
+    assert_true(PolyIsEq(&res, &test));
+    assert_true(PolyIsEq(&back, &p));
+    PolyDestroy(&p);
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+    PolyDestroy(&back);
+    PolyBuilderDestroy(&b);
+    PolyBuilderDestroy(&c);
+}
+
+/**
+ * PolyMul past its deadline returns zero and leaves the operands intact.
+ */
+static void test_polymul_deadline(void **state) {
+    (void) state;
+    Poly p = build_test_poly();
+    Poly copy = PolyClone(&p);
+    PolyMemClearError();
+    PolySetDeadline(1);
+    Poly res = PolyMul(&p, &p);
+    PolySetDeadline(0);
+    assert_true(PolyMemFailed());
+    assert_int_equal(PolyStopReason(), POLY_STOP_DEADLINE);
+    assert_true(PolyIsZero(&res));
+    assert_true(PolyIsEq(&p, &copy));
+    PolyMemClearError();
+    PolyDestroy(&p);
+    PolyDestroy(&copy);
+}
+
+/**
+ * PolyShift of a sparse polynomial of high degree stops at its deadline.
+ */
+static void test_polyshift_deadline(void **state) {
+    (void) state;
+    Poly one = PolyFromCoeff(1), c = PolyFromCoeff(1);
+    Mono m[2] = {MonoFromPoly(&one, 0), MonoFromPoly(&c, 5000)};
+    Poly p = PolyAddMonos(2, m);
+    PolyMemClearError();
+    PolySetDeadline(1);
+    Poly res = PolyShift(&p, 1);
+    PolySetDeadline(0);
+    assert_true(PolyMemFailed());
+    assert_int_equal(PolyStopReason(), POLY_STOP_DEADLINE);
+    assert_true(PolyIsZero(&res));
+    assert_int_equal(PolyDeg(&p), 5000);
+    PolyMemClearError();
+    PolyDestroy(&p);
+}
+
+/**
+ * PolyMul over the memory budget returns zero and leaves the operands intact.
+ */
+static void test_polymul_budget(void **state) {
+    (void) state;
+    PolyMemStats stats;
+    Mono m[100];
+    for (int i = 0; i < 100; i++) {
+        Poly c = PolyFromCoeff(i + 1);
+        m[i] = MonoFromPoly(&c, i);
+    }
+    Poly p = PolyAddMonos(100, m);
+    Poly copy = PolyClone(&p);
+    PolyMemClearError();
+    PolyMemGetStats(&stats);
+    PolyMemSetBudget(stats.liveBytes + 1000 * sizeof(Mono));
+    Poly res = PolyMul(&p, &p);
+    PolyMemSetBudget(0);
+    assert_true(PolyMemFailed());
+    assert_int_equal(PolyStopReason(), POLY_STOP_MEMORY);
+    assert_true(PolyIsZero(&res));
+    assert_true(PolyIsEq(&p, &copy));
+    PolyMemClearError();
+    res = PolyMul(&p, &p);
+    assert_false(PolyMemFailed());
+    assert_int_equal(PolyDeg(&res), 198);
+    PolyDestroy(&p);
+    PolyDestroy(&copy);
+    PolyDestroy(&res);
+}
+
+/**
+ * With a session account set, the memory budget ignores monomials held
+ * by other sessions.
+ */
+static void test_polymul_budget_account(void **state) {
+    (void) state;
+    atomic_long held, own;
+    atomic_init(&held, 0);
+    atomic_init(&own, 0);
+    PolyMemClearError();
+    PolySetMemAccount(&held);
+    Mono outer[100];
+    for (int i = 0; i < 100; i++) {
+        Mono inner[30];
+        for (int j = 0; j < 30; j++) {
+            Poly c = PolyFromCoeff(i + j + 1);
+            inner[j] = MonoFromPoly(&c, j);
+        }
+        Poly c = PolyAddMonos(30, inner);
+        outer[i] = MonoFromPoly(&c, i);
+    }
+    Poly big = PolyAddMonos(100, outer);
+    Mono m[10];
+    for (int i = 0; i < 10; i++) {
+        Poly c = PolyFromCoeff(i + 1);
+        m[i] = MonoFromPoly(&c, i);
+    }
+    PolySetMemAccount(&own);
+    Poly p = PolyAddMonos(10, m);
+    PolyMemSetBudget(1000 * sizeof(Mono));
+    Poly res = PolyMul(&p, &p);
+    assert_false(PolyMemFailed());
+    assert_int_equal(PolyDeg(&res), 18);
+    PolyDestroy(&res);
+    PolySetMemAccount(NULL);
+    res = PolyMul(&p, &p);
+    PolyMemSetBudget(0);
+    assert_true(PolyMemFailed());
+    assert_true(PolyIsZero(&res));
+    PolyMemClearError();
+    PolyDestroy(&p);
+    PolyDestroy(&big);
+}
+
+/**
+ * Collects streamed terms into a PolyBuilder.
+ */
+static bool collect_term(void *arg, poly_coeff_t coeff, unsigned nvars,
+                         const poly_exp_t exps[]) {
+    (void) nvars;
+    PolyBuilderAdd(arg, coeff, exps);
+    return true;
+}
+
+/**
+ * PolyMulSink streams exactly the terms of PolyMul.
+ */
+static void test_polymulsink(void **state) {
+    (void) state;
+    PolyBuilder b, c;
+    poly_exp_t e[2];
+    PolyBuilderInit(&b, 2);
+    for (int i = 0; i < 20; i++) {
+        e[0] = i % 4;
+        e[1] = (i * 3) % 5;
+        PolyBuilderAdd(&b, i % 5 - 2, e);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    Poly test = PolyMul(&p, &p);
+    PolyBuilderInit(&c, 2);
+    assert_true(PolyMulSink(&p, &p, collect_term, &c));
+    Poly res = PolyBuilderBuild(&c);
+    assert_true(PolyIsEq(&res, &test));
+    PolyDestroy(&p);
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+    PolyBuilderDestroy(&b);
+    PolyBuilderDestroy(&c);
+}
+
+/**
+ * PolyDot equals the sum of separately computed products.
+ */
+static void test_polydot(void **state) {
+    (void) state;
+    Poly a[3], b[3];
+    Poly test = PolyZero();
+    for (int i = 0; i < 3; i++) {
+        Poly c = PolyFromCoeff(i + 1), d = PolyFromCoeff(i - 1);
+        Poly one = PolyFromCoeff(1), e = PolyFromCoeff(-1);
+        Mono ma[2] = {MonoFromPoly(&e, 0), MonoFromPoly(&c, i + 1)};
+        Mono mb[2] = {MonoFromPoly(&d, 0), MonoFromPoly(&one, 2)};
+        a[i] = PolyAddMonos(2, ma);
+        b[i] = PolyAddMonos(2, mb);
+        Poly prod = PolyMul(&a[i], &b[i]);
+        Poly sum = PolyAdd(&test, &prod);
+        PolyDestroy(&prod);
+        PolyDestroy(&test);
+        test = sum;
+    }
+    Poly res = PolyDot(3, a, b);
+    assert_true(PolyIsEq(&res, &test));
+    PolyFma(&res, &a[1], &b[2]);
+    Poly prod = PolyMul(&a[1], &b[2]);
+    Poly sum = PolyAdd(&test, &prod);
+    assert_true(PolyIsEq(&res, &sum));
+    for (int i = 0; i < 3; i++) {
+        PolyDestroy(&a[i]);
+        PolyDestroy(&b[i]);
+    }
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+    PolyDestroy(&prod);
+    PolyDestroy(&sum);
+}
+
+/**
+ * PolyCompact yields an equal polynomial laid out in one block.
+ */
+static void test_polycompact(void **state) {
+    (void) state;
+    PolyBuilder b;
+    poly_exp_t e[3];
+    PolyBuilderInit(&b, 3);
+    for (int i = 0; i < 30; i++) {
+        e[0] = i % 3;
+        e[1] = (i * 7) % 5;
+        e[2] = i % 4;
+        PolyBuilderAdd(&b, i - 15, e);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    Poly c = PolyCompact(&p);
+    assert_true(PolyIsEq(&p, &c));
+    assert_true(c.first != p.first);
+    Poly atP = PolyAt(&p, 3);
+    Poly atC = PolyAt(&c, 3);
+    assert_true(PolyIsEq(&atP, &atC));
+    PolyCompactFree(&c);
+    PolyDestroy(&p);
+    PolyDestroy(&atP);
+    PolyDestroy(&atC);
+    PolyBuilderDestroy(&b);
+}
+
+/**
+ * PolySubst matches PolyCompose with identity for the other variables.
+ */
+static void test_polysubst(void **state) {
+    (void) state;
+    PolyBuilder b;
+    poly_exp_t e[3];
+    PolyBuilderInit(&b, 3);
+    for (int i = 0; i < 12; i++) {
+        e[0] = i % 3;
+        e[1] = (i * 5) % 4;
+        e[2] = i % 2;
+        PolyBuilderAdd(&b, i - 5, e);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    Poly one = PolyFromCoeff(1), two = PolyFromCoeff(2);
+    Mono x0[2] = {MonoFromPoly(&two, 0), MonoFromPoly(&one, 1)};
+    Poly q = PolyAddMonos(2, x0);
+    Poly x[3];
+    for (unsigned i = 0; i < 3; i++) {
+        Poly c = PolyFromCoeff(1);
+        for (unsigned v = i + 1; v-- > 0;) {
+            Mono m = MonoFromPoly(&c, v == i);
+            c = PolyAddMonos(1, &m);
+        }
+        x[i] = i == 2 ? PolyClone(&q) : c;
+        if (i == 2)
+            PolyDestroy(&c);
+    }
+    Poly test = PolyCompose(&p, 3, x);
+    Poly res = PolySubst(&p, 2, &q);
+    assert_true(PolyIsEq(&res, &test));
+    for (unsigned i = 0; i < 3; i++)
+        PolyDestroy(&x[i]);
+    PolyDestroy(&p);
+    PolyDestroy(&q);
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+    PolyBuilderDestroy(&b);
+}
+
+/**
+ * PolySubst of x_1 by a polynomial independent of x_0 (substituted level
+ * by level) gives the same result as PolyCompose.
+ */
+static void test_polysubst_local(void **state) {
+    (void) state;
+    PolyBuilder b;
+    poly_exp_t e[3];
+    PolyBuilderInit(&b, 3);
+    for (int i = 0; i < 12; i++) {
+        e[0] = i % 3;
+        e[1] = (i * 5) % 4;
+        e[2] = i % 2;
+        PolyBuilderAdd(&b, i - 5, e);
+    }
+    Poly p = PolyBuilderBuild(&b);
+    poly_exp_t q1[] = {0, 2, 0}, q2[] = {0, 0, 1}, q3[] = {0, 0, 0};
+    PolyBuilderAdd(&b, 1, q1);
+    PolyBuilderAdd(&b, -1, q2);
+    PolyBuilderAdd(&b, 3, q3);
+    Poly q = PolyBuilderBuild(&b);
+    Poly x[3];
+    for (unsigned i = 0; i < 3; i++) {
+        Poly c = PolyFromCoeff(1);
+        for (unsigned v = i + 1; v-- > 0;) {
+            Mono m = MonoFromPoly(&c, v == i);
+            c = PolyAddMonos(1, &m);
+        }
+        x[i] = c;
+    }
+    PolyDestroy(&x[1]);
+    x[1] = PolyClone(&q);
+    Poly test = PolyCompose(&p, 3, x);
+    Poly res = PolySubst(&p, 1, &q);
+    assert_false(PolyMemFailed());
+    assert_true(PolyIsEq(&res, &test));
+    for (unsigned i = 0; i < 3; i++)
+        PolyDestroy(&x[i]);
+    PolyDestroy(&p);
+    PolyDestroy(&q);
+    PolyDestroy(&test);
+    PolyDestroy(&res);
+    PolyBuilderDestroy(&b);
+}
+
 /**
  * COMPOSE no argument
  */
@@ -338,6 +956,722 @@ static void test_compose_letnumcount(void **state){
     assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
 }
 
+/**
+ * SHIFT no argument
+ */
+static void test_shift_noparameter(void **state) {
+    (void) state;
+    init_input_stream("SHIFT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * SHIFT minimal argument
+ */
+static void test_shift_minvalue(void **state) {
+    (void) state;
+    init_input_stream("SHIFT -9223372036854775808\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 STACK UNDERFLOW\n");
+}
+
+/**
+ * SHIFT maximal argument
+ */
+static void test_shift_maxvalue(void **state) {
+    (void) state;
+    init_input_stream("SHIFT 9223372036854775807\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 STACK UNDERFLOW\n");
+}
+
+/**
+ * SHIFT '-1' argument
+ */
+static void test_shift_negvalue(void **state) {
+    (void) state;
+    init_input_stream("SHIFT -1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 STACK UNDERFLOW\n");
+}
+
+/**
+ * SHIFT minimal argument - 1
+ */
+static void test_shift_undervalue(void **state) {
+    (void) state;
+    init_input_stream("SHIFT -9223372036854775809\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * SHIFT maximal argument + 1
+ */
+static void test_shift_overvalue(void **state) {
+    (void) state;
+    init_input_stream("SHIFT 9223372036854775808\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * SHIFT with letter combination argument
+ */
+static void test_shift_lettervalue(void **state) {
+    (void) state;
+    init_input_stream("SHIFT SsBf\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * SHIFT with letter and number combination argument
+ */
+static void test_shift_letnumvalue(void **state) {
+    (void) state;
+    init_input_stream("SHIFT 1a2B3c4D5E\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * SHIFT of a polynomial with a coefficient argument
+ */
+static void test_shift_print(void **state) {
+    (void) state;
+    init_input_stream("(1,2)\nSHIFT 1\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,0)+(2,1)+(1,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * POW with no argument
+ */
+static void test_pow_noparameter(void **state) {
+    (void) state;
+    init_input_stream("POW\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * POW with minimal argument
+ */
+static void test_pow_mincount(void **state) {
+    (void) state;
+    init_input_stream("POW 0\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 STACK UNDERFLOW\n");
+}
+
+/**
+ * POW with maximal argument
+ */
+static void test_pow_maxcount(void **state) {
+    (void) state;
+    init_input_stream("POW 2147483647\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 STACK UNDERFLOW\n");
+}
+
+/**
+ * POW with '-1' argument
+ */
+static void test_pow_negcount(void **state) {
+    (void) state;
+    init_input_stream("POW -1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * POW with maximal argument + 1
+ */
+static void test_pow_overcount(void **state) {
+    (void) state;
+    init_input_stream("POW 2147483648\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * POW with letter and number combination argument
+ */
+static void test_pow_letnumcount(void **state) {
+    (void) state;
+    init_input_stream("POW 1a2B3c4D5E\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * POW of a polynomial
+ */
+static void test_pow_print(void **state) {
+    (void) state;
+    init_input_stream("(1,1)+(1,0)\nPOW 2\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,0)+(2,1)+(1,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * TRUNC with no argument
+ */
+static void test_trunc_noparameter(void **state) {
+    (void) state;
+    init_input_stream("TRUNC\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * TRUNC with minimal argument (no truncation)
+ */
+static void test_trunc_mincount(void **state) {
+    (void) state;
+    init_input_stream("TRUNC -1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * TRUNC with maximal argument
+ */
+static void test_trunc_maxcount(void **state) {
+    (void) state;
+    init_input_stream("TRUNC 2147483647\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * TRUNC with minimal argument - 1
+ */
+static void test_trunc_undercount(void **state) {
+    (void) state;
+    init_input_stream("TRUNC -2\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * TRUNC with maximal argument + 1
+ */
+static void test_trunc_overcount(void **state) {
+    (void) state;
+    init_input_stream("TRUNC 2147483648\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * TRUNC with letter combination argument
+ */
+static void test_trunc_lettercount(void **state) {
+    (void) state;
+    init_input_stream("TRUNC SsBf\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * POW truncated by TRUNC
+ */
+static void test_trunc_pow(void **state) {
+    (void) state;
+    init_input_stream("TRUNC 1\n(1,1)+(1,0)\nPOW 2\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,0)+(2,1)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * REORDER with no argument
+ */
+static void test_reorder_noparameter(void **state) {
+    (void) state;
+    init_input_stream("REORDER\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * REORDER with minimal argument
+ */
+static void test_reorder_minvalue(void **state) {
+    (void) state;
+    init_input_stream("REORDER 0\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * REORDER with maximal argument
+ */
+static void test_reorder_maxvalue(void **state) {
+    (void) state;
+    init_input_stream("REORDER 1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * REORDER with '-1' argument
+ */
+static void test_reorder_negvalue(void **state) {
+    (void) state;
+    init_input_stream("REORDER -1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * REORDER with maximal argument + 1
+ */
+static void test_reorder_overvalue(void **state) {
+    (void) state;
+    init_input_stream("REORDER 2\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * REORDER with letter argument
+ */
+static void test_reorder_lettervalue(void **state) {
+    (void) state;
+    init_input_stream("REORDER a\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * MUL gives the same product with and without REORDER
+ */
+static void test_reorder_mul(void **state) {
+    (void) state;
+    init_input_stream("REORDER 1\n((1,0)+(1,1),0)+(1,1)\n((1,0)+(-1,1),0)+(-1,1)\nMUL\nPRINT\nREORDER 0\n((1,0)+(1,1),0)+(1,1)\n((1,0)+(-1,1),0)+(-1,1)\nMUL\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "((1,0)+(-1,2),0)+((-2,1),1)+(-1,2)\n((1,0)+(-1,2),0)+((-2,1),1)+(-1,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * MUL_TO with no argument
+ */
+static void test_multo_noparameter(void **state) {
+    (void) state;
+    init_input_stream("MUL_TO\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG FILE\n");
+}
+
+/**
+ * MUL_TO on an empty stack
+ */
+static void test_multo_emptystack(void **state) {
+    (void) state;
+    init_input_stream("MUL_TO /nonexistent/mul_to\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 STACK UNDERFLOW\n");
+}
+
+/**
+ * MUL_TO with a single polynomial on the stack
+ */
+static void test_multo_onepoly(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\nMUL_TO /nonexistent/mul_to\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 2 STACK UNDERFLOW\n");
+}
+
+/**
+ * MUL_TO to a file that cannot be created
+ */
+static void test_multo_wrongfile(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\n(1,0)+(1,1)\nMUL_TO /nonexistent/mul_to\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 3 WRONG FILE\n");
+}
+
+/**
+ * MUL_TO writes the product in SAVE format, LOAD reads it back
+ */
+static void test_multo_load(void **state) {
+    (void) state;
+    char path[] = "/tmp/unit_tests_polyXXXXXX";
+    char input[128];
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    close(fd);
+    snprintf(input, sizeof(input),
+             "(1,1)\n(1,0)+(1,1)\nMUL_TO %s\nLOAD %s\nPRINT\n", path, path);
+    init_input_stream(input);
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,1)+(1,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+    unlink(path);
+}
+
+/**
+ * DOT with no argument
+ */
+static void test_dot_noparameter(void **state) {
+    (void) state;
+    init_input_stream("DOT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * DOT with minimal argument pushes zero
+ */
+static void test_dot_mincount(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\nDOT 0\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "0\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * DOT with too few polynomials on the stack
+ */
+static void test_dot_underflow(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\nDOT 1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 2 STACK UNDERFLOW\n");
+}
+
+/**
+ * DOT with maximal argument
+ */
+static void test_dot_maxcount(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\nDOT 4294967295\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 2 STACK UNDERFLOW\n");
+}
+
+/**
+ * DOT with maximal argument + 1
+ */
+static void test_dot_overcount(void **state) {
+    (void) state;
+    init_input_stream("DOT 4294967296\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * DOT with '-1' argument
+ */
+static void test_dot_negcount(void **state) {
+    (void) state;
+    init_input_stream("DOT -1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * DOT with letter argument
+ */
+static void test_dot_lettercount(void **state) {
+    (void) state;
+    init_input_stream("DOT a\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * DOT of two pairs
+ */
+static void test_dot_print(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\n(2,1)\n(1,0)+(1,1)\n(1,0)+(-1,1)\nDOT 2\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,0)+(1,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * FMA with too few polynomials on the stack
+ */
+static void test_fma_underflow(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\n(2,1)\nFMA\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 3 STACK UNDERFLOW\n");
+}
+
+/**
+ * FMA with an argument
+ */
+static void test_fma_parameter(void **state) {
+    (void) state;
+    init_input_stream("FMA 1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COMMAND\n");
+}
+
+/**
+ * FMA adds the product of the top two polynomials to the third
+ */
+static void test_fma_print(void **state) {
+    (void) state;
+    init_input_stream("(1,0)\n(1,1)\n(2,1)\nFMA\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,0)+(2,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * COMPACT with no argument
+ */
+static void test_compact_noparameter(void **state) {
+    (void) state;
+    init_input_stream("COMPACT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * COMPACT with '-1' argument turns compaction off
+ */
+static void test_compact_off(void **state) {
+    (void) state;
+    init_input_stream("COMPACT -1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * COMPACT with minimal argument
+ */
+static void test_compact_minvalue(void **state) {
+    (void) state;
+    init_input_stream("COMPACT 0\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * COMPACT with maximal argument
+ */
+static void test_compact_maxvalue(void **state) {
+    (void) state;
+    init_input_stream("COMPACT 4294967295\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * COMPACT with '-2' argument
+ */
+static void test_compact_undervalue(void **state) {
+    (void) state;
+    init_input_stream("COMPACT -2\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * COMPACT with maximal argument + 1
+ */
+static void test_compact_overvalue(void **state) {
+    (void) state;
+    init_input_stream("COMPACT 4294967296\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * COMPACT with letter argument
+ */
+static void test_compact_lettervalue(void **state) {
+    (void) state;
+    init_input_stream("COMPACT a\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VALUE\n");
+}
+
+/**
+ * polynomials compacted on the stack keep their value
+ */
+static void test_compact_print(void **state) {
+    (void) state;
+    init_input_stream("COMPACT 0\n(1,0)+(2,1)\n(1,1)\nMUL\nCLONE\nPRINT\nADD\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,1)+(2,2)\n(2,1)+(4,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * SUBST with no argument
+ */
+static void test_subst_noparameter(void **state) {
+    (void) state;
+    init_input_stream("SUBST\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG COUNT\n");
+}
+
+/**
+ * SUBST with minimal argument and one polynomial on the stack
+ */
+static void test_subst_minvar(void **state) {
+    (void) state;
+    init_input_stream("(1,1)\nSUBST 0\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 2 STACK UNDERFLOW\n");
+}
+
+/**
+ * SUBST with maximal argument on an empty stack
+ */
+static void test_subst_maxvar(void **state) {
+    (void) state;
+    init_input_stream("SUBST 4294967295\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 STACK UNDERFLOW\n");
+}
+
+/**
+ * SUBST with maximal argument + 1
+ */
+static void test_subst_overvar(void **state) {
+    (void) state;
+    init_input_stream("SUBST 4294967296\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VARIABLE\n");
+}
+
+/**
+ * SUBST with '-1' argument
+ */
+static void test_subst_negvar(void **state) {
+    (void) state;
+    init_input_stream("SUBST -1\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VARIABLE\n");
+}
+
+/**
+ * SUBST with letter argument
+ */
+static void test_subst_lettervar(void **state) {
+    (void) state;
+    init_input_stream("SUBST a\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(fprintf_buffer, "ERROR 1 WRONG VARIABLE\n");
+}
+
+/**
+ * SUBST of x_0 + 1 into x_0^2
+ */
+static void test_subst_print(void **state) {
+    (void) state;
+    init_input_stream("(1,0)+(1,1)\n(1,2)\nSUBST 0\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,0)+(2,1)+(1,2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * SUBST into the second variable
+ */
+static void test_subst_inner(void **state) {
+    (void) state;
+    init_input_stream("(2,0)+(1,1)\n((1,1),0)\nSUBST 1\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(2,0)+(1,1)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * SUBST into the second variable of a polynomial independent of x_0
+ */
+static void test_subst_local(void **state) {
+    (void) state;
+    init_input_stream("((3,0)+(1,2),0)\n((1,1),2)+((1,3),0)\n"
+                      "SUBST 1\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer,
+                        "((27,0)+(27,2)+(9,4)+(1,6),0)+((3,0)+(1,2),2)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * FMA leaves a cloned accumulator below it unchanged
+ */
+static void test_fma_shared(void **state) {
+    (void) state;
+    init_input_stream("(1,0)+(1,1)\nCLONE\n(1,1)\n(2,1)\nFMA\nPRINT\nPOP\nPRINT\n");
+    assert_int_equal(mock_main(), 0);
+    assert_string_equal(printf_buffer, "(1,0)+(1,1)+(2,2)\n(1,0)+(1,1)\n");
+    assert_string_equal(fprintf_buffer, "");
+}
+
+/**
+ * Length of a line that fills the server's input buffer (SERVER_MAX_PENDING).
+ */
+#define SERVER_LONG_LINE (1 << 24)
+
+/**
+ * Runs the calculator server on the socket path given as the argument.
+ */
+static void *server_thread(void *path) {
+    RunServer(path, 1, 4);
+    return NULL;
+}
+
+/**
+ * Server answers a line that does not fit its buffer with an error
+ * and closes the connection.
+ */
+static void test_server_longline(void **state) {
+    (void) state;
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    char dir[] = "/tmp/unit_tests_polyXXXXXX";
+    char reply[64] = "";
+    size_t len = 0;
+    ssize_t n;
+    pthread_t server;
+    assert_non_null(mkdtemp(dir));
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/sock", dir);
+    assert_int_equal(pthread_create(&server, NULL, server_thread,
+                                     addr.sun_path), 0);
+    struct timeval timeout = {.tv_sec = 10};
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert_true(fd >= 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+        usleep(1000);
+    char *line = malloc(SERVER_LONG_LINE);
+    assert_non_null(line);
+    memset(line, '1', SERVER_LONG_LINE);
+    for (size_t sent = 0; sent < SERVER_LONG_LINE; sent += n) {
+        n = send(fd, line + sent, SERVER_LONG_LINE - sent, MSG_NOSIGNAL);
+        assert_true(n > 0);
+    }
+    while ((n = recv(fd, reply + len, sizeof(reply) - 1 - len, 0)) > 0)
+        len += n;
+    assert_int_equal(n, 0);
+    assert_string_equal(reply, "ERROR 1 LINE TOO LONG\n");
+    close(fd);
+    free(line);
+    pthread_kill(server, SIGINT);
+    pthread_join(server, NULL);
+    rmdir(dir);
+}
+
 int main() {
     const struct CMUnitTest tests1[] = {
             cmocka_unit_test(test_polyzero_countzero),
@@ -346,7 +1680,25 @@ int main() {
             cmocka_unit_test(test_polyconst_countone_polyconst),
             cmocka_unit_test(test_polyvarzero_countzero),
             cmocka_unit_test(test_polyvarzero_countone_polyconst),
-            cmocka_unit_test(test_polyvarzero_countone_polyvarzero)
+            cmocka_unit_test(test_polyvarzero_countone_polyvarzero),
+            cmocka_unit_test(test_polyshift_square),
+            cmocka_unit_test(test_polyserialize_roundtrip),
+            cmocka_unit_test(test_polydeserialize_malformed),
+            cmocka_unit_test(test_polybuilder_duplicates),
+            cmocka_unit_test(test_polymulexternal_runs),
+            cmocka_unit_test(test_polyview_roundtrip),
+            cmocka_unit_test(test_polyview_corrupt),
+            cmocka_unit_test(test_polymultrunc),
+            cmocka_unit_test(test_polypermutevars),
+            cmocka_unit_test(test_polymul_deadline),
+            cmocka_unit_test(test_polyshift_deadline),
+            cmocka_unit_test(test_polymul_budget),
+            cmocka_unit_test(test_polymul_budget_account),
+            cmocka_unit_test(test_polymulsink),
+            cmocka_unit_test(test_polydot),
+            cmocka_unit_test(test_polycompact),
+            cmocka_unit_test(test_polysubst),
+            cmocka_unit_test(test_polysubst_local)
     };
     const struct CMUnitTest tests2[] = {
             cmocka_unit_test_setup(test_compose_noparameter, test_setup),
@@ -357,6 +1709,71 @@ int main() {
             cmocka_unit_test_setup(test_compose_bigcount, test_setup),
             cmocka_unit_test_setup(test_compose_lettercount, test_setup),
             cmocka_unit_test_setup(test_compose_letnumcount, test_setup),
+            cmocka_unit_test_setup(test_shift_noparameter, test_setup),
+            cmocka_unit_test_setup(test_shift_minvalue, test_setup),
+            cmocka_unit_test_setup(test_shift_maxvalue, test_setup),
+            cmocka_unit_test_setup(test_shift_negvalue, test_setup),
+            cmocka_unit_test_setup(test_shift_undervalue, test_setup),
+            cmocka_unit_test_setup(test_shift_overvalue, test_setup),
+            cmocka_unit_test_setup(test_shift_lettervalue, test_setup),
+            cmocka_unit_test_setup(test_shift_letnumvalue, test_setup),
+            cmocka_unit_test_setup(test_shift_print, test_setup),
+            cmocka_unit_test_setup(test_pow_noparameter, test_setup),
+            cmocka_unit_test_setup(test_pow_mincount, test_setup),
+            cmocka_unit_test_setup(test_pow_maxcount, test_setup),
+            cmocka_unit_test_setup(test_pow_negcount, test_setup),
+            cmocka_unit_test_setup(test_pow_overcount, test_setup),
+            cmocka_unit_test_setup(test_pow_letnumcount, test_setup),
+            cmocka_unit_test_setup(test_pow_print, test_setup),
+            cmocka_unit_test_setup(test_trunc_noparameter, test_setup),
+            cmocka_unit_test_setup(test_trunc_mincount, test_setup),
+            cmocka_unit_test_setup(test_trunc_maxcount, test_setup),
+            cmocka_unit_test_setup(test_trunc_undercount, test_setup),
+            cmocka_unit_test_setup(test_trunc_overcount, test_setup),
+            cmocka_unit_test_setup(test_trunc_lettercount, test_setup),
+            cmocka_unit_test_setup(test_trunc_pow, test_setup),
+            cmocka_unit_test_setup(test_reorder_noparameter, test_setup),
+            cmocka_unit_test_setup(test_reorder_minvalue, test_setup),
+            cmocka_unit_test_setup(test_reorder_maxvalue, test_setup),
+            cmocka_unit_test_setup(test_reorder_negvalue, test_setup),
+            cmocka_unit_test_setup(test_reorder_overvalue, test_setup),
+            cmocka_unit_test_setup(test_reorder_lettervalue, test_setup),
+            cmocka_unit_test_setup(test_reorder_mul, test_setup),
+            cmocka_unit_test_setup(test_multo_noparameter, test_setup),
+            cmocka_unit_test_setup(test_multo_emptystack, test_setup),
+            cmocka_unit_test_setup(test_multo_onepoly, test_setup),
+            cmocka_unit_test_setup(test_multo_wrongfile, test_setup),
+            cmocka_unit_test_setup(test_multo_load, test_setup),
+            cmocka_unit_test_setup(test_dot_noparameter, test_setup),
+            cmocka_unit_test_setup(test_dot_mincount, test_setup),
+            cmocka_unit_test_setup(test_dot_underflow, test_setup),
+            cmocka_unit_test_setup(test_dot_maxcount, test_setup),
+            cmocka_unit_test_setup(test_dot_overcount, test_setup),
+            cmocka_unit_test_setup(test_dot_negcount, test_setup),
+            cmocka_unit_test_setup(test_dot_lettercount, test_setup),
+            cmocka_unit_test_setup(test_dot_print, test_setup),
+            cmocka_unit_test_setup(test_fma_underflow, test_setup),
+            cmocka_unit_test_setup(test_fma_parameter, test_setup),
+            cmocka_unit_test_setup(test_fma_print, test_setup),
+            cmocka_unit_test_setup(test_compact_noparameter, test_setup),
+            cmocka_unit_test_setup(test_compact_off, test_setup),
+            cmocka_unit_test_setup(test_compact_minvalue, test_setup),
+            cmocka_unit_test_setup(test_compact_maxvalue, test_setup),
+            cmocka_unit_test_setup(test_compact_undervalue, test_setup),
+            cmocka_unit_test_setup(test_compact_overvalue, test_setup),
+            cmocka_unit_test_setup(test_compact_lettervalue, test_setup),
+            cmocka_unit_test_setup(test_compact_print, test_setup),
+            cmocka_unit_test_setup(test_subst_noparameter, test_setup),
+            cmocka_unit_test_setup(test_subst_minvar, test_setup),
+            cmocka_unit_test_setup(test_subst_maxvar, test_setup),
+            cmocka_unit_test_setup(test_subst_overvar, test_setup),
+            cmocka_unit_test_setup(test_subst_negvar, test_setup),
+            cmocka_unit_test_setup(test_subst_lettervar, test_setup),
+            cmocka_unit_test_setup(test_subst_print, test_setup),
+            cmocka_unit_test_setup(test_subst_inner, test_setup),
+            cmocka_unit_test_setup(test_subst_local, test_setup),
+            cmocka_unit_test_setup(test_fma_shared, test_setup),
+            cmocka_unit_test_setup(test_server_longline, test_setup),
     };
 
     return cmocka_run_group_tests(tests1, NULL, NULL) || cmocka_run_group_tests(tests2, NULL, NULL);